@@ -1,515 +1,4508 @@
-#ifndef SMALL_CHIP_8_HEADER
-#define SMALL_CHIP_8_HEADER
-
-/*
-The MIT License
-
-Copyright (c) 2025 Viktor Hugo C.M.G.
-
-Permission is hereby granted, free of charge, to any person obtaining a copy 
-    of this software and associated documentation files (the “Software”), to deal 
-    in the Software without restriction, including without limitation the rights 
-    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
-    copies of the Software, and to permit persons to whom the Software is 
-    furnished to do so, subject to the following conditions:
-The above copyright notice and this permission notice shall be included in 
-    all copies or substantial portions of the Software.
-THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
-    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
-    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
-    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
-    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
-    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
-    THE SOFTWARE.
-
-*/
-
-/*
-Resources used:
-http://devernay.free.fr/hacks/chip8/C8TECH10.HTM#0.1
-https://multigesture.net/articles/how-to-write-an-emulator-chip-8-interpreter/
-*/
-
-#include <assert.h>
-#include <string.h>
-#include <stdbool.h>
-#include <stddef.h>
-#include <stdint.h>
-
-#define SC8_ATTR_FORMAT(a, b) __attribute__((format(printf, a, b)))
-
-#define SC8_LSB(val) ((val) & 1)
-#define SC8_MSB(val) ((val) >> (sizeof(val)*8 - 1) & 1) // not portable blah blah blah I don't care
-
-#define SC8_MAX(a, b) (((a) > (b)) ? (a) : (b))
-#define SC8_MIN(a, b) (((a) < (b)) ? (a) : (b))
-#define SC8_CLAMP(value, min, max) SC8_MIN(SC8_MAX(value, min), max)
-
-#define SC8_N(value)   ((value) & 0x000F)
-#define SC8_NNN(value) ((value) & 0x0FFF)
-#define SC8_Vx(value) (((value) & 0x0F00) >> 8)
-#define SC8_Vy(value) (((value) & 0x00F0) >> 4)
-#define SC8_KK(value) ((value) & 0x00FF)
-
-// changing this value probably won't expand the memory,
-// it's only here so I don't need to remember 4096 and type it out everywhere
-#define MEMORY_SIZE 4096
-// changing those won't have effect as well
-#define SC8_W 64
-#define SC8_H 32
-typedef struct {
-    uint8_t memory[MEMORY_SIZE];
-    bool gfx[SC8_W * SC8_H];
-    
-    // The user should be aware of the draw flag and render the gfx array
-    // properly to the screen whenever it's set.
-    bool drawFlag;
-    // The user should handle this array (since sc8 doesn't enforce any IO library),
-    // handling this array means defining the sc8_updateKeyArray function.
-    // The recomended layout is as follows:
-    // +-+-+-+-+    +-+-+-+-+
-    // |1|2|3|C|    |1|2|3|4|
-    // +-+-+-+-+    +-+-+-+-+
-    // |4|5|6|D|    |Q|W|E|R|
-    // +-+-+-+-+ -> +-+-+-+-+
-    // |7|8|9|E|    |A|S|D|F|
-    // +-+-+-+-+    +-+-+-+-+
-    // |A|0|B|F|    |Z|X|C|V|
-    // +-+-+-+-+    +-+-+-+-+
-    //
-    // note: The index is the key value (for example,
-    // if the key 2 was pressed, the key at index 0x2 should be set to true)
-    // ```c
-    // state.key[key_pressed] = true; // , as simple as that
-    // ```
-    // 
-    // WARNING: NOT HANDLING THIS PROPERLY MAY AND WILL LEAD TO YOUR EMULATED PROGRAMS NOT WORKING
-    //
-    bool key[16];
-
-    uint16_t opcode;
-
-    union {
-        uint8_t v[16];
-        struct {
-            uint8_t v0;
-            uint8_t v1;
-            uint8_t v2;
-            uint8_t v3;
-            uint8_t v4;
-            uint8_t v5;
-            uint8_t v6;
-            uint8_t v7;
-            uint8_t v8;
-            uint8_t v9;
-            uint8_t va;
-            uint8_t vb;
-            uint8_t vc;
-            uint8_t vd;
-            uint8_t ve;
-            uint8_t vf;
-        };
-    };
-
-    uint16_t i;
-    uint16_t pc;
-
-    uint8_t dt;
-    uint8_t st;
-
-    uint8_t stack[16];
-    uint8_t sp;
-} sc8_state;
-
-// file hanlde
-typedef void* sc8_fh;
-
-#ifdef __cplusplus
-extern "C" {
-#endif // __cplusplus
-
-// IO declarations (user defined)
-
-sc8_fh sc8_fopen(const char *file_path, const char *mode);
-void sc8_fclose(sc8_fh fh);
-size_t sc8_fread(void *buffer, size_t size, size_t count, sc8_fh fh);
-bool sc8_fnil(sc8_fh fh);
-
-int sc8_errprintf(const char *format, ...) SC8_ATTR_FORMAT(1, 2);
-
-// media IO declarations (user defined as well)
-
-// the user should define this function for handling the key array
-void sc8_updateKeyArray(sc8_state *state);
-void sc8_beep(void);
-
-// random generator
-
-extern uint32_t sc8_xorRandState;
-uint32_t sc8_xorRand();
-#define sc8_defRand() sc8_xorRand() // you can modify this
-
-// sc8 emulator
-
-void sc8_init(sc8_state *state);
-
-void sc8_loadRom(sc8_state *state, const uint8_t *rom, size_t rom_size);
-typedef enum {
-    sc8_loadFile_OK,
-    sc8_loadFile_EmptyROM,
-    sc8_loadFile_fopenError,
-} sc8_LoadFileResult;
-sc8_LoadFileResult sc8_loadFile(sc8_state *state, const char *file_path);
-
-void sc8_loadRomPad(sc8_state *state, const uint8_t *rom, size_t rom_size, int padding);
-sc8_LoadFileResult sc8_loadFilePad(sc8_state *state, const char *file_path, int padding);
-
-bool sc8_step(sc8_state *state);
-
-// define `SC8_NO_DEFAULT_FONTSET` to disable the default fontset (it's 8x5 pixels for char)
-extern const uint8_t sc8_fontset[80];
-
-#ifndef SC8_NO_DEFAULT_FONTSET
-const uint8_t sc8_fontset[80] = { 
-  0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-  0x20, 0x60, 0x20, 0x20, 0x70, // 1
-  0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-  0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-  0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-  0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-  0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-  0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-  0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-  0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-  0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-  0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-  0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-  0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-  0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-  0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-};
-#endif // SC8_NO_DEFAULT_FONTSET
-
-#ifdef SC8_USE_STDIO
-#include <stdarg.h>
-#include <stdio.h>
-
-sc8_fh sc8_fopen(const char *file_path, const char *mode) {
-    return fopen(file_path, mode);
-}
-void sc8_fclose(sc8_fh fh) {
-    fclose(fh);
-}
-size_t sc8_fread(void *buffer, size_t size, size_t count, sc8_fh fh) {
-    return fread(buffer, size, count, fh);
-}
-bool sc8_fnil(sc8_fh fh) {
-    return fh == NULL;
-}
-
-int sc8_errprintf(const char *format, ...) {
-    va_list args;
-    va_start(args, format);
-    int ret = vfprintf(stderr, format, args);
-    va_end(args);
-    return ret;
-}
-#endif // SC8_USE_STDIO
-
-#define SC8_IMPLEMENTATION
-#ifdef SC8_IMPLEMENTATION
-uint32_t sc8_xorRandState = 305419896;
-
-uint32_t sc8_xorRand() {
-    sc8_xorRandState ^= sc8_xorRandState << 13;
-    sc8_xorRandState ^= sc8_xorRandState >> 17;
-    sc8_xorRandState ^= sc8_xorRandState << 5;
-    return sc8_xorRandState;
-}
-
-void sc8_init(sc8_state *state) {
-    memset(state, 0, sizeof(sc8_state));
-    state->pc = 512;
-
-    // load fontset
-    memcpy(state->memory, sc8_fontset, 80);
-    // for(int i = 0; i < 80; i++) {
-    //     state->memory[i] = sc8_fontset[i];
-    // }
-}
-
-void sc8_loadRom(sc8_state *state, const uint8_t *rom, size_t rom_size) {
-    assert((rom_size < (MEMORY_SIZE - 512)) && "The ROM size is greater than the maximum memory size");
-    memcpy(state->memory + 512, rom, rom_size);
-}
-
-sc8_LoadFileResult sc8_loadFile(sc8_state *state, const char *file_path) {
-    sc8_fh f = sc8_fopen(file_path, "rb");
-    if(sc8_fnil(f)) {
-        return sc8_loadFile_fopenError;
-    }
-
-    size_t rom_size = sc8_fread(state->memory + 512, 1, MEMORY_SIZE - 512, f);
-    sc8_fclose(f);
-
-    return rom_size == 0;
-}
-
-void sc8_loadRomPad(sc8_state *state, const uint8_t *rom, size_t rom_size, int padding) {
-    assert((rom_size < (size_t)(MEMORY_SIZE - padding)) && "The ROM size is greater than the maximum memory size");
-    memcpy(state->memory + padding, rom, rom_size);
-}
-
-sc8_LoadFileResult sc8_loadFilePad(sc8_state *state, const char *file_path, int padding) {
-    sc8_fh f = sc8_fopen(file_path, "rb");
-    if(sc8_fnil(f)) {
-        return sc8_loadFile_fopenError;
-    }
-
-    size_t rom_size = sc8_fread(state->memory + padding, 1, MEMORY_SIZE - padding, f);
-    sc8_fclose(f);
-
-    return rom_size == 0;
-}
-
-bool sc8_step(sc8_state *state) {
-    state->opcode = state->memory[state->pc] << 8 | state->memory[state->pc + 1];
-    uint16_t opcode = state->opcode;
-
-    sc8_updateKeyArray(state);
-
-    bool unknown_opcode = false;
-    switch(opcode & 0xF000) {
-        case 0x0000: {
-            switch(opcode & 0x000F) {
-                case 0x0000: {
-                    memset(state->gfx, 0, sizeof(state->gfx));
-                    state->drawFlag = true;
-                    state->pc += 2;
-                } break;
-                case 0x000E: {
-                    state->pc = state->stack[state->sp--];
-                    state->pc += 2;
-                } break;
-                default: {
-                    sc8_errprintf("Unknown opcode: %04X\n", opcode);
-                    unknown_opcode = true;
-                    state->pc+=2;
-                } break;
-            }
-        } break;
-        case 0x1000: {
-            state->pc = SC8_NNN(opcode);
-        } break;
-        case 0x2000: {
-            state->stack[state->sp++] = state->pc;
-            state->pc = SC8_NNN(opcode);
-        } break;
-        case 0x3000: {
-            state->pc += (state->v[SC8_Vx(opcode)] == SC8_KK(opcode)) ? 4 : 2;
-        } break;
-        case 0x4000: {
-            state->pc += (state->v[SC8_Vx(opcode)] != SC8_KK(opcode)) ? 4 : 2;
-        } break;
-        case 0x5000: {
-            state->pc += (state->v[SC8_Vx(opcode)] == state->v[SC8_Vy(opcode)]) ? 4 : 2;
-        } break;
-        case 0x6000: {
-            state->v[SC8_Vx(opcode)] = SC8_KK(opcode);
-            state->pc += 2;
-        } break;
-        case 0x7000: {
-            state->v[SC8_Vx(opcode)] += SC8_KK(opcode);
-            state->pc += 2;
-        } break;
-        case 0x8000: {
-            switch(opcode & 0x000F) {
-                case 0x0000: {
-                    state->v[SC8_Vx(opcode)] = SC8_Vy(opcode);
-                } break;
-                case 0x0001: {
-                    state->v[SC8_Vx(opcode)] |= SC8_Vy(opcode);
-                } break;
-                case 0x0002: {
-                    state->v[SC8_Vx(opcode)] &= SC8_Vy(opcode);
-                } break;
-                case 0x0003: {
-                    state->v[SC8_Vx(opcode)] ^= SC8_Vy(opcode);
-                } break;
-                case 0x0004: {
-                    const uint8_t x = state->v[SC8_Vx(opcode)], y = state->v[SC8_Vy(opcode)];
-                    size_t result = x + y;
-                    state->vf = (result > 255) ? 1 : 0;
-                    state->v[SC8_Vx(opcode)] = result;
-                } break;
-                case 0x0005: {
-                    const uint8_t x = state->v[SC8_Vx(opcode)], y = state->v[SC8_Vy(opcode)];
-                    state->vf = (x > y) ? 1 : 0;
-                    state->v[SC8_Vx(opcode)] = x - y;
-                } break;
-                case 0x0006: {
-                    const uint8_t x = state->v[SC8_Vx(opcode)];
-                    state->vf = SC8_LSB(x) ? 1 : 0;
-                    state->v[SC8_Vx(opcode)] >>= 1;
-                } break;
-                case 0x0007: {
-                    const uint8_t x = state->v[SC8_Vx(opcode)], y = state->v[SC8_Vy(opcode)];
-                    state->vf = (y > x) ? 1 : 0;
-                    state->v[SC8_Vx(opcode)] = y - x;
-                } break;
-                case 0x000E: {
-                    const uint8_t x = state->v[SC8_Vx(opcode)];
-                    state->vf = SC8_MSB(x) ? 1 : 0;
-                    state->v[SC8_Vx(opcode)] <<= 1;
-                } break;
-                
-                default: {
-                    sc8_errprintf("Unknown opcode: %04X\n", opcode);
-                    unknown_opcode = true;
-                    state->pc+=2;
-                } break;
-            }
-            state->pc += 2;
-        } break;
-        case 0x9000: {
-            state->pc += (state->v[SC8_Vx(opcode)] != state->v[SC8_Vy(opcode)]) ? 4 : 2;
-        } break;
-        case 0xA000: {
-            state->i = SC8_NNN(opcode);
-            state->pc += 2;
-        } break;
-        case 0xB000: {
-            state->pc = SC8_NNN(opcode) + state->v0;
-        } break;
-        case 0xC000: {
-            state->v[SC8_Vx(opcode)] = (uint8_t)sc8_defRand() & SC8_KK(opcode);
-            state->pc += 2;
-        } break;
-        case 0xD000: {
-            const uint8_t x = state->v[SC8_Vx(opcode)], y = state->v[SC8_Vy(opcode)];
-            uint8_t height = SC8_N(opcode);
-            
-            state->vf = 0;
-            for(int irow = 0; irow < height; irow++) {
-                uint8_t row = state->memory[0 + irow];
-                for(int ipixel = 0; ipixel < 8; ipixel++) {
-                    bool pixel = (row & (0x80 >> ipixel)) != 0;
-                    const int index = (x + ipixel) * ((y + irow) * SC8_W);
-                    state->vf = pixel && (state->gfx[index] != 0);
-                    state->gfx[index] ^= pixel;
-                }
-            }
-
-            state->drawFlag = true;
-            state->pc += 2;
-        } break;
-        case 0xE000: {
-            switch(opcode & 0x00FF) {
-                case 0x009E: {
-                    state->pc += 
-                        (state->key[state->v[SC8_Vx(opcode)]]) ? 4 : 2;
-                } break;
-                case 0x00A1: {
-                    state->pc += 
-                        !(state->key[state->v[SC8_Vx(opcode)]]) ? 4 : 2;
-                } break;
-                default: {
-                    sc8_errprintf("Unknown opcode: %04X\n", opcode);
-                    unknown_opcode = true;
-                    state->pc+=2;
-                } break;
-            }
-        } break;
-        case 0xF000: {
-            switch(opcode & 0x00FF) {
-                case 0x0007: {
-                    state->v[SC8_Vx(opcode)] = state->dt;
-                    state->pc += 2;
-                } break;
-                case 0x000A: {
-                    for(;;) {
-                        for(int key = 0; key < 16; key++) {
-                            if(state->key[key]) {
-                                state->v[SC8_Vx(opcode)] = key;
-                                goto OPCODE_0x000A_EXIT;
-                            }
-                        }
-                        sc8_updateKeyArray(state);
-                    }
-OPCODE_0x000A_EXIT:
-                    state->pc += 2;
-                } break;
-                case 0x0015: {
-                    state->dt = state->v[SC8_Vx(opcode)];
-                    state->pc += 2;
-                } break;
-                case 0x0018: {
-                    state->st = state->v[SC8_Vx(opcode)];
-                    state->pc += 2;
-                } break;
-                case 0x001E: {
-                    state->i += state->v[SC8_Vx(opcode)];
-                    state->pc += 2;
-                } break;
-                case 0x0029: {
-                    state->i = state->v[SC8_Vx(opcode)] * 5; // neat trick, take a look at the sc8_fontset
-                                                             // array to understand it.
-                    state->pc += 2;
-                } break;
-                case 0x0033: {
-                    const uint8_t x = state->v[SC8_Vx(opcode)];
-                    state->memory[state->i] = x / 100;
-                    state->memory[state->i + 1] = (x / 10) % 10;
-                    state->memory[state->i + 2] = (x % 100) % 10;
-                    state->pc += 2;
-                } break;
-                case 0x0055: {
-                    for(int i = 0; i < SC8_Vx(opcode); i++) {
-                        state->memory[state->i + i] = state->v[i];
-                    }
-                    state->pc += 2;
-                } break;
-                case 0x0065: {
-                    for(int i = 0; i < SC8_Vx(opcode); i++) {
-                        state->v[i] = state->memory[state->i + i];
-                    }
-                    state->pc += 2;
-                } break;
-                case 0x00FF: {
-                    // this instruction is just a repeat, basically exits the program
-                } break;
-
-                default: {
-                    sc8_errprintf("Unknown opcode: %04X\n", opcode);
-                    unknown_opcode = true;
-                    state->pc+=2;
-                } break;
-            }
-        } break;
-
-        default: {
-            sc8_errprintf("Unknown opcode: %04X\n", state->opcode);
-            unknown_opcode = true;
-            state->pc+=2;
-        } break;
-    }
-
-    if(state->dt > 0) {
-        state->dt--;
-    }
-    if(state->st > 0) {
-        sc8_beep();
-        state->st--;
-    }
-
-    return !unknown_opcode;
-}
-
-#undef SC8_IMPLEMENTATION
-#endif // SC8_IMPLEMENTATION
-
-#ifdef __cplusplus
-}
-#endif // __cplusplus
-
+#ifndef SMALL_CHIP_8_HEADER
+#define SMALL_CHIP_8_HEADER
+
+/*
+The MIT License
+
+Copyright (c) 2025 Viktor Hugo C.M.G.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy 
+    of this software and associated documentation files (the “Software”), to deal 
+    in the Software without restriction, including without limitation the rights 
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+    copies of the Software, and to permit persons to whom the Software is 
+    furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+    THE SOFTWARE.
+
+*/
+
+/*
+Resources used:
+http://devernay.free.fr/hacks/chip8/C8TECH10.HTM#0.1
+https://multigesture.net/articles/how-to-write-an-emulator-chip-8-interpreter/
+*/
+
+#include <assert.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// the profiler and the tracer need every instruction to go through the interpreter
+#if defined(SC8_JIT) && defined(__x86_64__) && defined(__linux__) && !defined(SC8_PROFILE) && !defined(SC8_TRACE) && \
+    !defined(SC8_SAMPLER)
+#define SC8__JIT_X64
+#include <sys/mman.h>
+#endif
+
+#ifdef SC8_EVENT_THREAD
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#if defined(SC8_TRACE) && defined(__linux__)
+#include <sched.h>
+#endif
+
+#if defined(SC8_SAMPLER) && defined(__linux__)
+#define SC8__SAMPLER
+#include <sched.h>
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+#define SC8_ATTR_FORMAT(a, b) __attribute__((format(printf, a, b)))
+#define SC8__FORCE_INLINE __attribute__((always_inline)) inline
+#define SC8__COLD __attribute__((cold, noinline))
+
+#define SC8_LSB(val) ((val) & 1)
+#define SC8_MSB(val) ((val) >> (sizeof(val)*8 - 1) & 1) // not portable blah blah blah I don't care
+
+#define SC8_MAX(a, b) (((a) > (b)) ? (a) : (b))
+#define SC8_MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define SC8_CLAMP(value, min, max) SC8_MIN(SC8_MAX(value, min), max)
+
+#define SC8_N(value)   ((value) & 0x000F)
+#define SC8_NNN(value) ((value) & 0x0FFF)
+#define SC8_Vx(value) (((value) & 0x0F00) >> 8)
+#define SC8_Vy(value) (((value) & 0x00F0) >> 4)
+#define SC8_KK(value) ((value) & 0x00FF)
+
+// changing this value probably won't expand the memory,
+// it's only here so I don't need to remember 4096 and type it out everywhere
+#define MEMORY_SIZE 4096
+// changing those won't have effect as well
+#define SC8_W 64
+#define SC8_H 32
+
+// What the interpreter is stuck on, see `wait` in `sc8_state`.
+typedef enum {
+    sc8_wait_None,
+    sc8_wait_Key,  // Fx0A with no key pressed and released yet
+    sc8_wait_Halt, // F0FF
+} sc8_Wait;
+
+// A key going down or up, see `sc8_keyDown`.
+typedef struct {
+    uint64_t cycle; // applied right before the instruction that runs once `cycles + idle` gets here
+    uint8_t key;
+    bool down;
+} sc8_keyEvent;
+
+// Bounded queue of key events between the thread pushing them and the one running the
+// interpreter. Single producer, single consumer, so it needs no locks.
+#define SC8_KEY_QUEUE 64 // has to be a power of two
+typedef struct {
+    sc8_keyEvent events[SC8_KEY_QUEUE];
+    uint32_t head; // only written by `sc8_keyDown`/`sc8_keyUp`
+    uint32_t tail; // only written by the interpreter
+} sc8_keyQueue;
+
+// What an opcode decodes to, one per handler.
+#define SC8__KINDS(X)                                                   \
+    X(Unknown) X(Unknown8) X(CLS) X(RET) X(JP) X(CALL) X(SEi) X(SNEi)    \
+    X(SE) X(LDi) X(ADDi) X(LD) X(OR) X(AND) X(XOR) X(ADD) X(SUB) X(SHR)  \
+    X(SUBN) X(SHL) X(SNE) X(LDI) X(JPV0) X(RND) X(DRW) X(SKP) X(SKNP)    \
+    X(LDVxDT) X(LDK) X(LDDT) X(LDST) X(ADDI) X(LDF) X(LDB) X(STORE)      \
+    X(LOAD) X(HALT)
+
+enum {
+#define SC8__KIND_ENUM(name) sc8__kind##name,
+    SC8__KINDS(SC8__KIND_ENUM)
+#undef SC8__KIND_ENUM
+    sc8__kindCount
+};
+
+// A predecoded instruction, see `sc8_blockCache`.
+typedef struct {
+    uint16_t opcode;
+    uint8_t kind; // which handler executes it
+    uint8_t len;  // instructions left in its basic block (itself included), 0 when not decoded
+} sc8_uop;
+
+// Basic-block cache, `sc8_stepMany` runs through it once it's attached with `sc8_attachCache`.
+// Blocks are decoded once and then executed straight from here, every address has its own slot
+// so jumping into the middle of a block (or to an odd address) doesn't need decoding again.
+// Fx33/Fx55 writing over decoded code drop exactly the slots they touch, if you write into
+// `memory` yourself, call `sc8_cacheInvalidate` (the sc8_load* functions already do).
+#define SC8_BLOCK_MAX 32
+typedef struct sc8_blockCache {
+    sc8_uop uops[MEMORY_SIZE];
+    uint64_t codePages; // one bit per 64 byte page holding decoded code
+} sc8_blockCache;
+
+typedef struct {
+    // Kept up here, out of reach of a runaway stack pointer.
+    sc8_blockCache *cache;     // NULL unless one was attached
+    struct sc8_jit *jit;       // same, only used when built with `SC8_JIT`
+    struct sc8_keyLog *keyLog; // same, see `sc8_attachKeyLog`
+    struct sc8_eventLog *events; // same, see `sc8_attachEventLog`
+#ifdef SC8_PROFILE
+    struct sc8_profile *profile; // same, see `sc8_attachProfile`
+#endif
+#ifdef SC8_TRACE
+    struct sc8_trace *trace; // same, see `sc8_attachTrace`
+#endif
+#ifdef SC8_SAMPLER
+    uint32_t sample; // pc << 16 | opcode of the last instruction run, for the sampler's handler
+#endif
+
+    uint8_t memory[MEMORY_SIZE];
+    // One row per word, the leftmost pixel in the top bit. Use `sc8_getPixel` if you'd
+    // rather not deal with that.
+    uint64_t gfx[SC8_H];
+    // One bit per row of `gfx` changed since the last `sc8_takeDirtyRows`, row 0 in bit 0.
+    uint32_t dirtyRows;
+    
+    // The user should be aware of the draw flag and render the gfx array
+    // properly to the screen whenever it's set.
+    bool drawFlag;
+    // Keys currently down. sc8 doesn't enforce any IO library, so the user should push
+    // the keyboard's key events with `sc8_keyDown`/`sc8_keyUp`, which keep this up to date.
+    // The recomended layout is as follows:
+    // +-+-+-+-+    +-+-+-+-+
+    // |1|2|3|C|    |1|2|3|4|
+    // +-+-+-+-+    +-+-+-+-+
+    // |4|5|6|D|    |Q|W|E|R|
+    // +-+-+-+-+ -> +-+-+-+-+
+    // |7|8|9|E|    |A|S|D|F|
+    // +-+-+-+-+    +-+-+-+-+
+    // |A|0|B|F|    |Z|X|C|V|
+    // +-+-+-+-+    +-+-+-+-+
+    //
+    // note: The index is the key value (for example,
+    // if the key 2 was pressed, the key at index 0x2 is true)
+    // ```c
+    // sc8_keyDown(&state, key_pressed, 0); // , as simple as that
+    // ```
+    // 
+    // WARNING: NOT HANDLING THIS PROPERLY MAY AND WILL LEAD TO YOUR EMULATED PROGRAMS NOT WORKING
+    //
+    bool key[16];
+    sc8_keyQueue keyQueue;
+    // Fx0A: keys that went down since it started waiting, and the ones of those that came
+    // back up (it takes the first of them).
+    bool keyWaiting;
+    uint16_t keysPressed;
+    uint16_t keysReleased;
+
+    uint16_t opcode;
+
+    union {
+        uint8_t v[16];
+        struct {
+            uint8_t v0;
+            uint8_t v1;
+            uint8_t v2;
+            uint8_t v3;
+            uint8_t v4;
+            uint8_t v5;
+            uint8_t v6;
+            uint8_t v7;
+            uint8_t v8;
+            uint8_t v9;
+            uint8_t va;
+            uint8_t vb;
+            uint8_t vc;
+            uint8_t vd;
+            uint8_t ve;
+            uint8_t vf;
+        };
+    };
+
+    uint16_t i;
+    uint16_t pc;
+
+    uint8_t dt;
+    uint8_t st;
+
+    uint16_t stack[16]; // return addresses, `stack[sp - 1]` is the newest
+    uint8_t sp;
+
+    // one bit per address, see `sc8_run`
+    uint64_t breakpoints[MEMORY_SIZE / 64];
+
+    // Instructions executed so far (by `sc8_step`, `sc8_stepMany`, `sc8_run`..., counted as
+    // each one runs), in the current frame of `sc8_runFrame` and frames it completed.
+    uint64_t cycles;
+    uint32_t frameCycles;
+    uint64_t frames;
+    // Frames `sc8_runFrame` ended waiting on Fx0A or F0FF. Key events go by `cycles + idle`
+    // so a wait still moves their clock on, see `sc8_keyDown`.
+    uint64_t idle;
+    // Quirk: DXYN ends the frame in `sc8_runFrame`, like the original interpreter waiting
+    // for the vertical blank before drawing.
+    bool displayWait;
+    // Quirk: sprites wrap around the edges of the screen instead of being clipped.
+    bool wrapSprites;
+
+    // Set when Fx0A is still waiting for a key or F0FF ran, for the last call into the
+    // interpreter. pc stays on that instruction, so stepping again carries on once a key
+    // was pressed and released (F0FF never does).
+    sc8_Wait wait;
+
+    // `sc8_xorRand`'s state, `sc8_init` seeds it.
+    uint32_t xorRandState;
+} sc8_state;
+
+// file hanlde
+typedef void* sc8_fh;
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+// IO declarations (user defined)
+
+sc8_fh sc8_fopen(const char *file_path, const char *mode);
+void sc8_fclose(sc8_fh fh);
+size_t sc8_fread(void *buffer, size_t size, size_t count, sc8_fh fh);
+bool sc8_fnil(sc8_fh fh);
+
+int sc8_errprintf(const char *format, ...) SC8_ATTR_FORMAT(1, 2);
+
+// media IO declarations (user defined as well)
+
+void sc8_beep(void);
+
+// random generator
+
+// Its state is `xorRandState` in `sc8_state`, so instances (and threads) don't share one.
+uint32_t sc8_xorRand(sc8_state *state);
+#define sc8_defRand(state) sc8_xorRand(state) // you can modify this
+
+// sc8 emulator
+
+void sc8_init(sc8_state *state);
+
+void sc8_loadRom(sc8_state *state, const uint8_t *rom, size_t rom_size);
+typedef enum {
+    sc8_loadFile_OK,
+    sc8_loadFile_EmptyROM,
+    sc8_loadFile_fopenError,
+} sc8_LoadFileResult;
+sc8_LoadFileResult sc8_loadFile(sc8_state *state, const char *file_path);
+
+void sc8_loadRomPad(sc8_state *state, const uint8_t *rom, size_t rom_size, int padding);
+sc8_LoadFileResult sc8_loadFilePad(sc8_state *state, const char *file_path, int padding);
+
+// Input: push every key going down or up. Only one thread may push, but it doesn't have
+// to be the one running the interpreter (and nothing blocks either side).
+// The event is applied right before the instruction that runs once `cycles + idle` reaches `cycle`,
+// pass 0 (or any cycle already gone by) for the next instruction, so feeding the same events
+// at the same cycles always gives the same run. Events are applied in the order they were
+// pushed. Returns false, dropping the event, when the queue is full.
+// Fx0A waits for a key to go down and come back up, keys already down when it starts don't count.
+bool sc8_keyDown(sc8_state *state, uint8_t key, uint64_t cycle);
+bool sc8_keyUp(sc8_state *state, uint8_t key, uint64_t cycle);
+
+// Define `SC8_DISPATCH_THREADED` to use the threaded core instead of the plain switch
+// (computed goto on GCC/Clang, a table of handlers elsewhere or with `SC8_NO_COMPUTED_GOTO`).
+// All of them behave the same.
+// Returns false after an unknown opcode, or when it's waiting on a key or halted (`wait`),
+// none of them block.
+// An Fx0A still waiting for a key and F0FF don't count as executed, here or anywhere else
+// (`cycles`, what the run functions return, the profiler and tracer), but the timers still
+// tick for them like for any other step.
+bool sc8_step(sc8_state *state);
+// Same as calling `sc8_step` `count` times, stops as soon as it returns false.
+// Returns how many instructions were executed.
+uint32_t sc8_stepMany(sc8_state *state, uint32_t count);
+
+typedef enum {
+    sc8_run_Budget,        // ran `count` instructions
+    sc8_run_Draw,          // after a 00E0 or DXYN
+    sc8_run_KeyWait,       // on an Fx0A still waiting for a key
+    sc8_run_Halt,          // before an F0FF
+    sc8_run_UnknownOpcode, // after an unknown opcode, or a 2NNN/00EE the stack can't take
+    sc8_run_Breakpoint,    // before an instruction with a breakpoint
+} sc8_StopReason;
+// Runs up to `count` instructions without ticking the timers, call `sc8_tickTimers` yourself
+// between calls. Goes through the block cache when one is attached.
+// Returns how many instructions were executed and, if `reason` isn't NULL, why it stopped.
+// Fx0A and F0FF don't count as executed when it stops on them, calling it again retries them.
+// Breakpoints are checked before every instruction but the first, so calling it again
+// steps over the one it stopped on.
+uint32_t sc8_run(sc8_state *state, uint32_t count, sc8_StopReason *reason);
+void sc8_setBreakpoint(sc8_state *state, uint16_t addr, bool enabled);
+// Decrements `dt` and `st` once (beeping while `st` is set).
+void sc8_tickTimers(sc8_state *state);
+
+// Whether the pixel at (`x`, `y`) is lit, for hosts that read the screen pixel by pixel.
+bool sc8_getPixel(const sc8_state *state, int x, int y);
+// Returns the rows that changed since the last call (bit `n` for row `n`) and clears them,
+// so a renderer only has to redo those.
+uint32_t sc8_takeDirtyRows(sc8_state *state);
+
+// Runs one 60 Hz frame: runs `instructionsPerFrame` instructions through `sc8_run` and ticks
+// the timers once, so game speed only depends on how many frames you run.
+// The frame ends early on Fx0A waiting for a key, F0FF and (with the `displayWait` quirk) after
+// DXYN, returning that reason (`sc8_run_Draw` for DXYN), `sc8_run_Budget` otherwise.
+// Breakpoints and unknown opcodes return right away without finishing the frame, calling it
+// again carries on with the same one.
+// A frame that ends waiting on Fx0A or F0FF counts one `idle` instead, so no two frames start
+// on the same key clock and key events always land in the frame they were recorded in.
+sc8_StopReason sc8_runFrame(sc8_state *state, uint32_t instructionsPerFrame);
+
+// Attaches (and clears) `cache`, pass NULL to detach it. Attach it after `sc8_init`.
+void sc8_attachCache(sc8_state *state, sc8_blockCache *cache);
+void sc8_cacheInvalidate(sc8_blockCache *cache, uint16_t addr, size_t len);
+// The handler a `sc8__kind*` stands for ("DRW", "SKP"...), for reports.
+const char *sc8_kindName(int kind);
+
+// Save states: a versioned little-endian binary image of everything the program can see
+// (registers, timers, stack, keys, quirks, cycle counters, `xorRandState`), the screen
+// with empty rows left out, and memory as runs of bytes that differ from the fontset plus `rom`
+// loaded at 0x200 (pass the same bytes you gave `sc8_loadRom`), so a fresh state is tiny.
+// Pending key events, breakpoints and the attached cache/JIT aren't part of it.
+#define SC8_STATE_VERSION 3
+#define SC8_STATE_MAX (128 + SC8_H * 8 + 2 * MEMORY_SIZE) // biggest image there can be
+// Writes the image to `buffer` and returns its size, 0 when `buffer_size` is too small for it.
+size_t sc8_saveState(const sc8_state *state, const uint8_t *rom, size_t rom_size, uint8_t *buffer, size_t buffer_size);
+typedef enum {
+    sc8_loadState_OK,
+    sc8_loadState_BadImage,   // truncated or not a save state
+    sc8_loadState_BadVersion, // saved by a different SC8_STATE_VERSION
+    sc8_loadState_WrongROM,   // saved with a different ROM
+} sc8_LoadStateResult;
+// Leaves `state` untouched unless it returns `sc8_loadState_OK`.
+sc8_LoadStateResult sc8_loadState(sc8_state *state, const uint8_t *rom, size_t rom_size, const uint8_t *buffer, size_t buffer_size);
+
+// Snapshots: everything the emulation depends on in one flat block, copied as is. Much
+// cheaper to take and put back than a save state (no encoding, no checks), but big and only
+// good for the build that took it, so they're for in-memory use like rewind and run-ahead.
+// Queued key events and whatever is attached (cache, JIT, key and event logs) aren't part of one.
+typedef struct {
+    uint8_t memory[MEMORY_SIZE];
+    uint64_t gfx[SC8_H];
+    uint64_t cycles;
+    uint64_t frames;
+    uint64_t idle;
+    uint32_t frameCycles;
+    uint32_t xorRandState;
+    uint16_t pc, i, opcode;
+    uint16_t keys, keysPressed, keysReleased;
+    uint16_t stack[16];
+    uint8_t v[16];
+    uint8_t dt, st, sp, wait;
+    uint8_t flags; // displayWait, wrapSprites, drawFlag, keyWaiting
+} sc8_snapshot;
+void sc8_takeSnapshot(sc8_snapshot *snap, const sc8_state *state);
+// Marks the rows that change dirty.
+void sc8_restoreSnapshot(sc8_state *state, const sc8_snapshot *snap);
+
+// Rewind: one snapshot per frame, kept in a ring within a fixed memory budget. Every
+// `SC8_REWIND_KEY_EVERY`th one is a keyframe, the rest are stored as their XOR against it;
+// both are run-length encoded, so a frame that only moved a sprite costs a few dozen bytes.
+// When the budget runs out the oldest keyframe goes, along with the frames that need it.
+// The buffer is the caller's, like the block cache. Breakpoints, the attached cache/JIT
+// and pending key events aren't part of a snapshot.
+#define SC8_REWIND_KEY_EVERY 60
+#define SC8__REWIND_RLE_MAX (sizeof(sc8_snapshot) + sizeof(sc8_snapshot) / 128 + 2)
+typedef struct {
+    uint8_t *buffer;
+    size_t size;
+    uint64_t head, tail;  // records live at [tail, head), offsets grow forever and wrap around `size`
+    uint64_t keyAt;       // newest keyframe
+    uint32_t sinceKey;    // frames pushed after it
+    uint32_t frames;      // frames held
+    sc8_snapshot key;    // the newest keyframe, decoded
+    sc8_snapshot scratch;
+    uint8_t encoded[SC8__REWIND_RLE_MAX];
+} sc8_rewind;
+
+// `buffer` is the budget, `size` bytes of it (10 minutes at 60 fps usually fit in 8 MB).
+void sc8_rewindInit(sc8_rewind *rewind, void *buffer, size_t size);
+// Records `state` as the newest frame, call it once per frame.
+void sc8_rewindPush(sc8_rewind *rewind, const sc8_state *state);
+// Puts `state` back to the newest frame recorded and drops it, returns false when there's none left.
+bool sc8_rewindPop(sc8_rewind *rewind, sc8_state *state);
+uint32_t sc8_rewindFrames(const sc8_rewind *rewind);
+
+// Key log: every key event, with the cycle it was applied at, gets appended to an attached
+// log, so replaying them with those cycles gives back the exact same run. Empty it every
+// frame or so, `overflow` gets set (and events dropped) once it's full.
+typedef struct sc8_keyLog {
+    sc8_keyEvent *events;
+    uint32_t count;
+    uint32_t capacity;
+    bool overflow;
+} sc8_keyLog;
+// Pass NULL to detach it.
+void sc8_attachKeyLog(sc8_state *state, sc8_keyLog *log);
+// Hash of everything a snapshot holds, two states that hash the same behave the same from there on.
+uint64_t sc8_stateHash(const sc8_state *state);
+
+// Movies: the key events of a run of `sc8_runFrame` calls with the cycles they were applied
+// at (see `sc8_keyLog`), the hash of the state after every frame, and a save state every
+// `keyframeEvery` frames to seek from. Frames are counted by `frames`, so a frame cut short by
+// a breakpoint or an unknown opcode has to be finished before its hash is taken. Layout (little-endian):
+//   "SC8M", u16 version, u16 0, u32 ROM size, u32 FNV-1a of the ROM, u32 xorRandState at
+//   the start, u32 instructions per frame, u32 keyframeEvery, u64 first frame, u64 frames,
+//   u32 events, u32 keyframes
+//   events: u64 cycle, u8 key, u8 down
+//   hashes: u64 per frame
+//   keyframes: u64 offset of the save state in the movie, u32 its size, u32 first event after it
+//   the save states
+#define SC8_MOVIE_VERSION 2
+typedef struct {
+    uint32_t romSize;
+    uint32_t romHash;
+    uint32_t randState;
+    uint32_t instructionsPerFrame;
+    uint32_t keyframeEvery;
+    uint64_t firstFrame; // `frames` when recording started
+    uint64_t frames;
+    uint32_t events;
+    uint32_t keyframes;
+} sc8_movieInfo;
+typedef struct {
+    const uint8_t *image; // save state taken right before frame `n * keyframeEvery` of the movie
+    size_t size;
+    uint32_t firstEvent;  // events recorded before it
+} sc8_movieKeyframe;
+// Puts the movie together out of what was recorded (`info->frames` hashes, `info->events`
+// events and `info->keyframes` keyframes, `romSize` and `romHash` get filled in from `rom`).
+// Returns its size, 0 when `out_size` is too small, pass NULL for `out` to just get the size.
+size_t sc8_movieWrite(uint8_t *out, size_t out_size, sc8_movieInfo *info, const uint8_t *rom, size_t rom_size,
+                      const sc8_keyEvent *events, const uint64_t *hashes, const sc8_movieKeyframe *keyframes);
+
+// A movie read straight out of its bytes, which have to outlive it.
+typedef struct {
+    sc8_movieInfo info;
+    const uint8_t *data;
+    size_t size;
+    const uint8_t *events;
+    const uint8_t *hashes;
+    const uint8_t *keyframes;
+    uint32_t nextEvent; // first event not fed to the state playing it yet
+} sc8_movie;
+// Same results as `sc8_loadState`.
+sc8_LoadStateResult sc8_movieOpen(sc8_movie *movie, const uint8_t *data, size_t size, const uint8_t *rom, size_t rom_size);
+// Puts `state` right before frame `frame` (counted from the start of the movie): loads the
+// keyframe before it and plays the frames in between, so it costs `keyframeEvery` frames
+// at most. Drops any key events still queued, don't push your own while playing a movie.
+sc8_LoadStateResult sc8_movieSeek(sc8_movie *movie, sc8_state *state, const uint8_t *rom, size_t rom_size, uint64_t frame);
+// Plays the next frame, feeding it the recorded key events. Returns false when the state
+// doesn't hash the same as it did when recording, or the movie is over. A frame can have any
+// number of events, they get queued as room frees up.
+bool sc8_moviePlayFrame(sc8_movie *movie, sc8_state *state);
+
+// Events: the faults and halts the interpreter runs into go to an attached event log instead
+// of stderr, so a ROM that ran off into data costs a few stores per bad instruction rather than
+// a formatted line. Nothing gets recorded while no log is attached.
+// The interpreter is the only writer, one other thread may drain the log while it runs.
+typedef enum {
+    sc8_event_UnknownOpcode,
+    sc8_event_StackOverflow,  // 2NNN with all 16 entries in use, skipped and stops like an unknown opcode
+    sc8_event_StackUnderflow, // 00EE with nothing on the stack, same
+    sc8_event_OutOfBounds,    // Fx33/Fx55/Fx65 past the end of memory (wraps around to the start),
+                              // Ex9E/ExA1 on a Vx over F (only its low nibble is used)
+    sc8_event_Halt,           // F0FF
+    sc8_event_Count
+} sc8_EventKind;
+typedef struct {
+    // `cycles` of the instruction that ran into it, in every engine.
+    uint64_t cycle;
+    uint16_t pc;
+    uint16_t opcode;
+    uint8_t kind; // `sc8_event_*`
+} sc8_event;
+#define SC8_EVENT_RING 256 // a power of two
+// Rate limit: at most `limit` events per `window` cycles make it into the ring, and an event
+// just like the one before it (same kind, pc and opcode, a halted ROM for instance) doesn't
+// either, they're only counted. So is everything while the ring is full.
+typedef struct sc8_eventLog {
+    sc8_event ring[SC8_EVENT_RING];
+    uint32_t head; // next one the interpreter writes
+    uint32_t tail; // next one to drain
+    uint32_t limit;
+    uint64_t window;
+    uint64_t windowStart;
+    uint32_t inWindow;
+    sc8_event last;
+    // Read these with `sc8_eventTotals` from other threads.
+    uint64_t counts[sc8_event_Count]; // every event, by kind, whether it made it in or not
+    uint64_t suppressed;              // left out by the rate limit
+    uint64_t dropped;                 // left out with the ring full
+} sc8_eventLog;
+// Empties `log` and attaches it (pass NULL to detach).
+void sc8_attachEventLog(sc8_state *state, sc8_eventLog *log, uint32_t limit, uint64_t window);
+// Takes up to `max` events out of the ring, oldest first.
+uint32_t sc8_eventDrain(sc8_eventLog *log, sc8_event *out, uint32_t max);
+void sc8_eventTotals(const sc8_eventLog *log, uint64_t counts[sc8_event_Count], uint64_t *suppressed, uint64_t *dropped);
+const char *sc8_eventName(uint8_t kind);
+// Writes a line like "cycle 1234: unknown opcode 0206 at 3A4" to `buffer`, snprintf style.
+int sc8_eventFormat(const sc8_event *event, char *buffer, size_t size);
+
+#ifdef SC8_EVENT_THREAD
+// Drain thread (pthreads), define `SC8_EVENT_THREAD` to build it. It drains `log` every
+// `interval_ms` and prints the events through `sc8_errprintf`, along with how many the rate
+// limit left out since the last time, so the interpreter never formats anything itself.
+typedef struct {
+    sc8_eventLog *log;
+    uint32_t intervalMs;
+    bool running;
+    uint64_t suppressed; // already reported
+    pthread_t thread;
+} sc8_eventPrinter;
+bool sc8_eventPrinterStart(sc8_eventPrinter *printer, sc8_eventLog *log, uint32_t interval_ms);
+// Stops the thread after a last drain.
+void sc8_eventPrinterStop(sc8_eventPrinter *printer);
+#endif // SC8_EVENT_THREAD
+
+#ifdef SC8_PROFILE
+// Per-PC profiler, define `SC8_PROFILE` to build it (without it, there's nothing left of it
+// in the interpreter). Every instruction any of the cores runs counts toward its pc and
+// its kind of opcode, and skips count how often they skipped. The JIT is off in this
+// build, so everything goes through the interpreter and gets counted.
+// It also follows the guest's calls (2NNN in, 00EE out) in a calling context tree: a node
+// for every distinct chain of calls that ran, counting the instructions run in it.
+#define SC8_PROFILE_NODES 4096
+typedef struct {
+    uint16_t routine; // the address called, 0x200 for node 0 (nothing called yet)
+    uint16_t parent;
+    uint16_t child;   // the first one, 0 when none
+    uint16_t sibling; // the next child of `parent`, 0 when none
+    uint64_t calls;   // times it was entered
+    uint64_t self;    // instructions run in it, the ones of the calls it made not included
+} sc8_callNode;
+typedef struct sc8_profile {
+    uint64_t executed[MEMORY_SIZE];   // by pc
+    uint64_t skipsTaken[MEMORY_SIZE]; // by pc, not taken is `executed` minus this
+    uint64_t kinds[sc8__kindCount];   // by `sc8__kind*`, see `sc8_kindName`
+    uint64_t reads[MEMORY_SIZE];      // by address, bytes read by DXYN and Fx65 (fetches are in `executed`)
+    uint64_t writes[MEMORY_SIZE];     // by address, bytes written by Fx33 and Fx55
+    sc8_callNode nodes[SC8_PROFILE_NODES];
+    uint32_t nodeCount;
+    uint16_t current;   // node the guest is in
+    uint32_t lostDepth; // calls made with the tree full, their instructions go to `current`
+} sc8_profile;
+// Attaches (and clears) `profile`, pass NULL to detach it. Attach it after `sc8_init`.
+void sc8_attachProfile(sc8_state *state, sc8_profile *profile);
+
+// A loop closed by a 1NNN jumping back to (or before) itself.
+typedef struct {
+    uint16_t start;        // where the jump goes
+    uint16_t end;          // the jump
+    uint64_t iterations;   // times the jump ran
+    uint64_t instructions; // run from `start` to `end`, both included
+} sc8_hotLoop;
+// Writes the `max` loops that ran the most instructions to `loops`, most first, and returns
+// how many it found. The jumps are read from `state->memory`, so pass the state that was
+// profiled.
+uint32_t sc8_profileHotLoops(const sc8_profile *profile, const sc8_state *state, sc8_hotLoop *loops, uint32_t max);
+
+// Compact binary dump (little-endian):
+//   "SC8P", u16 version, u16 kinds, then u64 per kind
+//   u32 pcs, then for every pc that ran: u16 pc, u16 opcode there now, u64 executed, u64 skips taken
+// Returns its size, 0 when `out_size` is too small, pass NULL for `out` to just get the size.
+#define SC8_PROFILE_VERSION 1
+size_t sc8_profileDump(const sc8_profile *profile, const sc8_state *state, uint8_t *out, size_t out_size);
+
+// A guest subroutine out of the call tree. Recursive calls count once toward `inclusive`.
+typedef struct {
+    uint16_t routine;
+    uint64_t calls;
+    uint64_t inclusive; // instructions run in it and in everything it called
+    uint64_t exclusive; // instructions run in it
+} sc8_routineProfile;
+// Writes up to `max` routines to `routines`, most inclusive instructions first (the top
+// level, as routine 0x200, included), returns how many.
+uint32_t sc8_profileRoutines(const sc8_profile *profile, sc8_routineProfile *routines, uint32_t max);
+typedef struct {
+    uint16_t caller;
+    uint16_t callee;
+    uint64_t calls;
+} sc8_callEdge;
+// Writes up to `max` caller -> callee edges to `edges`, most calls first, returns how many.
+uint32_t sc8_profileEdges(const sc8_profile *profile, sc8_callEdge *edges, uint32_t max);
+
+// How an address was used, out of `executed` (both bytes of the opcode count as fetched),
+// `reads` and `writes`.
+enum {
+    SC8_MEM_EXEC  = 1,
+    SC8_MEM_READ  = 2,
+    SC8_MEM_WRITE = 4,
+};
+uint8_t sc8_profileAccess(const sc8_profile *profile, uint16_t addr);
+// A run of addresses used the same way. Code that's also written is self-modifying, every
+// write to it throws away what the cached interpreter decoded there.
+typedef struct {
+    uint16_t start;
+    uint16_t end; // one past the last address
+    uint8_t access; // `SC8_MEM_*`
+    uint64_t executed, reads, writes;
+} sc8_memRegion;
+// Writes up to `max` regions to `regions` in address order, leaving out the untouched
+// addresses, and returns how many.
+uint32_t sc8_profileRegions(const sc8_profile *profile, sc8_memRegion *regions, uint32_t max);
+#endif // SC8_PROFILE
+
+#ifdef SC8_TRACE
+// Execution tracer, define `SC8_TRACE` to build it (without it, there's nothing left of it
+// in the interpreter, and the JIT is off in this build like with `SC8_PROFILE`). The
+// interpreter only writes an 8 byte entry to the attached trace's ring where the drain can't
+// work out what happened on its own: what RND, DXYN, Fx07 and Fx0A wrote and whether SKP/SKNP
+// skipped, and where a call into the interpreter left off and the registers it starts from
+// when the next one doesn't carry on from there. Another thread drains it with
+// `sc8_traceDrain`, which replays everything else on a copy of the guest to hand out a record
+// per instruction, typically to pack them into chunks with `sc8_traceEncode` and stream them
+// to disk (see tools/sc8_trace.c).
+#define SC8_TRACE_RING 65536 // entries, a power of two
+#define SC8_TRACE_NONE 0xFF
+// An instruction that ran, as the drain hands them out.
+typedef struct {
+    uint64_t cycle;
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t i;      // after it ran
+    uint8_t reg;     // V register it wrote (VF for DXYN, the last one for Fx65), `SC8_TRACE_NONE` if none
+    uint8_t value;   // what's in that register now
+} sc8_traceRecord;
+// Entries are a u64 each, the kind in bits 12-13 next to a 12 bit pc or address:
+// - after an instruction that ends a block (see `sc8__traceEnds`): the pc it left and Vx
+//   and VF from bit 16 and 24 on,
+// - at the start of a call into the interpreter that doesn't carry on from the last one: pc,
+//   I from bit 16 on and sp from bit 32 on, then the cycle, V0-VF and the stack in the next
+//   seven,
+// - before that, or once it's detached: the cycle the last call ended at, its low 12 bits in
+//   the pc's and the rest from bit 16 on, where the drain stops replaying the block it was in,
+// - memory loaded by the host (`sc8_loadRom`, save states, snapshots...): 6 bytes from the
+//   address on, from bit 16 on. The guest's own writes are replayed.
+#define SC8__TRACE_BLOCK  0x0000
+#define SC8__TRACE_START  0x1000
+#define SC8__TRACE_STOP   0x2000
+#define SC8__TRACE_MEMORY 0x3000
+#define SC8__TRACE_KIND   0x3000
+// The interpreter's fields and the drain's are a cache line apart, so they don't keep
+// taking the line away from each other.
+typedef struct sc8_trace {
+    uint64_t ring[SC8_TRACE_RING];
+    uint32_t head;         // next one the interpreter writes
+    uint32_t full;         // `head` once the ring has no room left, only worked out again from `tail` then
+    bool lossless;         // wait for room with the ring full instead of dropping entries
+    bool lost;             // entries got dropped, nothing goes in until the next call into the interpreter
+    uint64_t left;         // `cycles` where the last call ended, UINT64_MAX when the next one can't carry on from there
+    uint64_t dropped;      // entries dropped, read it atomically from other threads
+    uint8_t pad[64 - 4 - 4 - 8 - 8 - 8];
+    uint32_t tail;         // next one to drain
+    bool replaying;        // the drain is past a start entry, `replay` holds the guest's state
+    uint64_t drainCycle;   // of the next record drained
+    sc8_state replay;      // what the drain replays the guest on
+} sc8_trace;
+// Empties `trace` and attaches it (pass NULL to detach). A lossless trace stalls the
+// interpreter whenever the ring is full, so something has to be draining it on another thread.
+// One that isn't drops entries then, and the drain skips ahead to where it can replay again:
+// the next call into the interpreter with room in the ring. Like the block cache, it has to
+// know about the guest changed behind the interpreter's back: the sc8_load* functions and
+// `sc8_restoreSnapshot` tell it, call `sc8_traceInvalidate` after writing `memory` (or, with
+// `len` 0, the registers) yourself.
+void sc8_attachTrace(sc8_state *state, sc8_trace *trace, bool lossless);
+void sc8_traceInvalidate(sc8_state *state, uint16_t addr, size_t len);
+// Writes where the last call into the interpreter ended, so the drain can hand out the
+// records up to there rather than wait for the next entry. Detaching the trace does it too.
+void sc8_traceFlush(sc8_state *state);
+// Takes up to `max` records out of the ring, oldest first. Only one thread may drain it. The
+// records of a block only come out once the entry ending it is in, see `sc8_traceFlush`.
+uint32_t sc8_traceDrain(sc8_trace *trace, sc8_traceRecord *out, uint32_t max);
+
+// Packs `count` records into `out` (room for `SC8_TRACE_PACKED_MAX(count)` bytes) and returns
+// the size. Each record becomes a byte of flags plus only what doesn't follow from the one
+// before it: sequential cycles and pcs, an unchanged I and the same opcode as the last time
+// at that pc cost nothing, so a typical record takes 1 to 3 bytes instead of 16. Every call
+// starts from scratch, so each chunk decodes on its own.
+#define SC8_TRACE_PACKED_MAX(count) ((size_t)(count) * 19)
+size_t sc8_traceEncode(const sc8_traceRecord *records, uint32_t count, uint8_t *out);
+// Unpacks `count` records, returns false when `data` doesn't hold that many.
+bool sc8_traceDecode(const uint8_t *data, size_t size, sc8_traceRecord *records, uint32_t count);
+#endif // SC8_TRACE
+
+#ifdef SC8_SAMPLER
+// Sampling profiler (Linux only), define `SC8_SAMPLER` to build it. Unlike `SC8_PROFILE` it
+// costs the interpreter next to nothing, a relaxed store of the pc and opcode of every
+// instruction run (the JIT is off in this build, its code wouldn't store them): a SIGPROF
+// timer interrupts the process every so often (of CPU time) and the handler takes the last
+// ones stored by every registered state, wherever they are in their run. Samples go into a lock-free ring that one thread drains with
+// `sc8_samplerDrain`, and `sc8_hotSpotsAdd` sorts them out by ROM.
+#define SC8_SAMPLER_STATES 64
+#define SC8_SAMPLER_RING 16384 // a power of two
+#define SC8_SAMPLER_UNREGISTER_TRIES 100000 // times `sc8_samplerUnregister` yields to handlers
+typedef struct {
+    uint32_t romHash; // of the ROM the state was registered with
+    uint16_t pc;
+    uint16_t opcode;
+} sc8_sample;
+// Starts sampling every `interval_us` microseconds of CPU time (1000 keeps it well under 1%
+// overhead), returns false when it couldn't (or it isn't built for this platform).
+// Installs a SIGPROF handler, with SA_RESTART so nothing else sees EINTR from it.
+bool sc8_samplerStart(uint32_t interval_us);
+void sc8_samplerStop(void);
+// Returns false when SC8_SAMPLER_STATES states are registered already.
+bool sc8_samplerRegister(const sc8_state *state, const uint8_t *rom, size_t rom_size);
+// Call it before `state` goes away, it waits out a handler still reading it. Returns false
+// when handlers kept running for too long to tell, `state` must stay around then.
+bool sc8_samplerUnregister(const sc8_state *state);
+// Takes up to `max` samples out of the ring, oldest first. Only one thread may drain it.
+uint32_t sc8_samplerDrain(sc8_sample *out, uint32_t max);
+// Samples lost to a full ring so far.
+uint64_t sc8_samplerDropped(void);
+
+// Samples of one ROM, by pc and kind of opcode.
+typedef struct {
+    uint32_t romHash;
+    uint64_t samples;
+    uint32_t pcs[MEMORY_SIZE];
+    uint32_t kinds[sc8__kindCount];
+} sc8_hotSpots;
+// Adds `samples` to the entries of their ROMs in `roms`, `*count` of them in use, starting new
+// ones while there's room for them. Returns how many samples had no room.
+uint32_t sc8_hotSpotsAdd(sc8_hotSpots *roms, uint32_t *count, uint32_t capacity, const sc8_sample *samples, uint32_t n);
+#endif // SC8_SAMPLER
+
+#ifdef SC8_JIT
+// x86-64 dynamic recompiler (Linux only), define `SC8_JIT` to build it.
+// Blocks that ran `SC8_JIT_HOT` times get translated to native code, the rest (and DXYN,
+// Fx0A, F0FF, unknown opcodes) goes through the interpreter. Up to 5 of the V registers a block
+// uses the most live in host registers while it runs, and VF isn't computed when nothing
+// reads it before it's overwritten. Jumps between translated blocks are linked directly,
+// so a hot loop only comes back to C once the instruction budget runs out.
+// Apart from that it behaves just like `sc8_stepMany`.
+#define SC8_JIT_HOT 16
+#define SC8_JIT_CODE_SIZE (1 << 20)
+#define SC8_JIT_LINKS 4096
+typedef uint32_t (*sc8_jitBlock)(sc8_state *state, uint32_t budget);
+typedef struct {
+    uint16_t target;   // pc the jump goes to
+    uint32_t at;       // offset of its rel32 in the code buffer
+    uint32_t fallback; // offset of the return path of the block it's in
+} sc8_jitLink;
+typedef struct sc8_jit {
+    sc8_jitBlock code[MEMORY_SIZE]; // translated block starting at each address
+    uint8_t len[MEMORY_SIZE];       // instructions in it
+    uint8_t heat[MEMORY_SIZE];      // stays at `SC8_JIT_HOT` once tried, until that code is written
+    uint64_t codePages;
+    sc8_jitLink link[SC8_JIT_LINKS];
+    uint32_t links;
+    uint8_t *buffer;
+    size_t used;
+    bool writable;
+    bool unlink; // blocks got dropped, the jumps into them still have to be unlinked
+    bool broken; // an mprotect failed, nothing gets translated or run translated anymore
+} sc8_jit;
+
+// Returns false when the JIT isn't available (or mmap failed), `sc8_jitRun` then just
+// calls `sc8_stepMany`. It does the same from the point making the code buffer writable or
+// executable again ever fails.
+bool sc8_jitInit(sc8_jit *jit);
+void sc8_jitFree(sc8_jit *jit);
+// Attaches (and flushes) `jit`, pass NULL to detach it. Attach it after `sc8_init`.
+void sc8_attachJit(sc8_state *state, sc8_jit *jit);
+void sc8_jitInvalidate(sc8_jit *jit, uint16_t addr, size_t len);
+uint32_t sc8_jitRun(sc8_state *state, uint32_t count);
+#endif // SC8_JIT
+
+// define `SC8_NO_DEFAULT_FONTSET` to disable the default fontset (it's 8x5 pixels for char)
+extern const uint8_t sc8_fontset[80];
+
+#ifndef SC8_NO_DEFAULT_FONTSET
+const uint8_t sc8_fontset[80] = { 
+  0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+  0x20, 0x60, 0x20, 0x20, 0x70, // 1
+  0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+  0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+  0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+  0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+  0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+  0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+  0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+  0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+  0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+  0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+  0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+  0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+  0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+  0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
+#endif // SC8_NO_DEFAULT_FONTSET
+
+#ifdef SC8_USE_STDIO
+#include <stdarg.h>
+#include <stdio.h>
+
+sc8_fh sc8_fopen(const char *file_path, const char *mode) {
+    return fopen(file_path, mode);
+}
+void sc8_fclose(sc8_fh fh) {
+    fclose(fh);
+}
+size_t sc8_fread(void *buffer, size_t size, size_t count, sc8_fh fh) {
+    return fread(buffer, size, count, fh);
+}
+bool sc8_fnil(sc8_fh fh) {
+    return fh == NULL;
+}
+
+int sc8_errprintf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int ret = vfprintf(stderr, format, args);
+    va_end(args);
+    return ret;
+}
+#endif // SC8_USE_STDIO
+
+#define SC8_IMPLEMENTATION
+#ifdef SC8_IMPLEMENTATION
+uint32_t sc8_xorRand(sc8_state *state) {
+    state->xorRandState ^= state->xorRandState << 13;
+    state->xorRandState ^= state->xorRandState >> 17;
+    state->xorRandState ^= state->xorRandState << 5;
+    return state->xorRandState;
+}
+
+void sc8_init(sc8_state *state) {
+    memset(state, 0, sizeof(sc8_state));
+    state->pc = 512;
+    state->xorRandState = 305419896;
+
+    // load fontset
+    memcpy(state->memory, sc8_fontset, 80);
+    // for(int i = 0; i < 80; i++) {
+    //     state->memory[i] = sc8_fontset[i];
+    // }
+}
+
+// Every write to `memory` (ROM loading and the interpreter) goes through here
+// so cached or translated code never goes stale.
+static inline void sc8__codeWritten(sc8_state *state, uint16_t addr, size_t len) {
+    if(state->cache != NULL) {
+        sc8_cacheInvalidate(state->cache, addr, len);
+    }
+#ifdef SC8_JIT
+    if(state->jit != NULL) {
+        sc8_jitInvalidate(state->jit, addr, len);
+    }
+#endif // SC8_JIT
+}
+
+#ifdef SC8_TRACE
+static void sc8__traceMemory(sc8_state *state, uint16_t addr, size_t len);
+#endif // SC8_TRACE
+
+// `sc8__codeWritten` for memory the host wrote, the trace needs to see it too.
+static void sc8__memoryLoaded(sc8_state *state, uint16_t addr, size_t len) {
+    sc8__codeWritten(state, addr, len);
+#ifdef SC8_TRACE
+    if(state->trace != NULL) {
+        sc8__traceMemory(state, addr, len);
+    }
+#endif // SC8_TRACE
+}
+
+void sc8_loadRom(sc8_state *state, const uint8_t *rom, size_t rom_size) {
+    assert((rom_size < (MEMORY_SIZE - 512)) && "The ROM size is greater than the maximum memory size");
+    memcpy(state->memory + 512, rom, rom_size);
+    sc8__memoryLoaded(state, 512, rom_size);
+}
+
+sc8_LoadFileResult sc8_loadFile(sc8_state *state, const char *file_path) {
+    sc8_fh f = sc8_fopen(file_path, "rb");
+    if(sc8_fnil(f)) {
+        return sc8_loadFile_fopenError;
+    }
+
+    size_t rom_size = sc8_fread(state->memory + 512, 1, MEMORY_SIZE - 512, f);
+    sc8_fclose(f);
+    sc8__memoryLoaded(state, 512, rom_size);
+
+    return rom_size == 0;
+}
+
+void sc8_loadRomPad(sc8_state *state, const uint8_t *rom, size_t rom_size, int padding) {
+    assert((rom_size < (size_t)(MEMORY_SIZE - padding)) && "The ROM size is greater than the maximum memory size");
+    memcpy(state->memory + padding, rom, rom_size);
+    sc8__memoryLoaded(state, padding, rom_size);
+}
+
+sc8_LoadFileResult sc8_loadFilePad(sc8_state *state, const char *file_path, int padding) {
+    sc8_fh f = sc8_fopen(file_path, "rb");
+    if(sc8_fnil(f)) {
+        return sc8_loadFile_fopenError;
+    }
+
+    size_t rom_size = sc8_fread(state->memory + padding, 1, MEMORY_SIZE - padding, f);
+    sc8_fclose(f);
+    sc8__memoryLoaded(state, padding, rom_size);
+
+    return rom_size == 0;
+}
+
+// Key events.
+
+static bool sc8__pushKey(sc8_state *state, uint8_t key, bool down, uint64_t cycle) {
+    sc8_keyQueue *queue = &state->keyQueue;
+    const uint32_t head = queue->head;
+    if(key > 0xF || head - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) == SC8_KEY_QUEUE) {
+        return false;
+    }
+    queue->events[head & (SC8_KEY_QUEUE - 1)] = (sc8_keyEvent){ cycle, key, down };
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool sc8_keyDown(sc8_state *state, uint8_t key, uint64_t cycle) {
+    return sc8__pushKey(state, key, true, cycle);
+}
+
+bool sc8_keyUp(sc8_state *state, uint8_t key, uint64_t cycle) {
+    return sc8__pushKey(state, key, false, cycle);
+}
+
+// Logs a key event applied at `cycle`, see `sc8_keyLog`.
+static void sc8__logKey(sc8_keyLog *log, uint64_t cycle, uint8_t key, bool down) {
+    if(log->count == log->capacity) {
+        log->overflow = true;
+        return;
+    }
+    log->events[log->count++] = (sc8_keyEvent){ cycle, key, down };
+}
+
+void sc8_attachKeyLog(sc8_state *state, sc8_keyLog *log) {
+    state->keyLog = log;
+}
+
+// Applies the key events that are due by now (`cycles + idle`) and returns how far, up to
+// `count`, a run loop that has `done` instructions behind it can go before the next one is.
+// The run loops only call this between runs of instructions instead of before each one.
+static uint32_t sc8__applyKeys(sc8_state *state, uint32_t done, uint32_t count) {
+    sc8_keyQueue *queue = &state->keyQueue;
+    const uint64_t now = state->cycles + state->idle;
+    const uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = queue->tail;
+    for(; tail != head; tail++) {
+        const sc8_keyEvent *event = &queue->events[tail & (SC8_KEY_QUEUE - 1)];
+        if(event->cycle > now) {
+            if(event->cycle - now < count - done) {
+                count = done + (uint32_t)(event->cycle - now);
+            }
+            break;
+        }
+
+        if(state->keyLog != NULL) {
+            sc8__logKey(state->keyLog, now, event->key, event->down);
+        }
+        const uint16_t bit = 1 << event->key;
+        state->key[event->key] = event->down;
+        if(event->down) {
+            state->keysPressed |= bit;
+        } else if(state->keysPressed & bit) {
+            state->keysReleased |= bit;
+        }
+    }
+    __atomic_store_n(&queue->tail, tail, __ATOMIC_RELEASE);
+    return count;
+}
+
+
+// Instrumentation hook: every core calls `SC8__INSTRUMENT` after running an instruction, with
+// the pc it ran at. It's nothing at all unless the profiler or the sampler is built in (the
+// tracer only needs to hear from a few handlers, see `sc8__traceEnds`).
+#ifdef SC8_PROFILE
+static uint8_t sc8__decode(uint16_t opcode);
+
+static void sc8__profileCall(sc8_profile *profile, uint16_t routine) {
+    sc8_callNode *nodes = profile->nodes;
+    const uint16_t caller = profile->current;
+    nodes[caller].self++;
+    if(profile->lostDepth > 0) {
+        profile->lostDepth++;
+        return;
+    }
+    uint16_t node = nodes[caller].child;
+    while(node != 0 && nodes[node].routine != routine) {
+        node = nodes[node].sibling;
+    }
+    if(node == 0) {
+        if(profile->nodeCount == SC8_PROFILE_NODES) {
+            profile->lostDepth++;
+            return;
+        }
+        node = profile->nodeCount++;
+        nodes[node] = (sc8_callNode){ routine, caller, 0, nodes[caller].child, 0, 0 };
+        nodes[caller].child = node;
+    }
+    nodes[node].calls++;
+    profile->current = node;
+}
+
+static void sc8__profileReturn(sc8_profile *profile) {
+    profile->nodes[profile->current].self++; // 00EE runs in the callee
+    if(profile->lostDepth > 0) {
+        profile->lostDepth--;
+    } else {
+        profile->current = profile->nodes[profile->current].parent; // node 0 is its own parent
+    }
+}
+
+static void sc8__profileCount(const sc8_state *state, uint16_t pc, uint16_t opcode) {
+    sc8_profile *profile = state->profile;
+    if(profile == NULL) {
+        return;
+    }
+    pc &= MEMORY_SIZE - 1;
+    const uint8_t kind = sc8__decode(opcode);
+    profile->executed[pc]++;
+    profile->kinds[kind]++;
+    // none of these move I, so it's still where they accessed memory
+    switch(kind) {
+        case sc8__kindSEi: case sc8__kindSNEi: case sc8__kindSE: case sc8__kindSNE:
+        case sc8__kindSKP: case sc8__kindSKNP:
+            profile->skipsTaken[pc] += state->pc == pc + 4;
+            break;
+        case sc8__kindDRW:
+            for(int row = 0; row < SC8_N(opcode); row++) {
+                profile->reads[(state->i + row) & (MEMORY_SIZE - 1)]++;
+            }
+            break;
+        case sc8__kindLOAD:
+            for(int r = 0; r < SC8_Vx(opcode); r++) {
+                profile->reads[(state->i + r) & (MEMORY_SIZE - 1)]++;
+            }
+            break;
+        case sc8__kindLDB:
+            for(int digit = 0; digit < 3; digit++) {
+                profile->writes[(state->i + digit) & (MEMORY_SIZE - 1)]++;
+            }
+            break;
+        case sc8__kindSTORE:
+            for(int r = 0; r < SC8_Vx(opcode); r++) {
+                profile->writes[(state->i + r) & (MEMORY_SIZE - 1)]++;
+            }
+            break;
+        case sc8__kindCALL:
+            if(state->pc != SC8_NNN(opcode)) {
+                break; // the stack was full, it didn't call anything
+            }
+            sc8__profileCall(profile, SC8_NNN(opcode));
+            return; // the call itself ran in the caller
+        case sc8__kindRET:
+            sc8__profileReturn(profile);
+            return;
+    }
+    profile->nodes[profile->current].self++;
+}
+#endif // SC8_PROFILE
+
+#ifdef SC8_TRACE
+// Waits for room for `count` more entries (or drops them when the trace isn't lossless) and
+// returns whether they can go in. Once it dropped some, nothing goes in until
+// `sc8__traceStart` gets the drain back on track.
+static SC8__COLD bool sc8__traceRoom(sc8_trace *trace, uint32_t count) {
+    if(!trace->lost) {
+        for(;;) {
+            trace->full = __atomic_load_n(&trace->tail, __ATOMIC_ACQUIRE) + SC8_TRACE_RING;
+            if(trace->full - trace->head >= count) {
+                return true;
+            }
+            if(!trace->lossless) {
+                break;
+            }
+#ifdef __linux__
+            sched_yield(); // the drain may be waiting for this core
+#endif // __linux__
+        }
+        trace->lost = true;
+        trace->full = trace->head; // every entry ends up here until then
+    }
+    __atomic_fetch_add(&trace->dropped, count, __ATOMIC_RELAXED);
+    return false;
+}
+
+// Whether the drain needs an entry after `opcode` ran, because it went by something the drain
+// doesn't replay: the RNG (CXKK), the screen (DXYN), the keys (EX9E, EXA1, Fx0A) or the delay
+// timer (Fx07). The rest only ever depends on registers, the stack and memory. Those handlers
+// write the entry themselves (`SC8__TRACE_RECORD`), so nothing else pays for it.
+static inline bool sc8__traceEnds(uint16_t opcode) {
+    switch(opcode & 0xF0FF) {
+        case 0xE09E: case 0xE0A1: case 0xF007: case 0xF00A:
+            return true;
+        default:
+            return (opcode & 0xE000) == 0xC000;
+    }
+}
+
+static inline void sc8__traceRecord(const sc8_state *state, uint16_t opcode) {
+    sc8_trace *trace = state->trace;
+    if(trace == NULL) {
+        return;
+    }
+    uint32_t head = trace->head; // only ever written from here
+    if(head == trace->full) {
+        if(!sc8__traceRoom(trace, 1)) {
+            return;
+        }
+        head = trace->head;
+    }
+    // both registers it might have written, without a branch: which one it was is up to the drain
+    trace->ring[head & (SC8_TRACE_RING - 1)] = SC8__TRACE_BLOCK | (state->pc & (MEMORY_SIZE - 1)) |
+        (uint32_t)state->v[SC8_Vx(opcode)] << 16 | (uint32_t)state->v[0xF] << 24;
+    __atomic_store_n(&trace->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// Writes `len` bytes of memory from `addr` on, 6 to an entry.
+static bool sc8__traceMemoryEntries(sc8_trace *trace, const sc8_state *state, uint16_t addr, size_t len) {
+    const uint32_t entries = (uint32_t)((len + 5) / 6);
+    if(len == 0 || (trace->full - trace->head < entries && !sc8__traceRoom(trace, entries))) {
+        return len == 0;
+    }
+    for(size_t at = addr; at < (size_t)addr + len; at += 6) {
+        const size_t from = SC8_MIN(at, (size_t)MEMORY_SIZE - 6); // the last one overlaps the one before
+        uint64_t entry = SC8__TRACE_MEMORY | from;
+        for(int b = 0; b < 6; b++) {
+            entry |= (uint64_t)state->memory[from + b] << (16 + 8 * b);
+        }
+        trace->ring[trace->head++ & (SC8_TRACE_RING - 1)] = entry;
+    }
+    __atomic_store_n(&trace->head, trace->head, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Where the last call ended, before anything that doesn't carry on from there.
+static SC8__COLD void sc8__traceStop(sc8_trace *trace) {
+    if(trace->left != UINT64_MAX && !trace->lost && (trace->head != trace->full || sc8__traceRoom(trace, 1))) {
+        trace->ring[trace->head & (SC8_TRACE_RING - 1)] =
+            SC8__TRACE_STOP | (trace->left & 0xFFF) | (trace->left >> 12) << 16;
+        __atomic_store_n(&trace->head, trace->head + 1, __ATOMIC_RELEASE);
+    }
+}
+
+// Memory written by the host, probably the registers too: the next call starts from scratch.
+static void sc8__traceMemory(sc8_state *state, uint16_t addr, size_t len) {
+    sc8__traceStop(state->trace);
+    state->trace->left = UINT64_MAX;
+    if(!state->trace->lost) {
+        sc8__traceMemoryEntries(state->trace, state, addr, SC8_MIN(len, (size_t)MEMORY_SIZE - addr));
+    }
+}
+
+// At the start of a call into the interpreter that doesn't carry on from the last one: the
+// registers it starts from. After dropped entries, all of memory too.
+static SC8__COLD void sc8__traceStart(sc8_state *state) {
+    sc8_trace *trace = state->trace;
+    sc8__traceStop(trace);
+    if(trace->lost) {
+        trace->lost = false;
+        if(!sc8__traceMemoryEntries(trace, state, 0, MEMORY_SIZE)) {
+            return;
+        }
+    }
+    if(trace->full - trace->head < 8 && !sc8__traceRoom(trace, 8)) {
+        return;
+    }
+    uint64_t words[8] = { SC8__TRACE_START | (state->pc & (MEMORY_SIZE - 1)) | (uint64_t)state->i << 16 |
+                          (uint64_t)state->sp << 32, state->cycles };
+    memcpy(&words[2], state->v, sizeof(state->v));
+    memcpy(&words[4], state->stack, sizeof(state->stack));
+    for(uint32_t w = 0; w < 8; w++) {
+        trace->ring[(trace->head + w) & (SC8_TRACE_RING - 1)] = words[w];
+    }
+    __atomic_store_n(&trace->head, trace->head + 8, __ATOMIC_RELEASE);
+}
+
+static inline void sc8__traceEnter(sc8_state *state) {
+    const sc8_trace *trace = state->trace;
+    if(trace != NULL && (trace->lost || state->cycles != trace->left)) {
+        sc8__traceStart(state);
+    }
+}
+
+// At its end, with `cycles` up to date. The stop entry waits for the next call: most carry
+// on from here (`sc8_run` returns after every DXYN and 00E0) and don't need one.
+static inline void sc8__traceLeave(sc8_state *state) {
+    if(state->trace != NULL) {
+        state->trace->left = state->cycles;
+    }
+}
+#define SC8__TRACE_RECORD(state, opcode) sc8__traceRecord(state, opcode)
+#define SC8__TRACE_ENTER(state) sc8__traceEnter(state)
+#define SC8__TRACE_LEAVE(state) sc8__traceLeave(state)
+#else
+#define SC8__TRACE_RECORD(state, opcode) ((void)(opcode))
+#define SC8__TRACE_ENTER(state) ((void)(state))
+#define SC8__TRACE_LEAVE(state) ((void)(state))
+#endif // SC8_TRACE
+
+#ifdef SC8_SAMPLER
+// one word, so the handler never sees the pc of one instruction with the opcode of another
+#define SC8__SAMPLE(state, pc, opcode) \
+    __atomic_store_n(&(state)->sample, (uint32_t)((pc) & (MEMORY_SIZE - 1)) << 16 | (opcode), __ATOMIC_RELAXED)
+#else
+#define SC8__SAMPLE(state, pc, opcode) ((void)0)
+#endif
+
+#ifdef SC8_PROFILE
+#define SC8__INSTRUMENT(state, pc, opcode) (SC8__SAMPLE(state, pc, opcode), sc8__profileCount(state, pc, opcode))
+#else
+#define SC8__INSTRUMENT(state, pc, opcode) (SC8__SAMPLE(state, pc, opcode), (void)(pc))
+#endif
+
+// Records an event for the instruction at `pc`, see `sc8_eventLog`. Only called once
+// something went wrong, so it's kept out of the handlers.
+static SC8__COLD void sc8__event(const sc8_state *state, uint8_t kind, uint16_t opcode) {
+    sc8_eventLog *log = state->events;
+    if(log == NULL) {
+        return;
+    }
+    const sc8_event event = { state->cycles, state->pc & (MEMORY_SIZE - 1), opcode, kind };
+    __atomic_fetch_add(&log->counts[kind], 1, __ATOMIC_RELAXED);
+    // also starts over when `cycles` went back (a save state, rewind...)
+    if(event.cycle - log->windowStart >= log->window) {
+        log->windowStart = event.cycle;
+        log->inWindow = 0;
+        log->last.kind = sc8_event_Count;
+    }
+    if(log->inWindow >= log->limit ||
+       (event.kind == log->last.kind && event.pc == log->last.pc && event.opcode == log->last.opcode)) {
+        __atomic_fetch_add(&log->suppressed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    log->last = event;
+    log->inWindow++;
+
+    const uint32_t head = log->head; // only ever written from here
+    if(head - __atomic_load_n(&log->tail, __ATOMIC_ACQUIRE) == SC8_EVENT_RING) {
+        __atomic_fetch_add(&log->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    log->ring[head & (SC8_EVENT_RING - 1)] = event;
+    __atomic_store_n(&log->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// Opcode handlers.
+//
+// Every execution core (the plain switch in `sc8_step` and the threaded one
+// enabled by `SC8_DISPATCH_THREADED`) goes through these, so they can't drift
+// apart. They return false when the core has to stop: unknown opcodes, calls and returns
+// the stack can't take, and Fx0A/F0FF putting the interpreter in a `wait`.
+// Nothing reads or writes past `memory`, `stack` or `key`, whatever the registers hold.
+
+static inline uint16_t sc8__fetch(sc8_state *state) {
+    const uint16_t pc = state->pc & (MEMORY_SIZE - 1);
+    state->opcode = state->memory[pc] << 8 | state->memory[(pc + 1) & (MEMORY_SIZE - 1)];
+    return state->opcode;
+}
+
+static inline void sc8__tickTimers(sc8_state *state) {
+    if(state->dt > 0) {
+        state->dt--;
+    }
+    if(state->st > 0) {
+        sc8_beep();
+        state->st--;
+    }
+}
+
+// Ticks the timers for `n` instructions at once, the same as `n` calls of `sc8__tickTimers`.
+static inline void sc8__tickTimersBy(sc8_state *state, uint32_t n) {
+    state->dt = (state->dt > n) ? state->dt - n : 0;
+    for(; n > 0 && state->st > 0; n--) {
+        sc8_beep();
+        state->st--;
+    }
+}
+
+// `sc8_stepMany` leaves `cycles` and the timers be while it runs and brings them up to date
+// in one go, at the end of a run and right before anything that reads them, the way the JIT
+// does with its pending ticks. `done` is how many instructions of the run have been run,
+// `*synced` how many of them are counted and ticked already.
+static inline void sc8__sync(sc8_state *state, uint32_t done, uint32_t *synced) {
+    const uint32_t n = done - *synced;
+    state->cycles += n;
+    sc8__tickTimersBy(state, n);
+    *synced = done;
+}
+
+// Whether `opcode` has to run synced: it reads or writes the timers, or may log an event
+// (which takes `cycles`) or stop the run. Group 0 (RET), 2 (CALL), E (SKP/SKNP), F (the
+// timers, Fx0A, the memory ones) and the unknown 8XYN.
+static inline bool sc8__syncs(uint16_t opcode) {
+    return (0xC005 >> (opcode >> 12) & 1) || ((opcode & 0xF000) == 0x8000 && (0xBF00 >> (opcode & 0xF) & 1));
+}
+#define SC8__SYNCED_KINDS                                                                                  \
+    ((uint64_t)1 << sc8__kindUnknown | (uint64_t)1 << sc8__kindUnknown8 | (uint64_t)1 << sc8__kindRET |     \
+     (uint64_t)1 << sc8__kindCALL | (uint64_t)1 << sc8__kindSKP | (uint64_t)1 << sc8__kindSKNP |           \
+     (uint64_t)1 << sc8__kindLDVxDT | (uint64_t)1 << sc8__kindLDK | (uint64_t)1 << sc8__kindLDDT |         \
+     (uint64_t)1 << sc8__kindLDST | (uint64_t)1 << sc8__kindLDB | (uint64_t)1 << sc8__kindSTORE |          \
+     (uint64_t)1 << sc8__kindLOAD | (uint64_t)1 << sc8__kindHALT)
+#define SC8__SYNCS(opcode) sc8__syncs(opcode)
+#define SC8__SYNCS_KIND(kind) (SC8__SYNCED_KINDS >> (kind) & 1)
+
+static inline bool sc8__opUnknown(sc8_state *state, uint16_t opcode) {
+    sc8__event(state, sc8_event_UnknownOpcode, opcode);
+    state->pc += 2;
+    return false;
+}
+// the 8XYN group used to bump the pc once more after its inner switch, keep that
+static inline bool sc8__opUnknown8(sc8_state *state, uint16_t opcode) {
+    sc8__opUnknown(state, opcode);
+    state->pc += 2;
+    return false;
+}
+
+static inline bool sc8__opCLS(sc8_state *state, uint16_t opcode) {
+    (void)opcode;
+    for(int row = 0; row < SC8_H; row++) {
+        if(state->gfx[row] != 0) {
+            state->dirtyRows |= (uint32_t)1 << row;
+        }
+    }
+    memset(state->gfx, 0, sizeof(state->gfx));
+    state->drawFlag = true;
+    state->pc += 2;
+    return true;
+}
+static inline bool sc8__opRET(sc8_state *state, uint16_t opcode) {
+    if(state->sp == 0) {
+        sc8__event(state, sc8_event_StackUnderflow, opcode);
+        state->pc += 2;
+        return false;
+    }
+    state->pc = state->stack[--state->sp] + 2;
+    return true;
+}
+static inline bool sc8__opJP(sc8_state *state, uint16_t opcode) {
+    state->pc = SC8_NNN(opcode);
+    return true;
+}
+static inline bool sc8__opCALL(sc8_state *state, uint16_t opcode) {
+    if(state->sp >= 16) {
+        sc8__event(state, sc8_event_StackOverflow, opcode);
+        state->pc += 2;
+        return false;
+    }
+    state->stack[state->sp++] = state->pc;
+    state->pc = SC8_NNN(opcode);
+    return true;
+}
+static inline bool sc8__opSEi(sc8_state *state, uint16_t opcode) {
+    state->pc += (state->v[SC8_Vx(opcode)] == SC8_KK(opcode)) ? 4 : 2;
+    return true;
+}
+static inline bool sc8__opSNEi(sc8_state *state, uint16_t opcode) {
+    state->pc += (state->v[SC8_Vx(opcode)] != SC8_KK(opcode)) ? 4 : 2;
+    return true;
+}
+static inline bool sc8__opSE(sc8_state *state, uint16_t opcode) {
+    state->pc += (state->v[SC8_Vx(opcode)] == state->v[SC8_Vy(opcode)]) ? 4 : 2;
+    return true;
+}
+static inline bool sc8__opLDi(sc8_state *state, uint16_t opcode) {
+    state->v[SC8_Vx(opcode)] = SC8_KK(opcode);
+    state->pc += 2;
+    return true;
+}
+static inline bool sc8__opADDi(sc8_state *state, uint16_t opcode) {
+    state->v[SC8_Vx(opcode)] += SC8_KK(opcode);
+    state->pc += 2;
+    return true;
+}
+static inline bool sc8__opLD(sc8_state *state, uint16_t opcode) {
+    state->v[SC8_Vx(opcode)] = SC8_Vy(opcode);
+    state->pc += 2;
+    return true;
+}
+static inline bool sc8__opOR(sc8_state *state, uint16_t opcode) {
+    state->v[SC8_Vx(opcode)] |= SC8_Vy(opcode);
+    state->pc += 2;
+    return true;
+}
+static inline bool sc8__opAND(sc8_state *state, uint16_t opcode) {
+    state->v[SC8_Vx(opcode)] &= SC8_Vy(opcode);
+    state->pc += 2;
+    return true;
+}
+static inline bool sc8__opXOR(sc8_state *state, uint16_t opcode) {
+    state->v[SC8_Vx(opcode)] ^= SC8_Vy(opcode);
+    state->pc += 2;
+    return true;
+}
+static inline bool sc8__opADD(sc8_state *state, uint16_t opcode) {
+    const uint8_t x = state->v[SC8_Vx(opcode)], y = state->v[SC8_Vy(opcode)];
+    size_t result = x + y;
+    state->vf = (result > 255) ? 1 : 0;
+    state->v[SC8_Vx(opcode)] = result;
+    state->pc += 2;
+    return true;
+}
+static inline bool sc8__opSUB(sc8_state *state, uint16_t opcode) {
+    const uint8_t x = state->v[SC8_Vx(opcode)], y = state->v[SC8_Vy(opcode)];
+    state->vf = (x > y) ? 1 : 0;
+    state->v[SC8_Vx(opcode)] = x - y;
+    state->pc += 2;
+    return true;
+}
+static inline bool sc8__opSHR(sc8_state *state, uint16_t opcode) {
+    const uint8_t x = state->v[SC8_Vx(opcode)];
+    state->vf = SC8_LSB(x) ? 1 : 0;
+    state->v[SC8_Vx(opcode)] >>= 1;
+    state->pc += 2;
+    return true;
+}
+static inline bool sc8__opSUBN(sc8_state *state, uint16_t opcode) {
+    const uint8_t x = state->v[SC8_Vx(opcode)], y = state->v[SC8_Vy(opcode)];
+    state->vf = (y > x) ? 1 : 0;
+    state->v[SC8_Vx(opcode)] = y - x;
+    state->pc += 2;
+    return true;
+}
+static inline bool sc8__opSHL(sc8_state *state, uint16_t opcode) {
+    const uint8_t x = state->v[SC8_Vx(opcode)];
+    state->vf = SC8_MSB(x) ? 1 : 0;
+    state->v[SC8_Vx(opcode)] <<= 1;
+    state->pc += 2;
+    return true;
+}
+static inline bool sc8__opSNE(sc8_state *state, uint16_t opcode) {
+    state->pc += (state->v[SC8_Vx(opcode)] != state->v[SC8_Vy(opcode)]) ? 4 : 2;
+    return true;
+}
+static inline bool sc8__opLDI(sc8_state *state, uint16_t opcode) {
+    state->i = SC8_NNN(opcode);
+    state->pc += 2;
+    return true;
+}
+static inline bool sc8__opJPV0(sc8_state *state, uint16_t opcode) {
+    state->pc = SC8_NNN(opcode) + state->v0;
+    return true;
+}
+static inline bool sc8__opRND(sc8_state *state, uint16_t opcode) {
+    state->v[SC8_Vx(opcode)] = (uint8_t)sc8_defRand(state) & SC8_KK(opcode);
+    state->pc += 2;
+    SC8__TRACE_RECORD(state, opcode);
+    return true;
+}
+static inline bool sc8__opDRW(sc8_state *state, uint16_t opcode) {
+    // the starting point always wraps, the rest of the sprite gets clipped (or wraps too)
+    const unsigned x = state->v[SC8_Vx(opcode)] % SC8_W, y = state->v[SC8_Vy(opcode)] % SC8_H;
+    const uint8_t height = SC8_N(opcode);
+
+    uint64_t collided = 0;
+    for(unsigned irow = 0; irow < height; irow++) {
+        unsigned screenRow = y + irow;
+        if(screenRow >= SC8_H) {
+            if(!state->wrapSprites) {
+                break;
+            }
+            screenRow -= SC8_H;
+        }
+
+        // sprite byte at the left of the word, then moved over to x
+        const uint64_t sprite = (uint64_t)state->memory[(state->i + irow) & (MEMORY_SIZE - 1)] << 56;
+        const uint64_t line = (state->wrapSprites && x != 0) ? (sprite >> x | sprite << (64 - x)) : sprite >> x;
+        collided |= state->gfx[screenRow] & line;
+        state->gfx[screenRow] ^= line;
+        if(line != 0) {
+            state->dirtyRows |= (uint32_t)1 << screenRow;
+        }
+    }
+
+    state->vf = collided != 0;
+    state->drawFlag = true;
+    state->pc += 2;
+    SC8__TRACE_RECORD(state, opcode);
+    return true;
+}
+static inline bool sc8__opSKP(sc8_state *state, uint16_t opcode) {
+    if(state->v[SC8_Vx(opcode)] >= sizeof(state->key)) {
+        sc8__event(state, sc8_event_OutOfBounds, opcode);
+    }
+    state->pc += 
+        (state->key[state->v[SC8_Vx(opcode)] & 0xF]) ? 4 : 2;
+    SC8__TRACE_RECORD(state, opcode);
+    return true;
+}
+static inline bool sc8__opSKNP(sc8_state *state, uint16_t opcode) {
+    if(state->v[SC8_Vx(opcode)] >= sizeof(state->key)) {
+        sc8__event(state, sc8_event_OutOfBounds, opcode);
+    }
+    state->pc += 
+        !(state->key[state->v[SC8_Vx(opcode)] & 0xF]) ? 4 : 2;
+    SC8__TRACE_RECORD(state, opcode);
+    return true;
+}
+static inline bool sc8__opLDVxDT(sc8_state *state, uint16_t opcode) {
+    state->v[SC8_Vx(opcode)] = state->dt;
+    state->pc += 2;
+    SC8__TRACE_RECORD(state, opcode);
+    return true;
+}
+static inline bool sc8__opLDK(sc8_state *state, uint16_t opcode) {
+    if(!state->keyWaiting) {
+        // a key already down doesn't count, it has to go down and up again from here
+        state->keyWaiting = true;
+        state->keysPressed = 0;
+        state->keysReleased = 0;
+    }
+    for(int key = 0; key < 16; key++) {
+        if(state->keysReleased >> key & 1) {
+            state->v[SC8_Vx(opcode)] = key;
+            state->keyWaiting = false;
+            state->wait = sc8_wait_None;
+            state->pc += 2;
+            SC8__TRACE_RECORD(state, opcode);
+            return true;
+        }
+    }
+    // stay here, the next step tries again with the key events applied since
+    state->wait = sc8_wait_Key;
+    return false;
+}
+static inline bool sc8__opLDDT(sc8_state *state, uint16_t opcode) {
+    state->dt = state->v[SC8_Vx(opcode)];
+    state->pc += 2;
+    return true;
+}
+static inline bool sc8__opLDST(sc8_state *state, uint16_t opcode) {
+    state->st = state->v[SC8_Vx(opcode)];
+    state->pc += 2;
+    return true;
+}
+static inline bool sc8__opADDI(sc8_state *state, uint16_t opcode) {
+    state->i += state->v[SC8_Vx(opcode)];
+    state->pc += 2;
+    return true;
+}
+static inline bool sc8__opLDF(sc8_state *state, uint16_t opcode) {
+    state->i = state->v[SC8_Vx(opcode)] * 5; // neat trick, take a look at the sc8_fontset
+                                             // array to understand it.
+    state->pc += 2;
+    return true;
+}
+// Where Fx33/Fx55/Fx65 start accessing `len` bytes at I. Past the end of memory they wrap
+// around to the start, which gets logged.
+static inline uint16_t sc8__accessI(sc8_state *state, uint16_t opcode, int len) {
+    if(state->i + len > MEMORY_SIZE) {
+        sc8__event(state, sc8_event_OutOfBounds, opcode);
+    }
+    return state->i & (MEMORY_SIZE - 1);
+}
+// `sc8__codeWritten` for `len` bytes written from `at` on, wrapping the same way.
+static inline void sc8__wrappedWritten(sc8_state *state, uint16_t at, int len) {
+    if(at + len > MEMORY_SIZE) {
+        sc8__codeWritten(state, 0, at + len - MEMORY_SIZE);
+        len = MEMORY_SIZE - at;
+    }
+    sc8__codeWritten(state, at, len);
+}
+static inline bool sc8__opLDB(sc8_state *state, uint16_t opcode) {
+    const uint16_t at = sc8__accessI(state, opcode, 3);
+    const uint8_t x = state->v[SC8_Vx(opcode)];
+    state->memory[at] = x / 100;
+    state->memory[(at + 1) & (MEMORY_SIZE - 1)] = (x / 10) % 10;
+    state->memory[(at + 2) & (MEMORY_SIZE - 1)] = (x % 100) % 10;
+    sc8__wrappedWritten(state, at, 3);
+    state->pc += 2;
+    return true;
+}
+static inline bool sc8__opSTORE(sc8_state *state, uint16_t opcode) {
+    const uint16_t at = sc8__accessI(state, opcode, SC8_Vx(opcode));
+    for(int i = 0; i < SC8_Vx(opcode); i++) {
+        state->memory[(at + i) & (MEMORY_SIZE - 1)] = state->v[i];
+    }
+    sc8__wrappedWritten(state, at, SC8_Vx(opcode));
+    state->pc += 2;
+    return true;
+}
+static inline bool sc8__opLOAD(sc8_state *state, uint16_t opcode) {
+    const uint16_t at = sc8__accessI(state, opcode, SC8_Vx(opcode));
+    for(int i = 0; i < SC8_Vx(opcode); i++) {
+        state->v[i] = state->memory[(at + i) & (MEMORY_SIZE - 1)];
+    }
+    state->pc += 2;
+    return true;
+}
+static inline bool sc8__opHALT(sc8_state *state, uint16_t opcode) {
+    // this instruction is just a repeat, basically exits the program
+    sc8__event(state, sc8_event_Halt, opcode);
+    state->wait = sc8_wait_Halt;
+    return false;
+}
+
+// The reference decoder: a plain switch every time. Always built, `sc8_run` uses it too.
+static SC8__FORCE_INLINE bool sc8__execute(sc8_state *state, uint16_t opcode) {
+    switch(opcode & 0xF000) {
+        case 0x0000: {
+            switch(opcode & 0x000F) {
+                case 0x0000: return sc8__opCLS(state, opcode);
+                case 0x000E: return sc8__opRET(state, opcode);
+                default:     return sc8__opUnknown(state, opcode);
+            }
+        }
+        case 0x1000: return sc8__opJP(state, opcode);
+        case 0x2000: return sc8__opCALL(state, opcode);
+        case 0x3000: return sc8__opSEi(state, opcode);
+        case 0x4000: return sc8__opSNEi(state, opcode);
+        case 0x5000: return sc8__opSE(state, opcode);
+        case 0x6000: return sc8__opLDi(state, opcode);
+        case 0x7000: return sc8__opADDi(state, opcode);
+        case 0x8000: {
+            switch(opcode & 0x000F) {
+                case 0x0000: return sc8__opLD(state, opcode);
+                case 0x0001: return sc8__opOR(state, opcode);
+                case 0x0002: return sc8__opAND(state, opcode);
+                case 0x0003: return sc8__opXOR(state, opcode);
+                case 0x0004: return sc8__opADD(state, opcode);
+                case 0x0005: return sc8__opSUB(state, opcode);
+                case 0x0006: return sc8__opSHR(state, opcode);
+                case 0x0007: return sc8__opSUBN(state, opcode);
+                case 0x000E: return sc8__opSHL(state, opcode);
+                default:     return sc8__opUnknown8(state, opcode);
+            }
+        }
+        case 0x9000: return sc8__opSNE(state, opcode);
+        case 0xA000: return sc8__opLDI(state, opcode);
+        case 0xB000: return sc8__opJPV0(state, opcode);
+        case 0xC000: return sc8__opRND(state, opcode);
+        case 0xD000: return sc8__opDRW(state, opcode);
+        case 0xE000: {
+            switch(opcode & 0x00FF) {
+                case 0x009E: return sc8__opSKP(state, opcode);
+                case 0x00A1: return sc8__opSKNP(state, opcode);
+                default:     return sc8__opUnknown(state, opcode);
+            }
+        }
+        case 0xF000: {
+            switch(opcode & 0x00FF) {
+                case 0x0007: return sc8__opLDVxDT(state, opcode);
+                case 0x000A: return sc8__opLDK(state, opcode);
+                case 0x0015: return sc8__opLDDT(state, opcode);
+                case 0x0018: return sc8__opLDST(state, opcode);
+                case 0x001E: return sc8__opADDI(state, opcode);
+                case 0x0029: return sc8__opLDF(state, opcode);
+                case 0x0033: return sc8__opLDB(state, opcode);
+                case 0x0055: return sc8__opSTORE(state, opcode);
+                case 0x0065: return sc8__opLOAD(state, opcode);
+                case 0x00FF: return sc8__opHALT(state, opcode);
+                default:     return sc8__opUnknown(state, opcode);
+            }
+        }
+    }
+    return sc8__opUnknown(state, opcode); // unreachable, the switch covers every nibble
+}
+
+#if !defined(SC8_DISPATCH_THREADED)
+// The reference core.
+static uint32_t sc8__run(sc8_state *state, uint32_t count, bool *ok) {
+    uint32_t synced = 0;
+    for(uint32_t done = 0; done < count; done++) {
+        const uint16_t pc = state->pc;
+        const uint16_t opcode = sc8__fetch(state);
+        if(SC8__SYNCS(opcode)) {
+            sc8__sync(state, done, &synced);
+        }
+        *ok = sc8__execute(state, opcode);
+        if(!*ok && state->wait != sc8_wait_None) {
+            sc8__tickTimers(state); // still waiting, it didn't run
+            return done;
+        }
+        SC8__INSTRUMENT(state, pc, opcode);
+        if(!*ok) {
+            sc8__sync(state, done + 1, &synced);
+            return done + 1;
+        }
+    }
+    sc8__sync(state, count, &synced);
+    *ok = true;
+    return count;
+}
+
+static bool sc8__step(sc8_state *state) {
+    const uint16_t pc = state->pc;
+    const uint16_t opcode = sc8__fetch(state);
+    const bool ok = sc8__execute(state, opcode);
+    if(ok || state->wait == sc8_wait_None) {
+        SC8__INSTRUMENT(state, pc, opcode);
+        state->cycles++;
+    }
+    sc8__tickTimers(state);
+    return ok;
+}
+
+#elif (defined(__GNUC__) || defined(__clang__)) && !defined(SC8_NO_COMPUTED_GOTO)
+// Threaded core: computed goto with the dispatch replicated at the end of
+// every handler, so each opcode gets its own indirect branch (and its own
+// slot in the branch predictor) instead of all of them sharing the one jump
+// of a switch.
+static uint32_t sc8__runThreaded(sc8_state *state, uint32_t count, bool *ok) {
+    static void *const top[16] = {
+        &&decode0, &&op_JP,   &&op_CALL, &&op_SEi,
+        &&op_SNEi, &&op_SE,   &&op_LDi,  &&op_ADDi,
+        &&decode8, &&op_SNE,  &&op_LDI,  &&op_JPV0,
+        &&op_RND,  &&op_DRW,  &&decodeE, &&decodeF,
+    };
+    static void *const group0[16] = {
+        [0x0] = &&op_CLS,
+        [0x1 ... 0xD] = &&op_unknown,
+        [0xE] = &&op_RET,
+        [0xF] = &&op_unknown,
+    };
+    static void *const group8[16] = {
+        &&op_LD,   &&op_OR,   &&op_AND,  &&op_XOR,
+        &&op_ADD,  &&op_SUB,  &&op_SHR,  &&op_SUBN,
+        &&op_unknown8, &&op_unknown8, &&op_unknown8, &&op_unknown8,
+        &&op_unknown8, &&op_unknown8, &&op_SHL, &&op_unknown8,
+    };
+    // the sparse groups are filled with a catch-all range first and then overridden
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+    static void *const groupE[256] = {
+        [0x00 ... 0xFF] = &&op_unknown,
+        [0x9E] = &&op_SKP,
+        [0xA1] = &&op_SKNP,
+    };
+    static void *const groupF[256] = {
+        [0x00 ... 0xFF] = &&op_unknown,
+        [0x07] = &&op_LDVxDT,
+        [0x0A] = &&op_LDK,
+        [0x15] = &&op_LDDT,
+        [0x18] = &&op_LDST,
+        [0x1E] = &&op_ADDI,
+        [0x29] = &&op_LDF,
+        [0x33] = &&op_LDB,
+        [0x55] = &&op_STORE,
+        [0x65] = &&op_LOAD,
+        [0xFF] = &&op_HALT,
+    };
+#pragma GCC diagnostic pop
+
+    uint32_t done = 0;
+    uint32_t synced = 0;
+    uint16_t pc;
+    uint16_t opcode;
+    *ok = true;
+    if(count == 0) {
+        return 0;
+    }
+
+#define SC8__DISPATCH() do {                   \
+        pc = state->pc;                        \
+        opcode = sc8__fetch(state);            \
+        goto *top[opcode >> 12];               \
+    } while(0)
+#define SC8__NEXT() do {                       \
+        SC8__INSTRUMENT(state, pc, opcode);    \
+        if(++done == count) goto end;          \
+        SC8__DISPATCH();                       \
+    } while(0)
+#define SC8__SYNC() sc8__sync(state, done, &synced)
+// the same split as `sc8__syncs`
+#define SC8__OP_SYNC(name) op_##name: SC8__SYNC(); sc8__op##name(state, opcode); SC8__NEXT()
+#define SC8__OP(name) op_##name: sc8__op##name(state, opcode); SC8__NEXT()
+#define SC8__OP_STOP(name) op_##name: SC8__SYNC(); if(!sc8__op##name(state, opcode)) goto stop; SC8__NEXT()
+#define SC8__OP_WAIT(name) op_##name: SC8__SYNC(); if(!sc8__op##name(state, opcode)) goto wait; SC8__NEXT()
+
+    SC8__DISPATCH();
+
+decode0: goto *group0[opcode & 0x000F];
+decode8: goto *group8[opcode & 0x000F];
+decodeE: goto *groupE[opcode & 0x00FF];
+decodeF: goto *groupF[opcode & 0x00FF];
+
+    SC8__OP(CLS);    SC8__OP(JP);
+    SC8__OP(SEi);    SC8__OP(SNEi);   SC8__OP(SE);     SC8__OP(LDi);
+    SC8__OP(ADDi);   SC8__OP(LD);     SC8__OP(OR);     SC8__OP(AND);
+    SC8__OP(XOR);    SC8__OP(ADD);    SC8__OP(SUB);    SC8__OP(SHR);
+    SC8__OP(SUBN);   SC8__OP(SHL);    SC8__OP(SNE);    SC8__OP(LDI);
+    SC8__OP(JPV0);   SC8__OP(RND);    SC8__OP(DRW);    SC8__OP(ADDI);
+    SC8__OP(LDF);
+    SC8__OP_SYNC(SKP);    SC8__OP_SYNC(SKNP);  SC8__OP_SYNC(LDVxDT);
+    SC8__OP_SYNC(LDDT);   SC8__OP_SYNC(LDST);  SC8__OP_SYNC(LDB);
+    SC8__OP_SYNC(STORE);  SC8__OP_SYNC(LOAD);
+    SC8__OP_STOP(RET); SC8__OP_STOP(CALL);
+    SC8__OP_WAIT(LDK); SC8__OP_WAIT(HALT);
+
+op_unknown:
+    SC8__SYNC();
+    sc8__opUnknown(state, opcode);
+    goto stop;
+op_unknown8:
+    SC8__SYNC();
+    sc8__opUnknown8(state, opcode);
+stop:
+    SC8__INSTRUMENT(state, pc, opcode);
+    done++;
+    SC8__SYNC();
+    *ok = false;
+    return done;
+wait:
+    sc8__tickTimers(state); // still waiting, it didn't run
+    *ok = false;
+    return done;
+end:
+    SC8__SYNC();
+    return done;
+
+#undef SC8__OP_WAIT
+#undef SC8__OP_STOP
+#undef SC8__OP
+#undef SC8__OP_SYNC
+#undef SC8__SYNC
+#undef SC8__NEXT
+#undef SC8__DISPATCH
+}
+
+static uint32_t sc8__run(sc8_state *state, uint32_t count, bool *ok) {
+    return sc8__runThreaded(state, count, ok);
+}
+
+static bool sc8__step(sc8_state *state) {
+    bool ok;
+    sc8__runThreaded(state, 1, &ok);
+    return ok;
+}
+
+#else
+// Table-driven fallback of the threaded core for compilers without computed
+// goto: one indirect call per opcode through a table indexed by the top nibble.
+typedef bool (*sc8__handler)(sc8_state *state, uint16_t opcode);
+
+static bool sc8__group0(sc8_state *state, uint16_t opcode) {
+    switch(opcode & 0x000F) {
+        case 0x0000: return sc8__opCLS(state, opcode);
+        case 0x000E: return sc8__opRET(state, opcode);
+        default:     return sc8__opUnknown(state, opcode);
+    }
+}
+static bool sc8__group8(sc8_state *state, uint16_t opcode) {
+    static const sc8__handler group8[16] = {
+        sc8__opLD,   sc8__opOR,   sc8__opAND,  sc8__opXOR,
+        sc8__opADD,  sc8__opSUB,  sc8__opSHR,  sc8__opSUBN,
+        sc8__opUnknown8, sc8__opUnknown8, sc8__opUnknown8, sc8__opUnknown8,
+        sc8__opUnknown8, sc8__opUnknown8, sc8__opSHL, sc8__opUnknown8,
+    };
+    return group8[opcode & 0x000F](state, opcode);
+}
+static bool sc8__groupE(sc8_state *state, uint16_t opcode) {
+    switch(opcode & 0x00FF) {
+        case 0x009E: return sc8__opSKP(state, opcode);
+        case 0x00A1: return sc8__opSKNP(state, opcode);
+        default:     return sc8__opUnknown(state, opcode);
+    }
+}
+static bool sc8__groupF(sc8_state *state, uint16_t opcode) {
+    switch(opcode & 0x00FF) {
+        case 0x0007: return sc8__opLDVxDT(state, opcode);
+        case 0x000A: return sc8__opLDK(state, opcode);
+        case 0x0015: return sc8__opLDDT(state, opcode);
+        case 0x0018: return sc8__opLDST(state, opcode);
+        case 0x001E: return sc8__opADDI(state, opcode);
+        case 0x0029: return sc8__opLDF(state, opcode);
+        case 0x0033: return sc8__opLDB(state, opcode);
+        case 0x0055: return sc8__opSTORE(state, opcode);
+        case 0x0065: return sc8__opLOAD(state, opcode);
+        case 0x00FF: return sc8__opHALT(state, opcode);
+        default:     return sc8__opUnknown(state, opcode);
+    }
+}
+
+static const sc8__handler sc8__top[16] = {
+    sc8__group0, sc8__opJP,   sc8__opCALL, sc8__opSEi,
+    sc8__opSNEi, sc8__opSE,   sc8__opLDi,  sc8__opADDi,
+    sc8__group8, sc8__opSNE,  sc8__opLDI,  sc8__opJPV0,
+    sc8__opRND,  sc8__opDRW,  sc8__groupE, sc8__groupF,
+};
+
+static uint32_t sc8__run(sc8_state *state, uint32_t count, bool *ok) {
+    uint32_t synced = 0;
+    for(uint32_t done = 0; done < count; done++) {
+        const uint16_t pc = state->pc;
+        const uint16_t opcode = sc8__fetch(state);
+        if(SC8__SYNCS(opcode)) {
+            sc8__sync(state, done, &synced);
+        }
+        *ok = sc8__top[opcode >> 12](state, opcode);
+        if(!*ok && state->wait != sc8_wait_None) {
+            sc8__tickTimers(state); // still waiting, it didn't run
+            return done;
+        }
+        SC8__INSTRUMENT(state, pc, opcode);
+        if(!*ok) {
+            sc8__sync(state, done + 1, &synced);
+            return done + 1;
+        }
+    }
+    sc8__sync(state, count, &synced);
+    *ok = true;
+    return count;
+}
+
+static bool sc8__step(sc8_state *state) {
+    const uint16_t pc = state->pc;
+    const uint16_t opcode = sc8__fetch(state);
+    const bool ok = sc8__top[opcode >> 12](state, opcode);
+    if(ok || state->wait == sc8_wait_None) {
+        SC8__INSTRUMENT(state, pc, opcode);
+        state->cycles++;
+    }
+    sc8__tickTimers(state);
+    return ok;
+}
+#endif // SC8_DISPATCH_THREADED
+
+bool sc8_step(sc8_state *state) {
+    state->wait = sc8_wait_None;
+    sc8__applyKeys(state, 0, 1);
+    SC8__TRACE_ENTER(state);
+    const bool ok = sc8__step(state);
+    SC8__TRACE_LEAVE(state);
+    return ok;
+}
+
+// Block cache.
+
+const char *sc8_kindName(int kind) {
+    static const char *names[] = {
+#define SC8__KIND_NAME(name) #name,
+        SC8__KINDS(SC8__KIND_NAME)
+#undef SC8__KIND_NAME
+    };
+    return (kind >= 0 && kind < sc8__kindCount) ? names[kind] : "?";
+}
+
+// Mirrors the reference switch in `sc8__execute`.
+static uint8_t sc8__decode(uint16_t opcode) {
+    switch(opcode & 0xF000) {
+        case 0x0000: {
+            switch(opcode & 0x000F) {
+                case 0x0000: return sc8__kindCLS;
+                case 0x000E: return sc8__kindRET;
+                default:     return sc8__kindUnknown;
+            }
+        }
+        case 0x1000: return sc8__kindJP;
+        case 0x2000: return sc8__kindCALL;
+        case 0x3000: return sc8__kindSEi;
+        case 0x4000: return sc8__kindSNEi;
+        case 0x5000: return sc8__kindSE;
+        case 0x6000: return sc8__kindLDi;
+        case 0x7000: return sc8__kindADDi;
+        case 0x8000: {
+            switch(opcode & 0x000F) {
+                case 0x0000: return sc8__kindLD;
+                case 0x0001: return sc8__kindOR;
+                case 0x0002: return sc8__kindAND;
+                case 0x0003: return sc8__kindXOR;
+                case 0x0004: return sc8__kindADD;
+                case 0x0005: return sc8__kindSUB;
+                case 0x0006: return sc8__kindSHR;
+                case 0x0007: return sc8__kindSUBN;
+                case 0x000E: return sc8__kindSHL;
+                default:     return sc8__kindUnknown8;
+            }
+        }
+        case 0x9000: return sc8__kindSNE;
+        case 0xA000: return sc8__kindLDI;
+        case 0xB000: return sc8__kindJPV0;
+        case 0xC000: return sc8__kindRND;
+        case 0xD000: return sc8__kindDRW;
+        case 0xE000: {
+            switch(opcode & 0x00FF) {
+                case 0x009E: return sc8__kindSKP;
+                case 0x00A1: return sc8__kindSKNP;
+                default:     return sc8__kindUnknown;
+            }
+        }
+        case 0xF000: {
+            switch(opcode & 0x00FF) {
+                case 0x0007: return sc8__kindLDVxDT;
+                case 0x000A: return sc8__kindLDK;
+                case 0x0015: return sc8__kindLDDT;
+                case 0x0018: return sc8__kindLDST;
+                case 0x001E: return sc8__kindADDI;
+                case 0x0029: return sc8__kindLDF;
+                case 0x0033: return sc8__kindLDB;
+                case 0x0055: return sc8__kindSTORE;
+                case 0x0065: return sc8__kindLOAD;
+                case 0x00FF: return sc8__kindHALT;
+                default:     return sc8__kindUnknown;
+            }
+        }
+    }
+    return sc8__kindUnknown;
+}
+
+// Anything that may leave pc somewhere other than pc + 2, or that writes memory
+// (so the write is seen before the next instruction is fetched from the cache).
+static inline bool sc8__endsBlock(uint8_t kind) {
+    switch(kind) {
+        case sc8__kindUnknown: case sc8__kindUnknown8:
+        case sc8__kindRET:  case sc8__kindJP:   case sc8__kindCALL:
+        case sc8__kindSEi:  case sc8__kindSNEi: case sc8__kindSE:
+        case sc8__kindSNE:  case sc8__kindJPV0: case sc8__kindSKP:
+        case sc8__kindSKNP: case sc8__kindLDK:  case sc8__kindLDB:
+        case sc8__kindSTORE: case sc8__kindHALT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static SC8__FORCE_INLINE bool sc8__executeKind(sc8_state *state, uint8_t kind, uint16_t opcode) {
+    switch(kind) {
+#define SC8__KIND_CASE(name) case sc8__kind##name: return sc8__op##name(state, opcode);
+        SC8__KINDS(SC8__KIND_CASE)
+#undef SC8__KIND_CASE
+    }
+    return sc8__opUnknown(state, opcode);
+}
+
+static inline uint64_t sc8__pageMask(size_t from, size_t to) {
+    // pages of the bytes in [from, to], both inclusive
+    const size_t first = from >> 6, last = to >> 6;
+    const uint64_t upto = (last >= 63) ? ~(uint64_t)0 : (((uint64_t)1 << (last + 1)) - 1);
+    return upto & ~(((uint64_t)1 << first) - 1);
+}
+
+void sc8_attachCache(sc8_state *state, sc8_blockCache *cache) {
+    if(cache != NULL) {
+        memset(cache, 0, sizeof(*cache));
+    }
+    state->cache = cache;
+}
+
+void sc8_cacheInvalidate(sc8_blockCache *cache, uint16_t addr, size_t len) {
+    if(len == 0 || addr >= MEMORY_SIZE) {
+        return;
+    }
+    const size_t end = SC8_MIN((size_t)addr + len, (size_t)MEMORY_SIZE);
+    if((cache->codePages & sc8__pageMask(addr, end - 1)) == 0) {
+        return;
+    }
+
+    // a slot runs over [p, p + 2*len), blocks are at most SC8_BLOCK_MAX long
+    // so nothing further back than that can reach `addr`
+    const size_t from = (addr > SC8_BLOCK_MAX * 2) ? addr - SC8_BLOCK_MAX * 2 : 0;
+    for(size_t p = from; p < end; p++) {
+        sc8_uop *uop = &cache->uops[p];
+        if(uop->len != 0 && p + 2 * (size_t)uop->len > addr) {
+            uop->len = 0;
+        }
+    }
+}
+
+static const sc8_uop *sc8__decodeBlock(sc8_blockCache *cache, const sc8_state *state, uint16_t pc) {
+    uint16_t count = 0;
+    uint16_t at = pc;
+    for(;;) {
+        const uint16_t opcode = state->memory[at] << 8 | state->memory[at + 1];
+        sc8_uop *uop = &cache->uops[at];
+        uop->opcode = opcode;
+        uop->kind = sc8__decode(opcode);
+        count++;
+        if(sc8__endsBlock(uop->kind) || count == SC8_BLOCK_MAX || at + 3 >= MEMORY_SIZE) {
+            break;
+        }
+        at += 2;
+    }
+
+    for(uint16_t k = 0; k < count; k++) {
+        cache->uops[pc + 2 * k].len = count - k;
+    }
+    cache->codePages |= sc8__pageMask(pc, at + 1);
+    return &cache->uops[pc];
+}
+
+static uint32_t sc8__runCached(sc8_state *state, uint32_t count, bool *ok) {
+    sc8_blockCache *cache = state->cache;
+    uint32_t done = 0;
+    uint32_t synced = 0;
+    while(done < count) {
+        if(state->pc >= MEMORY_SIZE - 1) {
+            // the last byte can't start a cached instruction, let the plain core handle it
+            sc8__sync(state, done, &synced);
+            if(!(*ok = sc8__step(state))) {
+                return done + (state->wait == sc8_wait_None);
+            }
+            synced = ++done;
+            continue;
+        }
+
+        const sc8_uop *uop = &cache->uops[state->pc];
+        if(uop->len == 0) {
+            uop = sc8__decodeBlock(cache, state, state->pc);
+        }
+
+        // only the last instruction of a block can branch or write memory,
+        // everything before it just moves pc forward by 2
+        uint32_t n = SC8_MIN((uint32_t)uop->len, count - done);
+        for(; n > 0; n--, uop += 2) {
+            const uint16_t pc = state->pc;
+            state->opcode = uop->opcode;
+            if(SC8__SYNCS_KIND(uop->kind)) {
+                sc8__sync(state, done, &synced);
+            }
+            *ok = sc8__executeKind(state, uop->kind, uop->opcode);
+            if(!*ok && state->wait != sc8_wait_None) {
+                sc8__tickTimers(state); // still waiting, it didn't run
+                return done;
+            }
+            SC8__INSTRUMENT(state, pc, uop->opcode);
+            done++;
+            if(!*ok) {
+                sc8__sync(state, done, &synced);
+                return done;
+            }
+        }
+    }
+    sc8__sync(state, done, &synced);
+    *ok = true;
+    return done;
+}
+
+uint32_t sc8_stepMany(sc8_state *state, uint32_t count) {
+    state->wait = sc8_wait_None;
+    SC8__TRACE_ENTER(state);
+    uint32_t done = 0;
+    bool ok = true;
+    while(ok && done < count) {
+        // straight through to the next key event, then apply it and carry on
+        const uint32_t until = sc8__applyKeys(state, done, count);
+        done += (state->cache != NULL) ? sc8__runCached(state, until - done, &ok) : sc8__run(state, until - done, &ok);
+    }
+    SC8__TRACE_LEAVE(state);
+    return done;
+}
+
+static inline bool sc8__breakpointAt(const sc8_state *state, uint16_t pc) {
+    pc &= MEMORY_SIZE - 1;
+    return state->breakpoints[pc >> 6] >> (pc & 63) & 1;
+}
+
+// Runs one predecoded instruction for `sc8_run`, returns false when it has to stop there.
+// `*done` counts it only if it was executed.
+static inline bool sc8__runOne(sc8_state *state, uint8_t kind, uint16_t opcode, uint32_t *done, sc8_StopReason *why) {
+    if(*done > 0 && sc8__breakpointAt(state, state->pc)) {
+        *why = sc8_run_Breakpoint;
+        return false;
+    }
+    state->opcode = opcode;
+    if(kind == sc8__kindHALT) {
+        sc8__event(state, sc8_event_Halt, opcode);
+        state->wait = sc8_wait_Halt;
+        *why = sc8_run_Halt;
+        return false;
+    }
+    const uint16_t pc = state->pc;
+    if(kind == sc8__kindLDK) {
+        if(!sc8__opLDK(state, opcode)) {
+            *why = sc8_run_KeyWait;
+            return false;
+        }
+        SC8__INSTRUMENT(state, pc, opcode);
+        state->cycles++;
+        (*done)++;
+        return true;
+    }
+
+    const bool ok = sc8__executeKind(state, kind, opcode);
+    SC8__INSTRUMENT(state, pc, opcode);
+    state->cycles++;
+    (*done)++;
+    if(!ok) {
+        *why = sc8_run_UnknownOpcode;
+        return false;
+    }
+    if(kind == sc8__kindDRW || kind == sc8__kindCLS) {
+        *why = sc8_run_Draw;
+        return false;
+    }
+    return true;
+}
+
+uint32_t sc8_run(sc8_state *state, uint32_t count, sc8_StopReason *reason) {
+    state->wait = sc8_wait_None;
+    SC8__TRACE_ENTER(state);
+    sc8_StopReason why = sc8_run_Budget;
+    uint32_t done = 0;
+    uint32_t keysDue = 0;
+    sc8_blockCache *cache = state->cache;
+    while(done < count) {
+        if(done == keysDue) {
+            keysDue = sc8__applyKeys(state, done, count);
+        }
+        // same walk as `sc8__runCached`, minus the timers
+        if(cache != NULL && state->pc < MEMORY_SIZE - 1) {
+            const sc8_uop *uop = &cache->uops[state->pc];
+            if(uop->len == 0) {
+                uop = sc8__decodeBlock(cache, state, state->pc);
+            }
+            uint32_t n = SC8_MIN((uint32_t)uop->len, keysDue - done);
+            for(; n > 0; n--, uop += 2) {
+                if(!sc8__runOne(state, uop->kind, uop->opcode, &done, &why)) {
+                    goto stop;
+                }
+            }
+        } else {
+            // no decoding up front, the few opcodes that matter here are easy to pick out
+            if(done > 0 && sc8__breakpointAt(state, state->pc)) {
+                why = sc8_run_Breakpoint;
+                break;
+            }
+            const uint16_t pc = state->pc;
+            const uint16_t opcode = sc8__fetch(state);
+            if((opcode & 0xF0FF) == 0xF0FF) {
+                sc8__event(state, sc8_event_Halt, opcode);
+                state->wait = sc8_wait_Halt;
+                why = sc8_run_Halt;
+                break;
+            }
+            if((opcode & 0xF0FF) == 0xF00A) {
+                if(!sc8__opLDK(state, opcode)) {
+                    why = sc8_run_KeyWait;
+                    break;
+                }
+                SC8__INSTRUMENT(state, pc, opcode);
+                state->cycles++;
+                done++;
+                continue;
+            }
+            const bool ok = sc8__execute(state, opcode);
+            SC8__INSTRUMENT(state, pc, opcode);
+            state->cycles++;
+            done++;
+            if(!ok) {
+                why = sc8_run_UnknownOpcode;
+                break;
+            }
+            if((opcode & 0xF000) == 0xD000 || (opcode & 0xF00F) == 0x0000) {
+                why = sc8_run_Draw;
+                break;
+            }
+        }
+    }
+
+stop:
+    SC8__TRACE_LEAVE(state);
+    if(reason != NULL) {
+        *reason = why;
+    }
+    return done;
+}
+
+// `sc8_runFrame`, which also stops once `cycles + idle` gets to `until` (returning
+// `sc8_run_Budget` with the frame not over yet).
+static sc8_StopReason sc8__runFrame(sc8_state *state, uint32_t instructionsPerFrame, uint64_t until) {
+    sc8_StopReason why = sc8_run_Budget;
+    while(state->frameCycles < instructionsPerFrame) {
+        const uint64_t clock = state->cycles + state->idle;
+        if(clock >= until) {
+            return sc8_run_Budget;
+        }
+        const uint32_t count = (uint32_t)SC8_MIN((uint64_t)(instructionsPerFrame - state->frameCycles), until - clock);
+        state->frameCycles += sc8_run(state, count, &why);
+        if(why == sc8_run_Draw) {
+            if(state->displayWait && (state->opcode & 0xF000) == 0xD000) {
+                break;
+            }
+            if(sc8__breakpointAt(state, state->pc)) {
+                return sc8_run_Breakpoint; // sc8_run wouldn't check it, it's the first one it runs
+            }
+            why = sc8_run_Budget;
+            continue;
+        }
+        if(why == sc8_run_Breakpoint || why == sc8_run_UnknownOpcode) {
+            return why; // the frame isn't over, the next call picks it up from here
+        }
+        if(why != sc8_run_Budget) {
+            break; // waiting on a key/halted for the rest of the frame
+        }
+    }
+
+    if(why == sc8_run_KeyWait || why == sc8_run_Halt) {
+        state->idle++; // the wait took up the rest of the frame
+    }
+    sc8__tickTimers(state);
+    state->frameCycles = 0;
+    state->frames++;
+    return why;
+}
+
+sc8_StopReason sc8_runFrame(sc8_state *state, uint32_t instructionsPerFrame) {
+    return sc8__runFrame(state, instructionsPerFrame, UINT64_MAX);
+}
+
+void sc8_setBreakpoint(sc8_state *state, uint16_t addr, bool enabled) {
+    addr &= MEMORY_SIZE - 1;
+    const uint64_t bit = (uint64_t)1 << (addr & 63);
+    if(enabled) {
+        state->breakpoints[addr >> 6] |= bit;
+    } else {
+        state->breakpoints[addr >> 6] &= ~bit;
+    }
+}
+
+void sc8_tickTimers(sc8_state *state) {
+    sc8__tickTimers(state);
+}
+
+uint32_t sc8_takeDirtyRows(sc8_state *state) {
+    const uint32_t rows = state->dirtyRows;
+    state->dirtyRows = 0;
+    return rows;
+}
+
+bool sc8_getPixel(const sc8_state *state, int x, int y) {
+    if(x < 0 || x >= SC8_W || y < 0 || y >= SC8_H) {
+        return false;
+    }
+    return state->gfx[y] >> (SC8_W - 1 - x) & 1;
+}
+
+// Save states.
+//
+// Layout (all little-endian):
+//   "SC8S", u16 version, u32 ROM size, u32 FNV-1a of the ROM
+//   u16 pc, i, opcode; u8 v[16], dt, st, sp; u16 stack[16]; u32 xorRandState
+//   u64 cycles, u32 frameCycles, u64 frames, u64 idle
+//   u8 flags (displayWait, wrapSprites, drawFlag, keyWaiting), u8 wait
+//   u16 keys down, keysPressed, keysReleased
+//   u32 mask of the non-empty rows, then a u64 for each of them
+//   memory runs: u16 address, u16 length, the bytes; ends with a run of length 0
+#define SC8__STATE_MAGIC "SC8S"
+// Unchanged bytes shorter than a run header get copied instead of starting a new run.
+#define SC8__STATE_RUN_GAP 4
+
+static uint32_t sc8__romHash(const uint8_t *rom, size_t rom_size) {
+    uint32_t hash = 2166136261u;
+    for(size_t i = 0; i < rom_size; i++) {
+        hash = (hash ^ rom[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// What memory looks like right after `sc8_init` and `sc8_loadRom`.
+static inline uint8_t sc8__baseByte(const uint8_t *rom, size_t rom_size, size_t addr) {
+    if(addr < sizeof(sc8_fontset)) {
+        return sc8_fontset[addr];
+    }
+    if(addr >= 512 && addr - 512 < rom_size) {
+        return rom[addr - 512];
+    }
+    return 0;
+}
+
+typedef struct {
+    uint8_t *at;
+    uint8_t *end;
+} sc8__writer;
+
+static void sc8__put(sc8__writer *w, uint64_t value, int bytes) {
+    if(w->end - w->at < bytes) {
+        w->at = w->end + 1; // doesn't fit, stays past the end from here on
+        return;
+    }
+    for(int b = 0; b < bytes; b++) {
+        *w->at++ = value >> (8 * b);
+    }
+}
+
+size_t sc8_saveState(const sc8_state *state, const uint8_t *rom, size_t rom_size, uint8_t *buffer, size_t buffer_size) {
+    sc8__writer w = { buffer, buffer + buffer_size };
+    for(int c = 0; c < 4; c++) {
+        sc8__put(&w, SC8__STATE_MAGIC[c], 1);
+    }
+    sc8__put(&w, SC8_STATE_VERSION, 2);
+    sc8__put(&w, rom_size, 4);
+    sc8__put(&w, sc8__romHash(rom, rom_size), 4);
+
+    sc8__put(&w, state->pc, 2);
+    sc8__put(&w, state->i, 2);
+    sc8__put(&w, state->opcode, 2);
+    for(int r = 0; r < 16; r++) {
+        sc8__put(&w, state->v[r], 1);
+    }
+    sc8__put(&w, state->dt, 1);
+    sc8__put(&w, state->st, 1);
+    sc8__put(&w, state->sp, 1);
+    for(int r = 0; r < 16; r++) {
+        sc8__put(&w, state->stack[r], 2);
+    }
+    sc8__put(&w, state->xorRandState, 4);
+    sc8__put(&w, state->cycles, 8);
+    sc8__put(&w, state->frameCycles, 4);
+    sc8__put(&w, state->frames, 8);
+    sc8__put(&w, state->idle, 8);
+    sc8__put(&w, state->displayWait | state->wrapSprites << 1 | state->drawFlag << 2 | state->keyWaiting << 3, 1);
+    sc8__put(&w, state->wait, 1);
+    uint16_t keys = 0;
+    for(int key = 0; key < 16; key++) {
+        keys |= state->key[key] << key;
+    }
+    sc8__put(&w, keys, 2);
+    sc8__put(&w, state->keysPressed, 2);
+    sc8__put(&w, state->keysReleased, 2);
+
+    uint32_t rows = 0;
+    for(int row = 0; row < SC8_H; row++) {
+        rows |= (uint32_t)(state->gfx[row] != 0) << row;
+    }
+    sc8__put(&w, rows, 4);
+    for(int row = 0; row < SC8_H; row++) {
+        if(rows >> row & 1) {
+            sc8__put(&w, state->gfx[row], 8);
+        }
+    }
+
+    for(size_t addr = 0; addr < MEMORY_SIZE; addr++) {
+        if(state->memory[addr] == sc8__baseByte(rom, rom_size, addr)) {
+            continue;
+        }
+        // extend the run until SC8__STATE_RUN_GAP bytes in a row match again
+        size_t end = addr + 1;
+        for(size_t same = 0; end < MEMORY_SIZE && same < SC8__STATE_RUN_GAP; end++) {
+            same = (state->memory[end] == sc8__baseByte(rom, rom_size, end)) ? same + 1 : 0;
+        }
+        while(state->memory[end - 1] == sc8__baseByte(rom, rom_size, end - 1)) {
+            end--;
+        }
+        sc8__put(&w, addr, 2);
+        sc8__put(&w, end - addr, 2);
+        for(; addr < end; addr++) {
+            sc8__put(&w, state->memory[addr], 1);
+        }
+    }
+    sc8__put(&w, 0, 2);
+    sc8__put(&w, 0, 2);
+
+    return (w.at > w.end) ? 0 : (size_t)(w.at - buffer);
+}
+
+typedef struct {
+    const uint8_t *at;
+    const uint8_t *end;
+} sc8__reader;
+
+static uint64_t sc8__get(sc8__reader *r, int bytes) {
+    if(r->end - r->at < bytes) {
+        r->at = r->end + 1; // truncated, reads 0 from here on
+        return 0;
+    }
+    uint64_t value = 0;
+    for(int b = 0; b < bytes; b++) {
+        value |= (uint64_t)*r->at++ << (8 * b);
+    }
+    return value;
+}
+
+// Walks the image, writing it to `state` only when `apply` is set, so it can be checked
+// all the way through first.
+static sc8_LoadStateResult sc8__readState(sc8_state *state, const uint8_t *rom, size_t rom_size, const uint8_t *buffer, size_t buffer_size, bool apply) {
+    sc8__reader r = { buffer, buffer + buffer_size };
+    for(int c = 0; c < 4; c++) {
+        if(sc8__get(&r, 1) != (uint8_t)SC8__STATE_MAGIC[c]) {
+            return sc8_loadState_BadImage;
+        }
+    }
+    if(sc8__get(&r, 2) != SC8_STATE_VERSION) {
+        return (r.at > r.end) ? sc8_loadState_BadImage : sc8_loadState_BadVersion;
+    }
+    const uint32_t saved_size = sc8__get(&r, 4);
+    const uint32_t saved_hash = sc8__get(&r, 4);
+    if(r.at > r.end) {
+        return sc8_loadState_BadImage;
+    }
+    if(saved_size != rom_size || saved_hash != sc8__romHash(rom, rom_size)) {
+        return sc8_loadState_WrongROM;
+    }
+
+    struct {
+        uint16_t pc, i, opcode;
+        uint8_t v[16], dt, st, sp;
+        uint16_t stack[16];
+        uint64_t cycles, frames, idle;
+        uint32_t frameCycles;
+        uint16_t keysPressed, keysReleased;
+    } s;
+    s.pc = sc8__get(&r, 2);
+    s.i = sc8__get(&r, 2);
+    s.opcode = sc8__get(&r, 2);
+    for(int reg = 0; reg < 16; reg++) {
+        s.v[reg] = sc8__get(&r, 1);
+    }
+    s.dt = sc8__get(&r, 1);
+    s.st = sc8__get(&r, 1);
+    s.sp = sc8__get(&r, 1);
+    for(int reg = 0; reg < 16; reg++) {
+        s.stack[reg] = sc8__get(&r, 2);
+    }
+    const uint32_t rand_state = sc8__get(&r, 4);
+    s.cycles = sc8__get(&r, 8);
+    s.frameCycles = sc8__get(&r, 4);
+    s.frames = sc8__get(&r, 8);
+    s.idle = sc8__get(&r, 8);
+    const uint8_t flags = sc8__get(&r, 1);
+    const uint8_t wait = sc8__get(&r, 1);
+    const uint16_t keys = sc8__get(&r, 2);
+    s.keysPressed = sc8__get(&r, 2);
+    s.keysReleased = sc8__get(&r, 2);
+    if(r.at > r.end || wait > sc8_wait_Halt || s.sp > 16) {
+        return sc8_loadState_BadImage;
+    }
+
+    if(apply) {
+        state->pc = s.pc;
+        state->i = s.i;
+        state->opcode = s.opcode;
+        memcpy(state->v, s.v, sizeof(s.v));
+        state->dt = s.dt;
+        state->st = s.st;
+        state->sp = s.sp;
+        memcpy(state->stack, s.stack, sizeof(s.stack));
+        state->xorRandState = rand_state;
+        state->cycles = s.cycles;
+        state->frameCycles = s.frameCycles;
+        state->frames = s.frames;
+        state->idle = s.idle;
+        state->displayWait = flags & 1;
+        state->wrapSprites = flags >> 1 & 1;
+        state->drawFlag = flags >> 2 & 1;
+        state->keyWaiting = flags >> 3 & 1;
+        state->wait = (sc8_Wait)wait;
+        for(int key = 0; key < 16; key++) {
+            state->key[key] = keys >> key & 1;
+        }
+        state->keysPressed = s.keysPressed;
+        state->keysReleased = s.keysReleased;
+    }
+
+    const uint32_t rows = sc8__get(&r, 4);
+    for(int row = 0; row < SC8_H; row++) {
+        const uint64_t bits = (rows >> row & 1) ? sc8__get(&r, 8) : 0;
+        if(apply) {
+            state->gfx[row] = bits;
+        }
+    }
+    if(apply) {
+        state->dirtyRows = ~(uint32_t)0;
+        for(size_t addr = 0; addr < MEMORY_SIZE; addr++) {
+            state->memory[addr] = sc8__baseByte(rom, rom_size, addr);
+        }
+    }
+
+    for(;;) {
+        const size_t addr = sc8__get(&r, 2);
+        const size_t len = sc8__get(&r, 2);
+        if(r.at > r.end || addr + len > MEMORY_SIZE || (size_t)(r.end - r.at) < len) {
+            return sc8_loadState_BadImage;
+        }
+        if(len == 0) {
+            break;
+        }
+        if(apply) {
+            memcpy(state->memory + addr, r.at, len);
+        }
+        r.at += len;
+    }
+    if(apply) {
+        sc8__memoryLoaded(state, 0, MEMORY_SIZE);
+    }
+    return sc8_loadState_OK;
+}
+
+sc8_LoadStateResult sc8_loadState(sc8_state *state, const uint8_t *rom, size_t rom_size, const uint8_t *buffer, size_t buffer_size) {
+    const sc8_LoadStateResult result = sc8__readState(state, rom, rom_size, buffer, buffer_size, false);
+    if(result != sc8_loadState_OK) {
+        return result;
+    }
+    return sc8__readState(state, rom, rom_size, buffer, buffer_size, true);
+}
+
+// Snapshots.
+
+void sc8_takeSnapshot(sc8_snapshot *snap, const sc8_state *state) {
+    memset(snap, 0, sizeof(*snap)); // padding too, it gets XORed
+    memcpy(snap->memory, state->memory, sizeof(snap->memory));
+    memcpy(snap->gfx, state->gfx, sizeof(snap->gfx));
+    snap->cycles = state->cycles;
+    snap->frames = state->frames;
+    snap->idle = state->idle;
+    snap->frameCycles = state->frameCycles;
+    snap->xorRandState = state->xorRandState;
+    snap->pc = state->pc;
+    snap->i = state->i;
+    snap->opcode = state->opcode;
+    for(int key = 0; key < 16; key++) {
+        snap->keys |= state->key[key] << key;
+    }
+    snap->keysPressed = state->keysPressed;
+    snap->keysReleased = state->keysReleased;
+    memcpy(snap->v, state->v, sizeof(snap->v));
+    memcpy(snap->stack, state->stack, sizeof(snap->stack));
+    snap->dt = state->dt;
+    snap->st = state->st;
+    snap->sp = state->sp;
+    snap->wait = state->wait;
+    snap->flags = state->displayWait | state->wrapSprites << 1 | state->drawFlag << 2 | state->keyWaiting << 3;
+}
+
+void sc8_restoreSnapshot(sc8_state *state, const sc8_snapshot *snap) {
+    memcpy(state->memory, snap->memory, sizeof(snap->memory));
+    sc8__memoryLoaded(state, 0, MEMORY_SIZE);
+    for(int row = 0; row < SC8_H; row++) {
+        if(state->gfx[row] != snap->gfx[row]) {
+            state->gfx[row] = snap->gfx[row];
+            state->dirtyRows |= (uint32_t)1 << row;
+        }
+    }
+    state->cycles = snap->cycles;
+    state->frames = snap->frames;
+    state->idle = snap->idle;
+    state->frameCycles = snap->frameCycles;
+    state->xorRandState = snap->xorRandState;
+    state->pc = snap->pc;
+    state->i = snap->i;
+    state->opcode = snap->opcode;
+    for(int key = 0; key < 16; key++) {
+        state->key[key] = snap->keys >> key & 1;
+    }
+    state->keysPressed = snap->keysPressed;
+    state->keysReleased = snap->keysReleased;
+    memcpy(state->v, snap->v, sizeof(snap->v));
+    memcpy(state->stack, snap->stack, sizeof(snap->stack));
+    state->dt = snap->dt;
+    state->st = snap->st;
+    state->sp = snap->sp;
+    state->wait = (sc8_Wait)snap->wait;
+    state->displayWait = snap->flags & 1;
+    state->wrapSprites = snap->flags >> 1 & 1;
+    state->drawFlag = snap->flags >> 2 & 1;
+    state->keyWaiting = snap->flags >> 3 & 1;
+}
+
+// Rewind.
+//
+// A record is a header, the run-length encoded snapshot (XORed with its keyframe unless it's
+// one) and its total size again, so the ring can be walked from either end. The encoding is
+// a control byte per run: below 0x80 that many plus one literal bytes follow, from 0x80 up
+// it stands for (control - 0x7F) zeros.
+typedef struct {
+    uint32_t bytes;    // the whole record
+    uint32_t sinceKey; // 0 for a keyframe
+    uint64_t keyAt;    // offset of its keyframe
+} sc8__rewindRecord;
+#define SC8__REWIND_OVERHEAD (sizeof(sc8__rewindRecord) + sizeof(uint32_t))
+
+// Encodes `snap` XOR `base` (just `snap` when `base` is NULL) to `out`, returns its size.
+static size_t sc8__rleEncode(uint8_t *out, const sc8_snapshot *snap, const sc8_snapshot *base) {
+    const uint8_t *a = (const uint8_t *)snap;
+    const uint8_t *b = (const uint8_t *)base;
+    const size_t n = sizeof(*snap);
+#define SC8__DELTA(at) (uint8_t)(a[at] ^ ((b != NULL) ? b[at] : 0))
+    size_t len = 0;
+    size_t at = 0;
+    while(at < n) {
+        size_t run = 0;
+        while(at + run < n && run < 128 && SC8__DELTA(at + run) == 0) {
+            run++;
+        }
+        if(run >= 2 || at + run == n) {
+            out[len++] = 0x7F + run;
+            at += run;
+            continue;
+        }
+        // literals, until a pair of zeros is worth a run of its own
+        const size_t start = at;
+        while(at < n && at - start < 128 &&
+              !(SC8__DELTA(at) == 0 && at + 1 < n && SC8__DELTA(at + 1) == 0)) {
+            at++;
+        }
+        out[len++] = at - start - 1;
+        for(size_t k = start; k < at; k++) {
+            out[len++] = SC8__DELTA(k);
+        }
+    }
+#undef SC8__DELTA
+    return len;
+}
+
+// XORs the decoded bytes onto `snap`.
+static void sc8__rleApply(sc8_snapshot *snap, const uint8_t *in, size_t len) {
+    uint8_t *out = (uint8_t *)snap;
+    size_t at = 0;
+    for(size_t k = 0; k < len && at < sizeof(*snap);) {
+        const uint8_t control = in[k++];
+        if(control >= 0x80) {
+            at += control - 0x7F;
+            continue;
+        }
+        for(int lit = 0; lit <= control && k < len && at < sizeof(*snap); lit++) {
+            out[at++] ^= in[k++];
+        }
+    }
+}
+
+static void sc8__ringWrite(sc8_rewind *rewind, uint64_t at, const void *data, size_t len) {
+    const size_t offset = at % rewind->size;
+    const size_t first = SC8_MIN(len, rewind->size - offset);
+    memcpy(rewind->buffer + offset, data, first);
+    memcpy(rewind->buffer, (const uint8_t *)data + first, len - first);
+}
+
+static void sc8__ringRead(const sc8_rewind *rewind, uint64_t at, void *data, size_t len) {
+    const size_t offset = at % rewind->size;
+    const size_t first = SC8_MIN(len, rewind->size - offset);
+    memcpy(data, rewind->buffer + offset, first);
+    memcpy((uint8_t *)data + first, rewind->buffer, len - first);
+}
+
+// Drops the oldest keyframe and the frames relying on it.
+static void sc8__rewindEvict(sc8_rewind *rewind) {
+    const uint64_t key = rewind->tail;
+    sc8__rewindRecord record;
+    do {
+        sc8__ringRead(rewind, rewind->tail, &record, sizeof(record));
+        rewind->tail += record.bytes;
+        rewind->frames--;
+        if(rewind->tail == rewind->head) {
+            return;
+        }
+        sc8__ringRead(rewind, rewind->tail, &record, sizeof(record));
+    } while(record.keyAt == key);
+}
+
+// Decodes the record at `at` on top of `snap` (which has to hold its keyframe, or zeros).
+static void sc8__rewindDecode(sc8_rewind *rewind, uint64_t at, const sc8__rewindRecord *record, sc8_snapshot *snap) {
+    const size_t len = record->bytes - SC8__REWIND_OVERHEAD;
+    sc8__ringRead(rewind, at + sizeof(*record), rewind->encoded, len);
+    sc8__rleApply(snap, rewind->encoded, len);
+}
+
+void sc8_rewindInit(sc8_rewind *rewind, void *buffer, size_t size) {
+    memset(rewind, 0, sizeof(*rewind));
+    rewind->buffer = buffer;
+    rewind->size = size;
+}
+
+void sc8_rewindPush(sc8_rewind *rewind, const sc8_state *state) {
+    sc8_takeSnapshot(&rewind->scratch, state);
+    for(;;) {
+        const bool isKey = rewind->frames == 0 || rewind->keyAt < rewind->tail ||
+                           rewind->sinceKey + 1 >= SC8_REWIND_KEY_EVERY;
+        const size_t len = sc8__rleEncode(rewind->encoded, &rewind->scratch, isKey ? NULL : &rewind->key);
+        const sc8__rewindRecord record = {
+            .bytes = (uint32_t)(len + SC8__REWIND_OVERHEAD),
+            .sinceKey = isKey ? 0 : rewind->sinceKey + 1,
+            .keyAt = isKey ? rewind->head : rewind->keyAt,
+        };
+        if(record.bytes > rewind->size) {
+            return; // wouldn't fit even on its own
+        }
+        if(rewind->head - rewind->tail + record.bytes > rewind->size) {
+            sc8__rewindEvict(rewind);
+            continue; // that might have taken our keyframe, encode it again
+        }
+
+        sc8__ringWrite(rewind, rewind->head, &record, sizeof(record));
+        sc8__ringWrite(rewind, rewind->head + sizeof(record), rewind->encoded, len);
+        sc8__ringWrite(rewind, rewind->head + sizeof(record) + len, &record.bytes, sizeof(record.bytes));
+        if(isKey) {
+            rewind->key = rewind->scratch;
+        }
+        rewind->keyAt = record.keyAt;
+        rewind->sinceKey = record.sinceKey;
+        rewind->head += record.bytes;
+        rewind->frames++;
+        return;
+    }
+}
+
+bool sc8_rewindPop(sc8_rewind *rewind, sc8_state *state) {
+    if(rewind->frames == 0) {
+        return false;
+    }
+    uint32_t bytes;
+    sc8__ringRead(rewind, rewind->head - sizeof(bytes), &bytes, sizeof(bytes));
+    const uint64_t at = rewind->head - bytes;
+    sc8__rewindRecord record;
+    sc8__ringRead(rewind, at, &record, sizeof(record));
+
+    if(record.sinceKey == 0) {
+        memset(&rewind->scratch, 0, sizeof(rewind->scratch));
+    } else {
+        rewind->scratch = rewind->key;
+    }
+    sc8__rewindDecode(rewind, at, &record, &rewind->scratch);
+    sc8_restoreSnapshot(state, &rewind->scratch);
+    rewind->head = at;
+    rewind->frames--;
+
+    if(record.sinceKey == 0 && rewind->frames > 0) {
+        // back into the previous keyframe's frames, decode that one
+        sc8__ringRead(rewind, rewind->head - sizeof(bytes), &bytes, sizeof(bytes));
+        sc8__rewindRecord newest;
+        sc8__ringRead(rewind, rewind->head - bytes, &newest, sizeof(newest));
+        sc8__rewindRecord key;
+        sc8__ringRead(rewind, newest.keyAt, &key, sizeof(key));
+        memset(&rewind->key, 0, sizeof(rewind->key));
+        sc8__rewindDecode(rewind, newest.keyAt, &key, &rewind->key);
+        rewind->keyAt = newest.keyAt;
+        rewind->sinceKey = newest.sinceKey;
+    } else {
+        rewind->sinceKey = record.sinceKey - (record.sinceKey > 0);
+    }
+    return true;
+}
+
+uint32_t sc8_rewindFrames(const sc8_rewind *rewind) {
+    return rewind->frames;
+}
+
+uint64_t sc8_stateHash(const sc8_state *state) {
+    sc8_snapshot snap;
+    sc8_takeSnapshot(&snap, state);
+    const uint8_t *bytes = (const uint8_t *)&snap;
+    uint64_t hash = 14695981039346656037u;
+    for(size_t i = 0; i < sizeof(snap); i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211u;
+    }
+    return hash;
+}
+
+// Movies.
+
+#define SC8__MOVIE_MAGIC "SC8M"
+#define SC8__MOVIE_HEADER 52
+#define SC8__MOVIE_EVENT 10
+#define SC8__MOVIE_KEYFRAME 16
+
+size_t sc8_movieWrite(uint8_t *out, size_t out_size, sc8_movieInfo *info, const uint8_t *rom, size_t rom_size,
+                      const sc8_keyEvent *events, const uint64_t *hashes, const sc8_movieKeyframe *keyframes) {
+    info->romSize = rom_size;
+    info->romHash = sc8__romHash(rom, rom_size);
+    size_t size = SC8__MOVIE_HEADER + (size_t)info->events * SC8__MOVIE_EVENT + info->frames * 8 +
+                  (size_t)info->keyframes * SC8__MOVIE_KEYFRAME;
+    const size_t images = size;
+    for(uint32_t k = 0; k < info->keyframes; k++) {
+        size += keyframes[k].size;
+    }
+    if(out == NULL) {
+        return size;
+    }
+    if(out_size < size) {
+        return 0;
+    }
+
+    sc8__writer w = { out, out + out_size };
+    for(int c = 0; c < 4; c++) {
+        sc8__put(&w, SC8__MOVIE_MAGIC[c], 1);
+    }
+    sc8__put(&w, SC8_MOVIE_VERSION, 2);
+    sc8__put(&w, 0, 2);
+    sc8__put(&w, info->romSize, 4);
+    sc8__put(&w, info->romHash, 4);
+    sc8__put(&w, info->randState, 4);
+    sc8__put(&w, info->instructionsPerFrame, 4);
+    sc8__put(&w, info->keyframeEvery, 4);
+    sc8__put(&w, info->firstFrame, 8);
+    sc8__put(&w, info->frames, 8);
+    sc8__put(&w, info->events, 4);
+    sc8__put(&w, info->keyframes, 4);
+    for(uint32_t e = 0; e < info->events; e++) {
+        sc8__put(&w, events[e].cycle, 8);
+        sc8__put(&w, events[e].key, 1);
+        sc8__put(&w, events[e].down, 1);
+    }
+    for(uint64_t f = 0; f < info->frames; f++) {
+        sc8__put(&w, hashes[f], 8);
+    }
+    size_t at = images;
+    for(uint32_t k = 0; k < info->keyframes; k++) {
+        sc8__put(&w, at, 8);
+        sc8__put(&w, keyframes[k].size, 4);
+        sc8__put(&w, keyframes[k].firstEvent, 4);
+        at += keyframes[k].size;
+    }
+    for(uint32_t k = 0; k < info->keyframes; k++) {
+        memcpy(w.at, keyframes[k].image, keyframes[k].size);
+        w.at += keyframes[k].size;
+    }
+    return size;
+}
+
+static uint64_t sc8__movieRead(const uint8_t *at, int bytes) {
+    sc8__reader r = { at, at + bytes };
+    return sc8__get(&r, bytes);
+}
+
+sc8_LoadStateResult sc8_movieOpen(sc8_movie *movie, const uint8_t *data, size_t size, const uint8_t *rom, size_t rom_size) {
+    sc8__reader r = { data, data + size };
+    for(int c = 0; c < 4; c++) {
+        if(sc8__get(&r, 1) != (uint8_t)SC8__MOVIE_MAGIC[c]) {
+            return sc8_loadState_BadImage;
+        }
+    }
+    if(sc8__get(&r, 2) != SC8_MOVIE_VERSION) {
+        return (r.at > r.end) ? sc8_loadState_BadImage : sc8_loadState_BadVersion;
+    }
+    sc8__get(&r, 2);
+    sc8_movieInfo info;
+    info.romSize = sc8__get(&r, 4);
+    info.romHash = sc8__get(&r, 4);
+    info.randState = sc8__get(&r, 4);
+    info.instructionsPerFrame = sc8__get(&r, 4);
+    info.keyframeEvery = sc8__get(&r, 4);
+    info.firstFrame = sc8__get(&r, 8);
+    info.frames = sc8__get(&r, 8);
+    info.events = sc8__get(&r, 4);
+    info.keyframes = sc8__get(&r, 4);
+    if(r.at > r.end || info.keyframeEvery == 0 || info.keyframes == 0 ||
+       (info.frames + info.keyframeEvery - 1) / info.keyframeEvery > info.keyframes) {
+        return sc8_loadState_BadImage;
+    }
+    if(info.romSize != rom_size || info.romHash != sc8__romHash(rom, rom_size)) {
+        return sc8_loadState_WrongROM;
+    }
+
+    // the tables have to fit, and so do the save states they point at
+    const uint64_t tables = (uint64_t)info.events * SC8__MOVIE_EVENT + info.frames * 8 +
+                            (uint64_t)info.keyframes * SC8__MOVIE_KEYFRAME;
+    if(info.frames > size || tables > size - SC8__MOVIE_HEADER) {
+        return sc8_loadState_BadImage;
+    }
+    movie->info = info;
+    movie->data = data;
+    movie->size = size;
+    movie->events = data + SC8__MOVIE_HEADER;
+    movie->hashes = movie->events + (size_t)info.events * SC8__MOVIE_EVENT;
+    movie->keyframes = movie->hashes + info.frames * 8;
+    movie->nextEvent = 0;
+    // events in order and for real keys, so playing them always makes progress
+    for(uint32_t e = 0; e < info.events; e++) {
+        const uint8_t *event = movie->events + (size_t)e * SC8__MOVIE_EVENT;
+        if(event[8] > 0xF || (e > 0 && sc8__movieRead(event, 8) < sc8__movieRead(event - SC8__MOVIE_EVENT, 8))) {
+            return sc8_loadState_BadImage;
+        }
+    }
+    for(uint32_t k = 0; k < info.keyframes; k++) {
+        sc8__reader key = { movie->keyframes + (size_t)k * SC8__MOVIE_KEYFRAME, data + size };
+        const uint64_t at = sc8__get(&key, 8);
+        const uint64_t len = sc8__get(&key, 4);
+        const uint64_t first = sc8__get(&key, 4);
+        if(at > size || len > size - at || first > info.events) {
+            return sc8_loadState_BadImage;
+        }
+    }
+    return sc8_loadState_OK;
+}
+
+sc8_LoadStateResult sc8_movieSeek(sc8_movie *movie, sc8_state *state, const uint8_t *rom, size_t rom_size, uint64_t frame) {
+    frame = SC8_MIN(frame, movie->info.frames);
+    const uint32_t k = SC8_MIN(frame / movie->info.keyframeEvery, (uint64_t)movie->info.keyframes - 1);
+    const uint8_t *key = movie->keyframes + (size_t)k * SC8__MOVIE_KEYFRAME;
+    const uint64_t at = sc8__movieRead(key, 8);
+    const size_t len = sc8__movieRead(key + 8, 4);
+    const sc8_LoadStateResult result = sc8_loadState(state, rom, rom_size, movie->data + at, len);
+    if(result != sc8_loadState_OK) {
+        return result;
+    }
+    // nothing queued from before the seek, the movie's events pick up from the keyframe
+    sc8_keyQueue *queue = &state->keyQueue;
+    queue->tail = queue->head;
+    movie->nextEvent = sc8__movieRead(key + 12, 4);
+
+    while(state->frames - movie->info.firstFrame < frame) {
+        sc8_moviePlayFrame(movie, state);
+    }
+    return sc8_loadState_OK;
+}
+
+bool sc8_moviePlayFrame(sc8_movie *movie, sc8_state *state) {
+    const uint64_t frame = state->frames - movie->info.firstFrame;
+    if(frame >= movie->info.frames) {
+        return false;
+    }
+    // a frame stopped by a breakpoint or an unknown opcode isn't over yet
+    while(state->frames - movie->info.firstFrame == frame) {
+        // queue what fits, each one still only gets applied at its own cycle
+        uint64_t until = UINT64_MAX;
+        for(; movie->nextEvent < movie->info.events; movie->nextEvent++) {
+            const uint8_t *event = movie->events + (size_t)movie->nextEvent * SC8__MOVIE_EVENT;
+            if(!sc8__pushKey(state, event[8], event[9], sc8__movieRead(event, 8))) {
+                // full: only run up to the newest one queued, then they're all due and make room
+                until = sc8__movieRead(event - SC8__MOVIE_EVENT, 8);
+                break;
+            }
+        }
+        sc8__runFrame(state, movie->info.instructionsPerFrame, until);
+        if(state->frames - movie->info.firstFrame == frame && state->cycles + state->idle >= until) {
+            sc8__applyKeys(state, 0, 0); // what the next `sc8_run` would have done first
+        }
+    }
+    return sc8_stateHash(state) == sc8__movieRead(movie->hashes + frame * 8, 8);
+}
+
+// Events.
+
+void sc8_attachEventLog(sc8_state *state, sc8_eventLog *log, uint32_t limit, uint64_t window) {
+    if(log != NULL) {
+        memset(log, 0, sizeof(*log));
+        log->limit = limit;
+        log->window = SC8_MAX(window, 1);
+        log->last.kind = sc8_event_Count; // matches nothing
+    }
+    state->events = log;
+}
+
+uint32_t sc8_eventDrain(sc8_eventLog *log, sc8_event *out, uint32_t max) {
+    const uint32_t head = __atomic_load_n(&log->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = log->tail; // only ever written from here
+    uint32_t n = 0;
+    for(; n < max && tail != head; n++, tail++) {
+        out[n] = log->ring[tail & (SC8_EVENT_RING - 1)];
+    }
+    __atomic_store_n(&log->tail, tail, __ATOMIC_RELEASE);
+    return n;
+}
+
+void sc8_eventTotals(const sc8_eventLog *log, uint64_t counts[sc8_event_Count], uint64_t *suppressed, uint64_t *dropped) {
+    for(int kind = 0; kind < sc8_event_Count; kind++) {
+        counts[kind] = __atomic_load_n(&log->counts[kind], __ATOMIC_RELAXED);
+    }
+    *suppressed = __atomic_load_n(&log->suppressed, __ATOMIC_RELAXED);
+    *dropped = __atomic_load_n(&log->dropped, __ATOMIC_RELAXED);
+}
+
+const char *sc8_eventName(uint8_t kind) {
+    static const char *names[sc8_event_Count] = {
+        "unknown opcode", "stack overflow", "stack underflow", "out of bounds", "halt",
+    };
+    return (kind < sc8_event_Count) ? names[kind] : "?";
+}
+
+// Formatted by hand, the library doesn't need stdio otherwise.
+static char *sc8__putHex(char *at, uint32_t value, int digits) {
+    for(int d = digits - 1; d >= 0; d--) {
+        *at++ = "0123456789ABCDEF"[value >> (d * 4) & 0xF];
+    }
+    return at;
+}
+
+int sc8_eventFormat(const sc8_event *event, char *buffer, size_t size) {
+    char line[64];
+    char *at = line;
+    memcpy(at, "cycle ", 6);
+    at += 6;
+    char digits[20];
+    int count = 0;
+    uint64_t cycle = event->cycle;
+    do {
+        digits[count++] = '0' + cycle % 10;
+        cycle /= 10;
+    } while(cycle != 0);
+    while(count > 0) {
+        *at++ = digits[--count];
+    }
+    *at++ = ':';
+    *at++ = ' ';
+    const char *name = sc8_eventName(event->kind);
+    const size_t nameLength = strlen(name);
+    memcpy(at, name, nameLength);
+    at += nameLength;
+    *at++ = ' ';
+    at = sc8__putHex(at, event->opcode, 4);
+    memcpy(at, " at ", 4);
+    at = sc8__putHex(at + 4, event->pc, 3);
+
+    const int length = (int)(at - line);
+    if(size > 0) {
+        const size_t copied = SC8_MIN((size_t)length, size - 1);
+        memcpy(buffer, line, copied);
+        buffer[copied] = '\0';
+    }
+    return length;
+}
+
+#ifdef SC8_EVENT_THREAD
+static void sc8__eventPrint(sc8_eventPrinter *printer) {
+    sc8_event events[64];
+    char line[64];
+    uint32_t n;
+    while((n = sc8_eventDrain(printer->log, events, sizeof(events) / sizeof(events[0]))) > 0) {
+        for(uint32_t e = 0; e < n; e++) {
+            sc8_eventFormat(&events[e], line, sizeof(line));
+            sc8_errprintf("%s\n", line);
+        }
+    }
+    const uint64_t suppressed = __atomic_load_n(&printer->log->suppressed, __ATOMIC_RELAXED);
+    if(suppressed != printer->suppressed) {
+        sc8_errprintf("(%llu more left out)\n", (unsigned long long)(suppressed - printer->suppressed));
+        printer->suppressed = suppressed;
+    }
+}
+
+static void *sc8__eventPrinter(void *data) {
+    sc8_eventPrinter *printer = data;
+    const struct timespec interval = { printer->intervalMs / 1000, (long)(printer->intervalMs % 1000) * 1000000 };
+    while(__atomic_load_n(&printer->running, __ATOMIC_ACQUIRE)) {
+        sc8__eventPrint(printer);
+        nanosleep(&interval, NULL);
+    }
+    sc8__eventPrint(printer);
+    return NULL;
+}
+
+bool sc8_eventPrinterStart(sc8_eventPrinter *printer, sc8_eventLog *log, uint32_t interval_ms) {
+    printer->log = log;
+    printer->intervalMs = interval_ms;
+    printer->suppressed = 0;
+    printer->running = true;
+    return pthread_create(&printer->thread, NULL, sc8__eventPrinter, printer) == 0;
+}
+
+void sc8_eventPrinterStop(sc8_eventPrinter *printer) {
+    __atomic_store_n(&printer->running, false, __ATOMIC_RELEASE);
+    pthread_join(printer->thread, NULL);
+}
+#endif // SC8_EVENT_THREAD
+
+#ifdef SC8_PROFILE
+// Profiler.
+
+void sc8_attachProfile(sc8_state *state, sc8_profile *profile) {
+    if(profile != NULL) {
+        memset(profile, 0, sizeof(*profile));
+        profile->nodes[0].routine = 0x200;
+        profile->nodes[0].calls = 1;
+        profile->nodeCount = 1;
+    }
+    state->profile = profile;
+}
+
+uint32_t sc8_profileHotLoops(const sc8_profile *profile, const sc8_state *state, sc8_hotLoop *loops, uint32_t max) {
+    uint32_t found = 0;
+    for(uint16_t pc = 0; pc < MEMORY_SIZE - 1; pc++) {
+        const uint16_t opcode = state->memory[pc] << 8 | state->memory[pc + 1];
+        if(profile->executed[pc] == 0 || (opcode & 0xF000) != 0x1000 || SC8_NNN(opcode) > pc) {
+            continue;
+        }
+        sc8_hotLoop loop = { SC8_NNN(opcode), pc, profile->executed[pc], 0 };
+        for(uint16_t at = loop.start; at <= pc; at++) {
+            loop.instructions += profile->executed[at];
+        }
+
+        // insertion into the top `max`, most instructions first
+        uint32_t at = SC8_MIN(found, max);
+        while(at > 0 && loops[at - 1].instructions < loop.instructions) {
+            if(at < max) {
+                loops[at] = loops[at - 1];
+            }
+            at--;
+        }
+        if(at < max) {
+            loops[at] = loop;
+        }
+        found++;
+    }
+    return SC8_MIN(found, max);
+}
+
+size_t sc8_profileDump(const sc8_profile *profile, const sc8_state *state, uint8_t *out, size_t out_size) {
+    uint32_t pcs = 0;
+    for(int pc = 0; pc < MEMORY_SIZE; pc++) {
+        pcs += profile->executed[pc] != 0;
+    }
+    const size_t size = 4 + 2 + 2 + sc8__kindCount * 8 + 4 + (size_t)pcs * 20;
+    if(out == NULL) {
+        return size;
+    }
+    if(out_size < size) {
+        return 0;
+    }
+
+    sc8__writer w = { out, out + out_size };
+    for(int c = 0; c < 4; c++) {
+        sc8__put(&w, "SC8P"[c], 1);
+    }
+    sc8__put(&w, SC8_PROFILE_VERSION, 2);
+    sc8__put(&w, sc8__kindCount, 2);
+    for(int kind = 0; kind < sc8__kindCount; kind++) {
+        sc8__put(&w, profile->kinds[kind], 8);
+    }
+    sc8__put(&w, pcs, 4);
+    for(int pc = 0; pc < MEMORY_SIZE; pc++) {
+        if(profile->executed[pc] == 0) {
+            continue;
+        }
+        const uint16_t opcode = state->memory[pc] << 8 | state->memory[(pc + 1) & (MEMORY_SIZE - 1)];
+        sc8__put(&w, pc, 2);
+        sc8__put(&w, opcode, 2);
+        sc8__put(&w, profile->executed[pc], 8);
+        sc8__put(&w, profile->skipsTaken[pc], 8);
+    }
+    return size;
+}
+
+uint32_t sc8_profileRoutines(const sc8_profile *profile, sc8_routineProfile *routines, uint32_t max) {
+    const sc8_callNode *nodes = profile->nodes;
+    // children always come after their parent, so one pass backwards adds up the subtrees
+    uint64_t total[SC8_PROFILE_NODES];
+    for(uint32_t n = 0; n < profile->nodeCount; n++) {
+        total[n] = nodes[n].self;
+    }
+    for(uint32_t n = profile->nodeCount - 1; n > 0; n--) {
+        total[nodes[n].parent] += total[n];
+    }
+
+    uint32_t found = 0;
+    for(uint32_t n = 0; n < profile->nodeCount; n++) {
+        uint32_t r = 0;
+        while(r < found && routines[r].routine != nodes[n].routine) {
+            r++;
+        }
+        if(r == found) {
+            if(found == max) {
+                continue;
+            }
+            routines[found++] = (sc8_routineProfile){ nodes[n].routine, 0, 0, 0 };
+        }
+        routines[r].calls += nodes[n].calls;
+        routines[r].exclusive += nodes[n].self;
+        // a recursive call is already inside the subtree of the outer one
+        bool outermost = true;
+        for(uint32_t up = n; up != 0 && outermost; ) {
+            up = nodes[up].parent;
+            outermost = nodes[up].routine != nodes[n].routine;
+        }
+        if(outermost) {
+            routines[r].inclusive += total[n];
+        }
+    }
+
+    // insertion sort, most inclusive first
+    for(uint32_t i = 1; i < found; i++) {
+        const sc8_routineProfile routine = routines[i];
+        uint32_t at = i;
+        for(; at > 0 && routines[at - 1].inclusive < routine.inclusive; at--) {
+            routines[at] = routines[at - 1];
+        }
+        routines[at] = routine;
+    }
+    return found;
+}
+
+uint32_t sc8_profileEdges(const sc8_profile *profile, sc8_callEdge *edges, uint32_t max) {
+    const sc8_callNode *nodes = profile->nodes;
+    uint32_t found = 0;
+    for(uint32_t n = 1; n < profile->nodeCount; n++) {
+        const uint16_t caller = nodes[nodes[n].parent].routine;
+        uint32_t e = 0;
+        while(e < found && (edges[e].caller != caller || edges[e].callee != nodes[n].routine)) {
+            e++;
+        }
+        if(e == found) {
+            if(found == max) {
+                continue;
+            }
+            edges[found++] = (sc8_callEdge){ caller, nodes[n].routine, 0 };
+        }
+        edges[e].calls += nodes[n].calls;
+    }
+
+    for(uint32_t i = 1; i < found; i++) {
+        const sc8_callEdge edge = edges[i];
+        uint32_t at = i;
+        for(; at > 0 && edges[at - 1].calls < edge.calls; at--) {
+            edges[at] = edges[at - 1];
+        }
+        edges[at] = edge;
+    }
+    return found;
+}
+
+uint8_t sc8_profileAccess(const sc8_profile *profile, uint16_t addr) {
+    addr &= MEMORY_SIZE - 1;
+    const bool fetched = profile->executed[addr] != 0 || profile->executed[(addr - 1) & (MEMORY_SIZE - 1)] != 0;
+    return (fetched ? SC8_MEM_EXEC : 0) | (profile->reads[addr] != 0 ? SC8_MEM_READ : 0) |
+           (profile->writes[addr] != 0 ? SC8_MEM_WRITE : 0);
+}
+
+uint32_t sc8_profileRegions(const sc8_profile *profile, sc8_memRegion *regions, uint32_t max) {
+    uint32_t found = 0;
+    for(uint16_t addr = 0; addr < MEMORY_SIZE; ) {
+        const uint8_t access = sc8_profileAccess(profile, addr);
+        sc8_memRegion region = { addr, addr, access, 0, 0, 0 };
+        for(; region.end < MEMORY_SIZE && sc8_profileAccess(profile, region.end) == access; region.end++) {
+            region.executed += profile->executed[region.end];
+            region.reads += profile->reads[region.end];
+            region.writes += profile->writes[region.end];
+        }
+        addr = region.end;
+        if(access == 0) {
+            continue;
+        }
+        if(found == max) {
+            break;
+        }
+        regions[found++] = region;
+    }
+    return found;
+}
+#endif // SC8_PROFILE
+
+#ifdef SC8_TRACE
+// Tracer.
+
+void sc8_attachTrace(sc8_state *state, sc8_trace *trace, bool lossless) {
+    if(state->trace != NULL) {
+        sc8__traceStop(state->trace);
+    }
+    if(trace != NULL) {
+        memset(trace, 0, sizeof(*trace));
+        trace->lossless = lossless;
+        trace->full = SC8_TRACE_RING;
+        trace->lost = true; // so the first call into the interpreter sends memory over
+        trace->left = UINT64_MAX;
+    }
+    state->trace = trace;
+}
+
+void sc8_traceInvalidate(sc8_state *state, uint16_t addr, size_t len) {
+    if(state->trace != NULL) {
+        sc8__traceMemory(state, addr & (MEMORY_SIZE - 1), len);
+    }
+}
+
+void sc8_traceFlush(sc8_state *state) {
+    if(state->trace != NULL) {
+        sc8__traceStop(state->trace);
+    }
+}
+
+// The V register `opcode` wrote, `SC8_TRACE_NONE` if none.
+static uint8_t sc8__traceWritten(uint16_t opcode) {
+    switch(opcode >> 12) {
+        case 0x6: case 0x7: case 0x8: case 0xC:
+            return SC8_Vx(opcode);
+        case 0xD:
+            return 0xF;
+        case 0xF:
+            if(SC8_KK(opcode) == 0x07 || SC8_KK(opcode) == 0x0A) {
+                return SC8_Vx(opcode);
+            }
+            if(SC8_KK(opcode) == 0x65 && SC8_Vx(opcode) > 0) {
+                return SC8_Vx(opcode) - 1; // the last one Fx65 loaded
+            }
+            return SC8_TRACE_NONE;
+        default:
+            return SC8_TRACE_NONE;
+    }
+}
+
+// Replays the instruction at the replay's pc, `entry` is the one after it for those that end a
+// block. Returns false, replaying nothing, when it ends a block and there's no `entry` for it
+// or not one that fits: the drain lost track of the guest.
+static bool sc8__traceReplay(sc8_trace *trace, const uint64_t *entry, sc8_traceRecord *record) {
+    sc8_state *replay = &trace->replay;
+    const uint16_t pc = replay->pc & (MEMORY_SIZE - 1);
+    const uint16_t opcode = sc8__fetch(replay);
+    if(sc8__traceEnds(opcode)) {
+        // SKP/SKNP move on by 2 or 4, the rest by 2 and wrote a register
+        if(entry == NULL) {
+            return false;
+        }
+        const uint16_t next = *entry & (MEMORY_SIZE - 1);
+        if((opcode & 0xF000) != 0xE000 && next != ((pc + 2) & (MEMORY_SIZE - 1))) {
+            return false;
+        }
+        replay->pc = next;
+        if((opcode & 0xF000) == 0xD000) {
+            replay->v[0xF] = (uint8_t)(*entry >> 24);
+        } else if((opcode & 0xF000) != 0xE000) {
+            replay->v[SC8_Vx(opcode)] = (uint8_t)(*entry >> 16);
+        }
+    } else {
+        sc8__execute(replay, opcode);
+    }
+    const uint8_t reg = sc8__traceWritten(opcode);
+    *record = (sc8_traceRecord){ trace->drainCycle++, pc, opcode, replay->i, reg,
+                                 (reg != SC8_TRACE_NONE) ? replay->v[reg] : 0 };
+    return true;
+}
+
+uint32_t sc8_traceDrain(sc8_trace *trace, sc8_traceRecord *out, uint32_t max) {
+    const uint32_t head = __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = trace->tail; // only ever written from here
+    sc8_state *replay = &trace->replay;
+    uint32_t n = 0;
+    while(n < max && tail != head) {
+        const uint64_t entry = trace->ring[tail & (SC8_TRACE_RING - 1)];
+        switch(entry & SC8__TRACE_KIND) {
+            case SC8__TRACE_START: {
+                // the seven after it went in with it
+                uint64_t words[8];
+                for(uint32_t w = 0; w < 8; w++) {
+                    words[w] = trace->ring[(tail + w) & (SC8_TRACE_RING - 1)];
+                }
+                replay->pc = entry & (MEMORY_SIZE - 1);
+                replay->i = (uint16_t)(entry >> 16);
+                replay->sp = (uint8_t)(entry >> 32);
+                trace->drainCycle = words[1];
+                memcpy(replay->v, &words[2], sizeof(replay->v));
+                memcpy(replay->stack, &words[4], sizeof(replay->stack));
+                trace->replaying = true;
+                tail += 8;
+                break;
+            }
+            case SC8__TRACE_MEMORY: {
+                const uint16_t addr = entry & (MEMORY_SIZE - 1);
+                for(int b = 0; b < 6; b++) {
+                    replay->memory[addr + b] = (uint8_t)(entry >> (16 + 8 * b));
+                }
+                tail++;
+                break;
+            }
+            case SC8__TRACE_STOP: {
+                // what ran of the block it stopped in, none of it ends a block
+                const uint64_t cycle = (entry & 0xFFF) | (entry >> 16) << 12;
+                while(trace->replaying && n < max && trace->drainCycle < cycle) {
+                    trace->replaying = sc8__traceReplay(trace, NULL, &out[n]);
+                    n += trace->replaying;
+                }
+                if(trace->replaying && trace->drainCycle < cycle) {
+                    goto full; // the rest next time
+                }
+                tail++;
+                break;
+            }
+            case SC8__TRACE_BLOCK: {
+                // the block up to the instruction it came after
+                bool ended = !trace->replaying;
+                while(!ended && n < max) {
+                    if(!sc8__traceReplay(trace, &entry, &out[n])) {
+                        trace->replaying = false; // off track, skip to the next start entry
+                        break;
+                    }
+                    ended = sc8__traceEnds(out[n++].opcode);
+                }
+                if(trace->replaying && !ended) {
+                    goto full; // the rest next time
+                }
+                tail++;
+                break;
+            }
+        }
+    }
+full:
+    __atomic_store_n(&trace->tail, tail, __ATOMIC_RELEASE);
+    return n;
+}
+
+enum {
+    sc8__traceNextCycle = 1, // cycle is the one before + 1, a zigzag varint of the difference otherwise
+    sc8__traceNextPc = 2,    // pc is the one before + 2, u16 otherwise
+    sc8__traceSameOp = 4,    // opcode is the last one at that pc, u16 otherwise
+    sc8__traceSameI = 8,     // I didn't change, u16 otherwise
+    sc8__traceNoReg = 16,    // no register written, u8 reg and u8 value otherwise
+};
+
+size_t sc8_traceEncode(const sc8_traceRecord *records, uint32_t count, uint8_t *out) {
+    uint16_t lastOp[MEMORY_SIZE] = { 0 };
+    uint8_t *at = out; // `out` fits the worst case, no checks needed
+    sc8_traceRecord prev = { 0 };
+    for(uint32_t n = 0; n < count; n++) {
+        const sc8_traceRecord *record = &records[n];
+        uint8_t *flags = at++;
+        *flags = 0;
+        if(record->cycle == prev.cycle + 1) {
+            *flags |= sc8__traceNextCycle;
+        } else {
+            // rewinds and save states can take it back
+            const int64_t delta = (int64_t)(record->cycle - prev.cycle);
+            uint64_t zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+            for(; zigzag >= 0x80; zigzag >>= 7) {
+                *at++ = (zigzag & 0x7F) | 0x80;
+            }
+            *at++ = zigzag;
+        }
+        if(record->pc == ((prev.pc + 2) & (MEMORY_SIZE - 1))) {
+            *flags |= sc8__traceNextPc;
+        } else {
+            *at++ = record->pc;
+            *at++ = record->pc >> 8;
+        }
+        if(record->opcode == lastOp[record->pc]) {
+            *flags |= sc8__traceSameOp;
+        } else {
+            *at++ = record->opcode;
+            *at++ = record->opcode >> 8;
+            lastOp[record->pc] = record->opcode;
+        }
+        if(record->i == prev.i) {
+            *flags |= sc8__traceSameI;
+        } else {
+            *at++ = record->i;
+            *at++ = record->i >> 8;
+        }
+        if(record->reg == SC8_TRACE_NONE) {
+            *flags |= sc8__traceNoReg;
+        } else {
+            *at++ = record->reg;
+            *at++ = record->value;
+        }
+        prev = *record;
+    }
+    return (size_t)(at - out);
+}
+
+bool sc8_traceDecode(const uint8_t *data, size_t size, sc8_traceRecord *records, uint32_t count) {
+    uint16_t lastOp[MEMORY_SIZE] = { 0 };
+    sc8__reader r = { data, data + size };
+    sc8_traceRecord prev = { 0 };
+    for(uint32_t n = 0; n < count; n++) {
+        sc8_traceRecord record;
+        const uint8_t flags = sc8__get(&r, 1);
+        if(flags & sc8__traceNextCycle) {
+            record.cycle = prev.cycle + 1;
+        } else {
+            uint64_t zigzag = 0;
+            for(int shift = 0; shift < 64; shift += 7) {
+                const uint8_t byte = sc8__get(&r, 1);
+                zigzag |= (uint64_t)(byte & 0x7F) << shift;
+                if(!(byte & 0x80)) {
+                    break;
+                }
+            }
+            record.cycle = prev.cycle + (uint64_t)((int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1));
+        }
+        record.pc = (flags & sc8__traceNextPc) ? ((prev.pc + 2) & (MEMORY_SIZE - 1)) : sc8__get(&r, 2) & (MEMORY_SIZE - 1);
+        if(flags & sc8__traceSameOp) {
+            record.opcode = lastOp[record.pc];
+        } else {
+            record.opcode = lastOp[record.pc] = sc8__get(&r, 2);
+        }
+        record.i = (flags & sc8__traceSameI) ? prev.i : sc8__get(&r, 2);
+        record.reg = SC8_TRACE_NONE;
+        record.value = 0;
+        if(!(flags & sc8__traceNoReg)) {
+            record.reg = sc8__get(&r, 1);
+            record.value = sc8__get(&r, 1);
+        }
+        if(r.at > r.end) {
+            return false;
+        }
+        records[n] = prev = record;
+    }
+    return true;
+}
+#endif // SC8_TRACE
+
+#ifdef SC8_SAMPLER
+// Sampling profiler.
+//
+// The ring has several producers (SIGPROF can land on any thread) and one consumer. A
+// producer claims a position with a CAS on `head`, fills the slot in and then publishes it
+// by setting its `seq` to the position + 1, the consumer only takes slots published for
+// the position it's at. Everything the handler touches is a lock-free atomic, so it's
+// async-signal-safe.
+typedef struct {
+    uint32_t seq;
+    sc8_sample sample;
+} sc8__sampleSlot;
+
+static struct {
+    const sc8_state *states[SC8_SAMPLER_STATES];
+    uint32_t romHashes[SC8_SAMPLER_STATES];
+    sc8__sampleSlot ring[SC8_SAMPLER_RING];
+    uint32_t head;
+    uint32_t tail;
+    uint32_t active; // handlers running right now
+    uint64_t dropped;
+} sc8__sampler;
+// a slot being filled in by `sc8_samplerRegister`
+#define SC8__SAMPLER_CLAIMED ((const sc8_state *)&sc8__sampler)
+
+#ifdef SC8__SAMPLER
+static void sc8__samplerPush(const sc8_sample *sample) {
+    uint32_t head = __atomic_load_n(&sc8__sampler.head, __ATOMIC_RELAXED);
+    do {
+        if(head - __atomic_load_n(&sc8__sampler.tail, __ATOMIC_ACQUIRE) >= SC8_SAMPLER_RING) {
+            __atomic_add_fetch(&sc8__sampler.dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    } while(!__atomic_compare_exchange_n(&sc8__sampler.head, &head, head + 1, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    sc8__sampleSlot *slot = &sc8__sampler.ring[head & (SC8_SAMPLER_RING - 1)];
+    slot->sample = *sample;
+    __atomic_store_n(&slot->seq, head + 1, __ATOMIC_RELEASE);
+}
+
+static void sc8__samplerTick(int signal) {
+    (void)signal;
+    __atomic_add_fetch(&sc8__sampler.active, 1, __ATOMIC_SEQ_CST);
+    for(int s = 0; s < SC8_SAMPLER_STATES; s++) {
+        const sc8_state *state = __atomic_load_n(&sc8__sampler.states[s], __ATOMIC_SEQ_CST);
+        if(state == NULL || state == SC8__SAMPLER_CLAIMED) {
+            continue;
+        }
+        // the state may be halfway through an instruction, this is the last one it finished
+        const uint32_t last = __atomic_load_n(&state->sample, __ATOMIC_RELAXED);
+        const sc8_sample sample = {
+            __atomic_load_n(&sc8__sampler.romHashes[s], __ATOMIC_RELAXED),
+            (uint16_t)(last >> 16),
+            (uint16_t)last,
+        };
+        sc8__samplerPush(&sample);
+    }
+    __atomic_sub_fetch(&sc8__sampler.active, 1, __ATOMIC_SEQ_CST);
+}
+#endif // SC8__SAMPLER
+
+bool sc8_samplerStart(uint32_t interval_us) {
+#ifdef SC8__SAMPLER
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = sc8__samplerTick;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if(interval_us == 0 || sigaction(SIGPROF, &action, NULL) != 0) {
+        return false;
+    }
+    struct itimerval timer;
+    timer.it_interval.tv_sec = interval_us / 1000000;
+    timer.it_interval.tv_usec = interval_us % 1000000;
+    timer.it_value = timer.it_interval;
+    return setitimer(ITIMER_PROF, &timer, NULL) == 0;
+#else
+    (void)interval_us;
+    return false;
+#endif // SC8__SAMPLER
+}
+
+void sc8_samplerStop(void) {
+#ifdef SC8__SAMPLER
+    // the handler stays, a SIGPROF already on its way must not kill the process
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, NULL);
+#endif // SC8__SAMPLER
+}
+
+bool sc8_samplerRegister(const sc8_state *state, const uint8_t *rom, size_t rom_size) {
+    const uint32_t hash = sc8__romHash(rom, rom_size);
+    for(int s = 0; s < SC8_SAMPLER_STATES; s++) {
+        const sc8_state *empty = NULL;
+        if(!__atomic_compare_exchange_n(&sc8__sampler.states[s], &empty, SC8__SAMPLER_CLAIMED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        // the hash goes in first, a handler may see the state as soon as it's in
+        __atomic_store_n(&sc8__sampler.romHashes[s], hash, __ATOMIC_RELAXED);
+        __atomic_store_n(&sc8__sampler.states[s], state, __ATOMIC_SEQ_CST);
+        return true;
+    }
+    return false;
+}
+
+bool sc8_samplerUnregister(const sc8_state *state) {
+    for(int s = 0; s < SC8_SAMPLER_STATES; s++) {
+        const sc8_state *expected = state;
+        __atomic_compare_exchange_n(&sc8__sampler.states[s], &expected, NULL, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    }
+    // a handler on another thread may still be reading it, they're short but may have been
+    // preempted
+    for(int tries = 0; tries < SC8_SAMPLER_UNREGISTER_TRIES; tries++) {
+        if(__atomic_load_n(&sc8__sampler.active, __ATOMIC_SEQ_CST) == 0) {
+            return true;
+        }
+#ifdef SC8__SAMPLER
+        sched_yield();
+#endif // SC8__SAMPLER
+    }
+    return false;
+}
+
+uint32_t sc8_samplerDrain(sc8_sample *out, uint32_t max) {
+    uint32_t tail = __atomic_load_n(&sc8__sampler.tail, __ATOMIC_RELAXED);
+    uint32_t n = 0;
+    for(; n < max; n++) {
+        const sc8__sampleSlot *slot = &sc8__sampler.ring[tail & (SC8_SAMPLER_RING - 1)];
+        if(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != tail + 1) {
+            break; // not published yet
+        }
+        out[n] = slot->sample;
+        tail++;
+        __atomic_store_n(&sc8__sampler.tail, tail, __ATOMIC_RELEASE);
+    }
+    return n;
+}
+
+uint64_t sc8_samplerDropped(void) {
+    return __atomic_load_n(&sc8__sampler.dropped, __ATOMIC_RELAXED);
+}
+
+uint32_t sc8_hotSpotsAdd(sc8_hotSpots *roms, uint32_t *count, uint32_t capacity, const sc8_sample *samples, uint32_t n) {
+    uint32_t lost = 0;
+    uint32_t last = 0; // samples come in runs of the same few ROMs
+    for(uint32_t i = 0; i < n; i++) {
+        const sc8_sample *sample = &samples[i];
+        if(last >= *count || roms[last].romHash != sample->romHash) {
+            for(last = 0; last < *count && roms[last].romHash != sample->romHash; last++) {}
+            if(last == *count) {
+                if(*count == capacity) {
+                    lost++;
+                    continue;
+                }
+                memset(&roms[last], 0, sizeof(roms[last]));
+                roms[last].romHash = sample->romHash;
+                (*count)++;
+            }
+        }
+        sc8_hotSpots *rom = &roms[last];
+        rom->samples++;
+        rom->pcs[sample->pc & (MEMORY_SIZE - 1)]++;
+        rom->kinds[sc8__decode(sample->opcode)]++;
+    }
+    return lost;
+}
+#endif // SC8_SAMPLER
+
+#ifdef SC8_JIT
+// Dynamic recompiler.
+//
+// Each translation is a function `uint32_t block(sc8_state *state, uint32_t budget)` returning
+// the budget left. Its body takes its own length off the budget first and hands back to the caller
+// when that doesn't fit. Exits with a known target pc end in a jump that gets linked straight into
+// the target's body once it's translated (and unlinked again when the target is invalidated), so
+// hot loops stay in native code until the budget runs out.
+
+static void sc8__jitFlush(sc8_jit *jit) {
+    memset(jit->code, 0, sizeof(jit->code));
+    memset(jit->heat, 0, sizeof(jit->heat));
+    jit->codePages = 0;
+    jit->links = 0;
+    jit->used = 0;
+    jit->unlink = false;
+}
+
+// The code buffer can't be trusted to be executable (or writable) anymore.
+static void sc8__jitBreak(sc8_jit *jit) {
+    sc8__jitFlush(jit);
+    jit->broken = true;
+}
+
+void sc8_attachJit(sc8_state *state, sc8_jit *jit) {
+    if(jit != NULL) {
+        sc8__jitFlush(jit);
+    }
+    state->jit = jit;
+}
+
+#ifdef SC8__JIT_X64
+
+// size of the prologue every translation starts with, the body comes right after
+#define SC8__JIT_PROLOGUE 20
+
+static bool sc8__jitProtect(sc8_jit *jit, bool writable) {
+    if(jit->writable == writable) {
+        return true;
+    }
+    if(mprotect(jit->buffer, SC8_JIT_CODE_SIZE, writable ? (PROT_READ | PROT_WRITE) : (PROT_READ | PROT_EXEC)) != 0) {
+        return false;
+    }
+    jit->writable = writable;
+    return true;
+}
+
+// point the jump at `link` either to the body of its target or back to its own return path
+static void sc8__jitPatch(sc8_jit *jit, const sc8_jitLink *link, bool linked) {
+    const uint8_t *to = linked ? (const uint8_t *)(void *)jit->code[link->target] + SC8__JIT_PROLOGUE
+                               : jit->buffer + link->fallback;
+    const uint32_t rel = (uint32_t)(to - (jit->buffer + link->at + 4));
+    memcpy(jit->buffer + link->at, &rel, 4);
+}
+
+// Points every jump into a dropped block back at its own return path. Breaks the JIT and
+// returns false when the buffer can't be made writable or executable again.
+static bool sc8__jitUnlinkDropped(sc8_jit *jit) {
+    if(!sc8__jitProtect(jit, true)) {
+        sc8__jitBreak(jit);
+        return false;
+    }
+    for(uint32_t l = 0; l < jit->links; l++) {
+        if(jit->code[jit->link[l].target] == NULL) {
+            sc8__jitPatch(jit, &jit->link[l], false);
+        }
+    }
+    jit->unlink = false;
+    if(!sc8__jitProtect(jit, false)) {
+        sc8__jitBreak(jit);
+        return false;
+    }
+    return true;
+}
+
+#endif // SC8__JIT_X64
+
+// Only drops the blocks: Fx33 and Fx55 get here from inside translated code, which has to
+// stay executable until it returns. `sc8_jitRun` unlinks the jumps into them before it runs
+// translated code again.
+void sc8_jitInvalidate(sc8_jit *jit, uint16_t addr, size_t len) {
+    if(len == 0 || addr >= MEMORY_SIZE) {
+        return;
+    }
+    const size_t end = SC8_MIN((size_t)addr + len, (size_t)MEMORY_SIZE);
+    // worth trying to translate again, the instruction starting a byte before included
+    const size_t first = (addr > 0) ? addr - 1 : 0;
+    memset(jit->heat + first, 0, end - first);
+    if((jit->codePages & sc8__pageMask(addr, end - 1)) == 0) {
+        return;
+    }
+
+    // same as the block cache, a translation covers [p, p + 2*len)
+    const size_t from = (addr > SC8_BLOCK_MAX * 2) ? addr - SC8_BLOCK_MAX * 2 : 0;
+    for(size_t p = from; p < end; p++) {
+        if(jit->code[p] != NULL && p + 2 * (size_t)jit->len[p] > addr) {
+            jit->code[p] = NULL;
+            jit->heat[p] = 0;
+            jit->unlink = true;
+        }
+    }
+}
+
+#ifdef SC8__JIT_X64
+
+// Called from translated code, with the opcode in the low half of `arg` and how many
+// instructions of the block (this one included) `cycles` is ahead by in the high half:
+// the block counts all of them on the way in, events want the cycle of this one.
+static void sc8__jitExecute(sc8_state *state, uint32_t arg) {
+    const uint16_t opcode = (uint16_t)arg;
+    state->cycles -= arg >> 16;
+    sc8__executeKind(state, sc8__decode(opcode), opcode);
+    state->cycles += arg >> 16;
+}
+static void sc8__jitBeep(sc8_state *state, uint32_t ticks) {
+    for(; ticks > 0 && state->st > 0; ticks--) {
+        sc8_beep();
+        state->st--;
+    }
+}
+
+// Host registers: rbx holds the state, eax/ecx/edx are scratch and the V registers
+// a block uses the most are cached in callee saved ones, so helper calls keep them.
+// [rsp] holds the budget left.
+enum { sc8__rax = 0, sc8__rcx = 1, sc8__rdx = 2, sc8__rbx = 3 };
+static const uint8_t sc8__jitCached[5] = { 5, 12, 13, 14, 15 }; // rbp, r12-r15
+
+typedef struct {
+    uint8_t *at;
+    int8_t host[16]; // host register caching each V register, -1 when it lives in memory
+} sc8__asm;
+
+static inline void sc8__b(sc8__asm *a, uint8_t byte) { *a->at++ = byte; }
+static inline void sc8__w(sc8__asm *a, uint16_t word) { memcpy(a->at, &word, 2); a->at += 2; }
+static inline void sc8__d(sc8__asm *a, uint32_t dword) { memcpy(a->at, &dword, 4); a->at += 4; }
+static inline void sc8__q(sc8__asm *a, uint64_t qword) { memcpy(a->at, &qword, 8); a->at += 8; }
+
+// [rbx + disp32] as the r/m operand, `reg` goes in the reg field
+static inline void sc8__mem(sc8__asm *a, int reg, size_t disp) {
+    sc8__b(a, 0x80 | (reg & 7) << 3 | sc8__rbx);
+    sc8__d(a, (uint32_t)disp);
+}
+// [rbx + rax + disp32]
+static inline void sc8__memIndexed(sc8__asm *a, int reg, size_t disp) {
+    sc8__b(a, 0x84 | (reg & 7) << 3);
+    sc8__b(a, 0x03);
+    sc8__d(a, (uint32_t)disp);
+}
+// [rbx + rax*2 + disp32]
+static inline void sc8__memIndexed2(sc8__asm *a, int reg, size_t disp) {
+    sc8__b(a, 0x84 | (reg & 7) << 3);
+    sc8__b(a, 0x43);
+    sc8__d(a, (uint32_t)disp);
+}
+// jump/jcc with a rel32 to fill in later, returns where it goes
+static inline uint8_t *sc8__jump(sc8__asm *a, uint8_t cc) {
+    if(cc == 0xFF) {
+        sc8__b(a, 0xE9);
+    } else {
+        sc8__b(a, 0x0F); sc8__b(a, 0x80 | cc);
+    }
+    uint8_t *rel = a->at;
+    sc8__d(a, 0);
+    return rel;
+}
+static inline void sc8__land(sc8__asm *a, uint8_t *rel) {
+    const uint32_t offset = (uint32_t)(a->at - (rel + 4));
+    memcpy(rel, &offset, 4);
+}
+enum { sc8__JB = 0x2, sc8__JAE = 0x3, sc8__JE = 0x4, sc8__JNE = 0x5, sc8__JA = 0x7, sc8__JMP = 0xFF };
+
+#define SC8__OFF_V(x) (offsetof(sc8_state, v) + (x))
+
+// scratch = Vx, zero extended
+static void sc8__loadV(sc8__asm *a, int scratch, int x) {
+    const int host = a->host[x];
+    if(host >= 0) {
+        if(host >= 8) sc8__b(a, 0x44);
+        sc8__b(a, 0x89); // mov scratch, host
+        sc8__b(a, 0xC0 | (host & 7) << 3 | scratch);
+    } else {
+        sc8__b(a, 0x0F); sc8__b(a, 0xB6); // movzx scratch, byte [Vx]
+        sc8__mem(a, scratch, SC8__OFF_V(x));
+    }
+}
+// Vx = low byte of scratch
+static void sc8__storeV(sc8__asm *a, int x, int scratch) {
+    const int host = a->host[x];
+    if(host >= 0) {
+        if(host >= 8) sc8__b(a, 0x44);
+        sc8__b(a, 0x0F); sc8__b(a, 0xB6); // movzx host, scratch8
+        sc8__b(a, 0xC0 | (host & 7) << 3 | scratch);
+    } else {
+        sc8__b(a, 0x88); // mov byte [Vx], scratch8
+        sc8__mem(a, scratch, SC8__OFF_V(x));
+    }
+}
+static void sc8__spill(sc8__asm *a) {
+    for(int x = 0; x < 16; x++) {
+        const int host = a->host[x];
+        if(host >= 0) {
+            sc8__b(a, (host >= 8) ? 0x44 : 0x40);
+            sc8__b(a, 0x88);
+            sc8__mem(a, host, SC8__OFF_V(x));
+        }
+    }
+}
+static void sc8__reload(sc8__asm *a) {
+    for(int x = 0; x < 16; x++) {
+        const int host = a->host[x];
+        if(host >= 0) {
+            if(host >= 8) sc8__b(a, 0x44);
+            sc8__b(a, 0x0F); sc8__b(a, 0xB6);
+            sc8__mem(a, host, SC8__OFF_V(x));
+        }
+    }
+}
+static void sc8__call(sc8__asm *a, const void *fn, uint32_t arg) {
+    sc8__b(a, 0x48); sc8__b(a, 0x89); sc8__b(a, 0xDF); // mov rdi, rbx
+    sc8__b(a, 0xBE); sc8__d(a, arg);                   // mov esi, arg
+    sc8__b(a, 0x48); sc8__b(a, 0xB8); sc8__q(a, (uint64_t)(uintptr_t)fn); // mov rax, fn
+    sc8__b(a, 0xFF); sc8__b(a, 0xD0);                  // call rax
+}
+static void sc8__movImm(sc8__asm *a, int scratch, uint32_t imm) {
+    sc8__b(a, 0xB8 + scratch);
+    sc8__d(a, imm);
+}
+// <op> eax, imm32
+static void sc8__aluImm(sc8__asm *a, uint8_t op, uint32_t imm) {
+    sc8__b(a, op);
+    sc8__d(a, imm);
+}
+enum { sc8__ADD = 0x05, sc8__OR = 0x0D, sc8__AND = 0x25, sc8__SUB = 0x2D, sc8__XOR = 0x35, sc8__CMP = 0x3D };
+
+static void sc8__setPc(sc8__asm *a, uint16_t pc) {
+    sc8__b(a, 0x66); sc8__b(a, 0xC7); // mov word [pc], imm16
+    sc8__mem(a, 0, offsetof(sc8_state, pc));
+    sc8__w(a, pc);
+}
+
+// Apply the timer ticks of the instructions translated so far.
+static void sc8__flushTicks(sc8__asm *a, uint32_t *pending) {
+    if(*pending == 0) {
+        return;
+    }
+    sc8__b(a, 0x0F); sc8__b(a, 0xB6); sc8__mem(a, sc8__rax, offsetof(sc8_state, dt)); // movzx eax, [dt]
+    sc8__aluImm(a, sc8__SUB, *pending);
+    sc8__b(a, 0x31); sc8__b(a, 0xC9);                   // xor ecx, ecx
+    sc8__b(a, 0x85); sc8__b(a, 0xC0);                   // test eax, eax
+    sc8__b(a, 0x0F); sc8__b(a, 0x48); sc8__b(a, 0xC1);  // cmovs eax, ecx
+    sc8__b(a, 0x88); sc8__mem(a, sc8__rax, offsetof(sc8_state, dt));
+
+    sc8__b(a, 0x80); sc8__b(a, 0xBB);                   // cmp byte [st], 0
+    sc8__d(a, (uint32_t)offsetof(sc8_state, st)); sc8__b(a, 0);
+    uint8_t *silent = sc8__jump(a, sc8__JE);
+    sc8__call(a, (const void *)sc8__jitBeep, *pending);
+    sc8__land(a, silent);
+
+    *pending = 0;
+}
+
+// Set pc and leave through a linkable jump.
+static void sc8__exit(sc8_jit *jit, sc8__asm *a, uint16_t target, uint8_t **returns, int *nreturns) {
+    sc8__setPc(a, target);
+    uint8_t *rel = sc8__jump(a, sc8__JMP);
+    if(target >= MEMORY_SIZE - 1 || jit->links == SC8_JIT_LINKS) {
+        returns[(*nreturns)++] = rel; // nowhere to link to, just return
+        return;
+    }
+    sc8_jitLink *link = &jit->link[jit->links++];
+    link->target = target;
+    link->at = (uint32_t)(rel - jit->buffer);
+    link->fallback = 0; // filled in once the return path is emitted
+    returns[(*nreturns)++] = rel;
+}
+
+static bool sc8__jitCompile(sc8_jit *jit, const sc8_state *state, uint16_t pc) {
+    uint16_t opcodes[SC8_BLOCK_MAX];
+    uint8_t kinds[SC8_BLOCK_MAX];
+    int count = 0;
+    for(uint16_t at = pc; count < SC8_BLOCK_MAX && at + 1 < MEMORY_SIZE; at += 2) {
+        const uint16_t opcode = state->memory[at] << 8 | state->memory[at + 1];
+        const uint8_t kind = sc8__decode(opcode);
+        if(kind == sc8__kindDRW || kind == sc8__kindLDK || kind == sc8__kindHALT ||
+           kind == sc8__kindUnknown || kind == sc8__kindUnknown8) {
+            break; // left for the interpreter
+        }
+        opcodes[count] = opcode;
+        kinds[count] = kind;
+        count++;
+        if(sc8__endsBlock(kind)) {
+            break;
+        }
+    }
+    if(count == 0) {
+        return false;
+    }
+
+    // VF liveness, walking backwards from the end of the block (where it's always live)
+    bool vfLive[SC8_BLOCK_MAX];
+    bool live = true;
+    for(int k = count - 1; k >= 0; k--) {
+        vfLive[k] = live;
+        const uint16_t opcode = opcodes[k];
+        const int x = SC8_Vx(opcode), y = SC8_Vy(opcode);
+        switch(kinds[k]) {
+            case sc8__kindLDi: case sc8__kindLD:
+                if(x == 0xF) live = false;
+                break;
+            case sc8__kindADD: case sc8__kindSUB: case sc8__kindSUBN:
+                live = (x == 0xF || y == 0xF);
+                break;
+            case sc8__kindSHR: case sc8__kindSHL:
+                live = (x == 0xF);
+                break;
+            case sc8__kindADDi: case sc8__kindOR: case sc8__kindAND: case sc8__kindXOR:
+            case sc8__kindLDI: case sc8__kindADDI: case sc8__kindLDF: case sc8__kindLDVxDT:
+            case sc8__kindLDDT: case sc8__kindLDST: case sc8__kindJP:
+                if(x == 0xF) live = true;
+                break;
+            default:
+                live = true; // helpers and branches, don't bother
+                break;
+        }
+    }
+
+    // worst case is well under 256 bytes per instruction
+    const size_t needed = 256 * (size_t)count + 512;
+    if(jit->used + needed > SC8_JIT_CODE_SIZE) {
+        sc8__jitFlush(jit);
+    }
+    if(!sc8__jitProtect(jit, true)) {
+        sc8__jitBreak(jit);
+        return false;
+    }
+
+    sc8__asm a;
+    a.at = jit->buffer + jit->used;
+    uint8_t *const start = a.at;
+
+    // cache the most used V registers
+    int uses[16] = {0};
+    for(int k = 0; k < count; k++) {
+        uses[SC8_Vx(opcodes[k])]++;
+        uses[SC8_Vy(opcodes[k])]++;
+    }
+    memset(a.host, -1, sizeof(a.host));
+    for(int r = 0; r < 5; r++) {
+        int best = -1;
+        for(int x = 0; x < 16; x++) {
+            if(a.host[x] < 0 && uses[x] >= 2 && (best < 0 || uses[x] > uses[best])) {
+                best = x;
+            }
+        }
+        if(best < 0) {
+            break;
+        }
+        a.host[best] = sc8__jitCached[r];
+    }
+
+    // push rbx, rbp, r12-r15, keep the stack 16 byte aligned for calls and the budget at [rsp]
+    sc8__b(&a, 0x53); sc8__b(&a, 0x55);
+    sc8__b(&a, 0x41); sc8__b(&a, 0x54); sc8__b(&a, 0x41); sc8__b(&a, 0x55);
+    sc8__b(&a, 0x41); sc8__b(&a, 0x56); sc8__b(&a, 0x41); sc8__b(&a, 0x57);
+    sc8__b(&a, 0x48); sc8__b(&a, 0x83); sc8__b(&a, 0xEC); sc8__b(&a, 0x08); // sub rsp, 8
+    sc8__b(&a, 0x48); sc8__b(&a, 0x89); sc8__b(&a, 0xFB);                   // mov rbx, rdi
+    sc8__b(&a, 0x89); sc8__b(&a, 0x34); sc8__b(&a, 0x24);                   // mov [rsp], esi
+    assert(a.at - start == SC8__JIT_PROLOGUE);
+
+    // body: sub dword [rsp], count; jb over budget; add qword [cycles], count
+    sc8__b(&a, 0x81); sc8__b(&a, 0x2C); sc8__b(&a, 0x24); sc8__d(&a, (uint32_t)count);
+    uint8_t *overBudget = sc8__jump(&a, sc8__JB);
+    sc8__b(&a, 0x48); sc8__b(&a, 0x81); sc8__mem(&a, 0, offsetof(sc8_state, cycles)); sc8__d(&a, (uint32_t)count);
+    sc8__reload(&a);
+
+    // everything but a branch at the end is translated here
+    uint8_t last = kinds[count - 1];
+    const bool branches = sc8__endsBlock(last) && last != sc8__kindLDB && last != sc8__kindSTORE;
+    const int straight = branches ? count - 1 : count;
+
+    uint32_t pending = 0;
+    uint16_t at = pc;
+    for(int k = 0; k < straight; k++, at += 2) {
+        const uint16_t opcode = opcodes[k];
+        const int x = SC8_Vx(opcode), y = SC8_Vy(opcode);
+        const uint8_t kk = SC8_KK(opcode);
+        const uint16_t nnn = SC8_NNN(opcode);
+        const bool flag = vfLive[k] || x == 0xF;
+
+        switch(kinds[k]) {
+            case sc8__kindLDi:
+                sc8__movImm(&a, sc8__rax, kk);
+                sc8__storeV(&a, x, sc8__rax);
+                break;
+            case sc8__kindADDi:
+                sc8__loadV(&a, sc8__rax, x);
+                sc8__aluImm(&a, sc8__ADD, kk);
+                sc8__storeV(&a, x, sc8__rax);
+                break;
+            // like the interpreter, 8XY0-8XY3 use the Y index itself
+            case sc8__kindLD:
+                sc8__movImm(&a, sc8__rax, y);
+                sc8__storeV(&a, x, sc8__rax);
+                break;
+            case sc8__kindOR: case sc8__kindAND: case sc8__kindXOR:
+                sc8__loadV(&a, sc8__rax, x);
+                sc8__aluImm(&a, (kinds[k] == sc8__kindOR) ? sc8__OR :
+                                (kinds[k] == sc8__kindAND) ? sc8__AND : sc8__XOR, y);
+                sc8__storeV(&a, x, sc8__rax);
+                break;
+            case sc8__kindADD:
+                sc8__loadV(&a, sc8__rax, x);
+                sc8__loadV(&a, sc8__rcx, y);
+                sc8__b(&a, 0x01); sc8__b(&a, 0xC8);                  // add eax, ecx
+                if(flag) {
+                    sc8__aluImm(&a, sc8__CMP, 255);
+                    sc8__b(&a, 0x0F); sc8__b(&a, 0x97); sc8__b(&a, 0xC2); // seta dl
+                    sc8__storeV(&a, 0xF, sc8__rdx);
+                }
+                sc8__storeV(&a, x, sc8__rax);
+                break;
+            case sc8__kindSUB:
+                sc8__loadV(&a, sc8__rax, x);
+                sc8__loadV(&a, sc8__rcx, y);
+                if(flag) {
+                    sc8__b(&a, 0x39); sc8__b(&a, 0xC8);                  // cmp eax, ecx
+                    sc8__b(&a, 0x0F); sc8__b(&a, 0x97); sc8__b(&a, 0xC2); // seta dl
+                    sc8__storeV(&a, 0xF, sc8__rdx);
+                }
+                sc8__b(&a, 0x29); sc8__b(&a, 0xC8);                      // sub eax, ecx
+                sc8__storeV(&a, x, sc8__rax);
+                break;
+            case sc8__kindSUBN:
+                sc8__loadV(&a, sc8__rax, x);
+                sc8__loadV(&a, sc8__rcx, y);
+                if(flag) {
+                    sc8__b(&a, 0x39); sc8__b(&a, 0xC1);                  // cmp ecx, eax
+                    sc8__b(&a, 0x0F); sc8__b(&a, 0x97); sc8__b(&a, 0xC2); // seta dl
+                    sc8__storeV(&a, 0xF, sc8__rdx);
+                }
+                sc8__b(&a, 0x29); sc8__b(&a, 0xC1);                      // sub ecx, eax
+                sc8__storeV(&a, x, sc8__rcx);
+                break;
+            // VF is set before Vx is shifted and Vx is read again, which matters when X is F
+            case sc8__kindSHR: case sc8__kindSHL:
+                if(flag) {
+                    sc8__loadV(&a, sc8__rdx, x);
+                    if(kinds[k] == sc8__kindSHR) {
+                        sc8__b(&a, 0x83); sc8__b(&a, 0xE2); sc8__b(&a, 0x01); // and edx, 1
+                    } else {
+                        sc8__b(&a, 0xC1); sc8__b(&a, 0xEA); sc8__b(&a, 0x07); // shr edx, 7
+                    }
+                    sc8__storeV(&a, 0xF, sc8__rdx);
+                }
+                sc8__loadV(&a, sc8__rax, x);
+                sc8__b(&a, 0xD1); sc8__b(&a, (kinds[k] == sc8__kindSHR) ? 0xE8 : 0xE0); // shr/shl eax, 1
+                sc8__storeV(&a, x, sc8__rax);
+                break;
+            case sc8__kindLDI:
+                sc8__b(&a, 0x66); sc8__b(&a, 0xC7); sc8__mem(&a, 0, offsetof(sc8_state, i));
+                sc8__w(&a, nnn);
+                break;
+            case sc8__kindADDI:
+                sc8__loadV(&a, sc8__rax, x);
+                sc8__b(&a, 0x66); sc8__b(&a, 0x01); sc8__mem(&a, sc8__rax, offsetof(sc8_state, i));
+                break;
+            case sc8__kindLDF:
+                sc8__loadV(&a, sc8__rax, x);
+                sc8__b(&a, 0x6B); sc8__b(&a, 0xC0); sc8__b(&a, 0x05);   // imul eax, eax, 5
+                sc8__b(&a, 0x66); sc8__b(&a, 0x89); sc8__mem(&a, sc8__rax, offsetof(sc8_state, i));
+                break;
+            case sc8__kindLDVxDT:
+                sc8__flushTicks(&a, &pending);
+                sc8__b(&a, 0x0F); sc8__b(&a, 0xB6); sc8__mem(&a, sc8__rax, offsetof(sc8_state, dt));
+                sc8__storeV(&a, x, sc8__rax);
+                break;
+            case sc8__kindLDDT: case sc8__kindLDST:
+                sc8__flushTicks(&a, &pending);
+                sc8__loadV(&a, sc8__rax, x);
+                sc8__b(&a, 0x88);
+                sc8__mem(&a, sc8__rax, (kinds[k] == sc8__kindLDDT) ? offsetof(sc8_state, dt) : offsetof(sc8_state, st));
+                break;
+            default:
+                // CLS, RND, Fx33, Fx55 and Fx65 go through the interpreter's handlers
+                sc8__spill(&a);
+                sc8__setPc(&a, at);
+                sc8__call(&a, (const void *)sc8__jitExecute, opcode | (uint32_t)(count - k) << 16);
+                sc8__reload(&a);
+                break;
+        }
+        pending++;
+    }
+
+    // CALL with the stack full, RET with it empty and SKP/SKNP on a Vx over F are left to
+    // the interpreter, which logs them: bail out right before the branch then, see below
+    uint8_t *bail = NULL;
+    const uint32_t straightTicks = pending;
+    if(branches) {
+        if(last == sc8__kindCALL || last == sc8__kindRET) {
+            sc8__b(&a, 0x80); sc8__mem(&a, 7, offsetof(sc8_state, sp));   // cmp byte [sp], 16 or 0
+            sc8__b(&a, (last == sc8__kindCALL) ? 16 : 0);
+            bail = sc8__jump(&a, (last == sc8__kindCALL) ? sc8__JAE : sc8__JE);
+        } else if(last == sc8__kindSKP || last == sc8__kindSKNP) {
+            sc8__loadV(&a, sc8__rax, SC8_Vx(opcodes[count - 1]));
+            sc8__aluImm(&a, sc8__CMP, 0xF);
+            bail = sc8__jump(&a, sc8__JA);
+        }
+    }
+
+    // Wrap up before the branch: none of them touch the timers or VF liveness past the block.
+    if(branches) {
+        pending++;
+    }
+    sc8__flushTicks(&a, &pending);
+    sc8__b(&a, 0x66); sc8__b(&a, 0xC7); sc8__mem(&a, 0, offsetof(sc8_state, opcode));
+    sc8__w(&a, opcodes[count - 1]);
+    sc8__spill(&a);
+
+    uint8_t *returns[2];
+    int nreturns = 0;
+    const uint32_t firstLink = jit->links;
+    const uint16_t opcode = opcodes[count - 1];
+    const int x = SC8_Vx(opcode), y = SC8_Vy(opcode);
+    const uint16_t nnn = SC8_NNN(opcode);
+    uint8_t skip = 0;
+    if(last == sc8__kindLDB || last == sc8__kindSTORE) {
+        // back to `sc8_jitRun` rather than on to the next block, which the write may have
+        // dropped without the jumps into it unlinked yet
+        sc8__setPc(&a, at);
+        returns[nreturns++] = sc8__jump(&a, sc8__JMP);
+    } else if(!branches) {
+        sc8__exit(jit, &a, at, returns, &nreturns);
+    } else switch(last) {
+        case sc8__kindJP:
+            sc8__exit(jit, &a, nnn, returns, &nreturns);
+            break;
+        case sc8__kindCALL:
+            // stack[sp++] = pc
+            sc8__b(&a, 0x0F); sc8__b(&a, 0xB6); sc8__mem(&a, sc8__rax, offsetof(sc8_state, sp));
+            sc8__b(&a, 0x66); sc8__b(&a, 0xC7); sc8__memIndexed2(&a, 0, offsetof(sc8_state, stack));
+            sc8__w(&a, at);
+            sc8__b(&a, 0xFE); sc8__mem(&a, 0, offsetof(sc8_state, sp));          // inc byte [sp]
+            sc8__exit(jit, &a, nnn, returns, &nreturns);
+            break;
+        case sc8__kindRET:
+            // pc = stack[--sp] + 2
+            sc8__b(&a, 0xFE); sc8__mem(&a, 1, offsetof(sc8_state, sp));          // dec byte [sp]
+            sc8__b(&a, 0x0F); sc8__b(&a, 0xB6); sc8__mem(&a, sc8__rax, offsetof(sc8_state, sp));
+            sc8__b(&a, 0x0F); sc8__b(&a, 0xB7); sc8__memIndexed2(&a, sc8__rcx, offsetof(sc8_state, stack));
+            sc8__b(&a, 0x83); sc8__b(&a, 0xC1); sc8__b(&a, 0x02);                // add ecx, 2
+            sc8__b(&a, 0x66); sc8__b(&a, 0x89); sc8__mem(&a, sc8__rcx, offsetof(sc8_state, pc));
+            break;
+        case sc8__kindJPV0:
+            sc8__loadV(&a, sc8__rax, 0);
+            sc8__aluImm(&a, sc8__ADD, nnn);
+            sc8__b(&a, 0x66); sc8__b(&a, 0x89); sc8__mem(&a, sc8__rax, offsetof(sc8_state, pc));
+            break;
+        case sc8__kindSEi: case sc8__kindSNEi:
+            sc8__loadV(&a, sc8__rax, x);
+            sc8__aluImm(&a, sc8__CMP, SC8_KK(opcode));
+            skip = (last == sc8__kindSEi) ? sc8__JE : sc8__JNE;
+            break;
+        case sc8__kindSE: case sc8__kindSNE:
+            sc8__loadV(&a, sc8__rax, x);
+            sc8__loadV(&a, sc8__rcx, y);
+            sc8__b(&a, 0x39); sc8__b(&a, 0xC8);                                  // cmp eax, ecx
+            skip = (last == sc8__kindSE) ? sc8__JE : sc8__JNE;
+            break;
+        case sc8__kindSKP: case sc8__kindSKNP:
+            sc8__loadV(&a, sc8__rax, x);
+            sc8__b(&a, 0x0F); sc8__b(&a, 0xB6); sc8__memIndexed(&a, sc8__rax, offsetof(sc8_state, key));
+            sc8__b(&a, 0x85); sc8__b(&a, 0xC0);                                  // test eax, eax
+            skip = (last == sc8__kindSKP) ? sc8__JNE : sc8__JE;
+            break;
+    }
+    if(skip != 0) {
+        uint8_t *skipped = sc8__jump(&a, skip);
+        sc8__exit(jit, &a, at + 2, returns, &nreturns);
+        sc8__land(&a, skipped);
+        sc8__exit(jit, &a, at + 4, returns, &nreturns);
+    }
+
+    // return path: eax = budget left
+    const uint32_t fallback = (uint32_t)(a.at - jit->buffer);
+    for(int r = 0; r < nreturns; r++) {
+        sc8__land(&a, returns[r]);
+    }
+    sc8__b(&a, 0x8B); sc8__b(&a, 0x04); sc8__b(&a, 0x24);                   // mov eax, [rsp]
+    sc8__b(&a, 0x48); sc8__b(&a, 0x83); sc8__b(&a, 0xC4); sc8__b(&a, 0x08); // add rsp, 8
+    sc8__b(&a, 0x41); sc8__b(&a, 0x5F); sc8__b(&a, 0x41); sc8__b(&a, 0x5E);
+    sc8__b(&a, 0x41); sc8__b(&a, 0x5D); sc8__b(&a, 0x41); sc8__b(&a, 0x5C);
+    sc8__b(&a, 0x5D); sc8__b(&a, 0x5B);
+    sc8__b(&a, 0xC3);
+
+    // not enough budget left for this block: give it back and return, pc already points here
+    sc8__land(&a, overBudget);
+    sc8__b(&a, 0x81); sc8__b(&a, 0x04); sc8__b(&a, 0x24); sc8__d(&a, (uint32_t)count); // add dword [rsp], count
+    uint8_t *back = sc8__jump(&a, sc8__JMP);
+    uint32_t rel = (uint32_t)((jit->buffer + fallback) - (back + 4));
+    memcpy(back, &rel, 4);
+
+    // bailing out: the instructions before the branch ran, the branch itself didn't, so it
+    // gets its budget and cycle back and pc stays on it for the interpreter to run
+    if(bail != NULL) {
+        sc8__land(&a, bail);
+        uint32_t ticks = straightTicks;
+        sc8__flushTicks(&a, &ticks);
+        sc8__spill(&a);
+        sc8__setPc(&a, at);
+        sc8__b(&a, 0x83); sc8__b(&a, 0x04); sc8__b(&a, 0x24); sc8__b(&a, 0x01);  // add dword [rsp], 1
+        sc8__b(&a, 0x48); sc8__b(&a, 0x83); sc8__mem(&a, 5, offsetof(sc8_state, cycles)); sc8__b(&a, 0x01); // sub qword [cycles], 1
+        back = sc8__jump(&a, sc8__JMP);
+        rel = (uint32_t)((jit->buffer + fallback) - (back + 4));
+        memcpy(back, &rel, 4);
+    }
+
+    jit->used += (size_t)(a.at - start);
+    jit->code[pc] = (sc8_jitBlock)(void *)start;
+    jit->len[pc] = (uint8_t)count;
+    jit->codePages |= sc8__pageMask(pc, pc + 2 * count - 1);
+
+    // link this block's exits, and every exit that was waiting for this block
+    for(uint32_t l = firstLink; l < jit->links; l++) {
+        jit->link[l].fallback = fallback;
+        if(jit->code[jit->link[l].target] != NULL) {
+            sc8__jitPatch(jit, &jit->link[l], true);
+        }
+    }
+    for(uint32_t l = 0; l < firstLink; l++) {
+        if(jit->link[l].target == pc) {
+            sc8__jitPatch(jit, &jit->link[l], true);
+        }
+    }
+
+    if(!sc8__jitProtect(jit, false)) {
+        sc8__jitBreak(jit);
+        return false;
+    }
+    return true;
+}
+
+bool sc8_jitInit(sc8_jit *jit) {
+    memset(jit, 0, sizeof(*jit));
+    void *buffer = mmap(NULL, SC8_JIT_CODE_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(buffer == MAP_FAILED) {
+        return false;
+    }
+    jit->buffer = (uint8_t *)buffer;
+    return true;
+}
+
+void sc8_jitFree(sc8_jit *jit) {
+    if(jit->buffer != NULL) {
+        munmap(jit->buffer, SC8_JIT_CODE_SIZE);
+    }
+    memset(jit, 0, sizeof(*jit));
+}
+
+#else // SC8__JIT_X64
+
+static bool sc8__jitCompile(sc8_jit *jit, const sc8_state *state, uint16_t pc) {
+    (void)jit; (void)state; (void)pc;
+    return false;
+}
+
+static bool sc8__jitUnlinkDropped(sc8_jit *jit) {
+    jit->unlink = false;
+    return true;
+}
+
+bool sc8_jitInit(sc8_jit *jit) {
+    memset(jit, 0, sizeof(*jit));
+    return false;
+}
+
+void sc8_jitFree(sc8_jit *jit) {
+    memset(jit, 0, sizeof(*jit));
+}
+
+#endif // SC8__JIT_X64
+
+uint32_t sc8_jitRun(sc8_state *state, uint32_t count) {
+    sc8_jit *jit = state->jit;
+    if(jit == NULL || jit->buffer == NULL || jit->broken) {
+        return sc8_stepMany(state, count);
+    }
+
+    state->wait = sc8_wait_None;
+    uint32_t done = 0;
+    uint32_t keysDue = 0;
+    while(done < count) {
+        if(done == keysDue) {
+            keysDue = sc8__applyKeys(state, done, count);
+        }
+        if(jit->unlink && !sc8__jitUnlinkDropped(jit)) {
+            return done + sc8_stepMany(state, count - done);
+        }
+        const uint16_t pc = state->pc;
+        if(pc < MEMORY_SIZE - 1) {
+            // tried once, whatever came of it, until something writes there
+            if(jit->code[pc] == NULL && jit->heat[pc] < SC8_JIT_HOT && ++jit->heat[pc] == SC8_JIT_HOT &&
+               !sc8__jitCompile(jit, state, pc) && jit->broken) {
+                return done + sc8_stepMany(state, count - done);
+            }
+            // translated code only gets as far as the next key event
+            if(jit->code[pc] != NULL && jit->len[pc] <= keysDue - done) {
+                const uint32_t left = jit->code[pc](state, keysDue - done);
+                if(left != keysDue - done) {
+                    done = keysDue - left;
+                    continue;
+                }
+                // it bailed out on its first instruction, that one is the interpreter's
+            }
+        }
+
+        if(!sc8__step(state)) {
+            done += state->wait == sc8_wait_None; // waiting on Fx0A or F0FF doesn't count
+            break;
+        }
+        done++;
+    }
+    return done;
+}
+#endif // SC8_JIT
+
+#undef SC8_IMPLEMENTATION
+#endif // SC8_IMPLEMENTATION
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
 #endif // SMALL_CHIP_8_HEADER
\ No newline at end of file
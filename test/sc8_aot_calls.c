@@ -0,0 +1,248 @@
+// Generated by tools/sc8_aot.c from test/sc8_aot_calls.ch8, don't edit.
+// #include it right after smallCHIP-8.h.
+
+static const uint8_t sc8aot_calls_rom[774] = {
+    0x60, 0x00, 0x61, 0x00, 0x23, 0x00, 0x24, 0x00, 0x71, 0x01, 0x31, 0x10, 0x12, 0x04, 0x25, 0x00,
+    0x62, 0x00, 0x00, 0xEE, 0x12, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x70, 0x01, 0x24, 0x00, 0x80, 0x14, 0x00, 0xEE, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x70, 0x03, 0xF0, 0x29, 0xD0, 0x15, 0x00, 0xEE, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x72, 0x01, 0x25, 0x00, 0x00, 0xEE,
+};
+
+static const uint16_t sc8aot_calls_code[][2] = {
+    { 0x200, 0x214 },
+    { 0x300, 0x308 },
+    { 0x400, 0x408 },
+    { 0x500, 0x506 },
+};
+
+static inline bool sc8aot_calls_intact(const sc8_state *state) {
+    for(size_t r = 0; r < 4; r++) {
+        const uint16_t from = sc8aot_calls_code[r][0], to = sc8aot_calls_code[r][1];
+        if(memcmp(state->memory + from, sc8aot_calls_rom + (from - 0x200), to - from) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline bool sc8aot_calls_overwrites(uint16_t addr, size_t len) {
+    for(size_t r = 0; r < 4; r++) {
+        if(addr < sc8aot_calls_code[r][1] && addr + len > sc8aot_calls_code[r][0]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#define SC8AOT_STEP(name, op)        \
+    if(done == count) {              \
+        return done;                 \
+    }                                \
+    state->opcode = op;              \
+    sc8__op##name(state, op);        \
+    sc8__tickTimers(state);          \
+    state->cycles++;                 \
+    done++;
+
+#define SC8AOT_TRY(name, op)         \
+    if(done == count) {              \
+        return done;                 \
+    }                                \
+    state->opcode = op;              \
+    if(!sc8__op##name(state, op)) {  \
+        sc8__tickTimers(state);      \
+        *ok = false;                 \
+        if(state->wait != sc8_wait_None) { \
+            return done;             \
+        }                            \
+        state->cycles++;             \
+        return done + 1;             \
+    }                                \
+    sc8__tickTimers(state);          \
+    state->cycles++;                 \
+    done++;
+
+static uint32_t sc8aot_calls_exec(sc8_state *state, uint32_t count, bool *ok) {
+    if(!sc8aot_calls_intact(state)) {
+        return sc8__run(state, count, ok);
+    }
+    uint32_t done = 0;
+    *ok = true;
+
+dispatch:
+    switch(state->pc) {
+        case 0x200: goto at200;
+        case 0x202: goto at202;
+        case 0x204: goto at204;
+        case 0x206: goto at206;
+        case 0x208: goto at208;
+        case 0x20A: goto at20A;
+        case 0x20C: goto at20C;
+        case 0x20E: goto at20E;
+        case 0x210: goto at210;
+        case 0x212: goto at212;
+        case 0x300: goto at300;
+        case 0x302: goto at302;
+        case 0x304: goto at304;
+        case 0x306: goto at306;
+        case 0x400: goto at400;
+        case 0x402: goto at402;
+        case 0x404: goto at404;
+        case 0x406: goto at406;
+        case 0x500: goto at500;
+        case 0x502: goto at502;
+        case 0x504: goto at504;
+    }
+    // not translated, interpret a single instruction
+    if(done == count) {
+        return done;
+    }
+    {
+        const uint16_t opcode = sc8__fetch(state);
+        const uint8_t kind = sc8__decode(opcode);
+        const uint16_t i = state->i;
+        done += sc8__run(state, 1, ok);
+        if(!*ok) {
+            return done;
+        }
+        if((kind == sc8__kindLDB && sc8aot_calls_overwrites(i & (MEMORY_SIZE - 1), 3)) ||
+           (kind == sc8__kindSTORE && sc8aot_calls_overwrites(i & (MEMORY_SIZE - 1), SC8_Vx(opcode)))) {
+            return done + sc8__run(state, count - done, ok);
+        }
+    }
+    goto dispatch;
+
+ret:
+    switch(state->pc) {
+        case 0x206: goto at206;
+        case 0x208: goto at208;
+        case 0x210: goto at210;
+        case 0x304: goto at304;
+        case 0x504: goto at504;
+    }
+    goto dispatch;
+
+at200:
+    SC8AOT_STEP(LDi, 0x6000)
+    goto at202;
+at202:
+    SC8AOT_STEP(LDi, 0x6100)
+    goto at204;
+at204:
+    SC8AOT_TRY(CALL, 0x2300)
+    goto at300;
+at206:
+    SC8AOT_TRY(CALL, 0x2400)
+    goto at400;
+at208:
+    SC8AOT_STEP(ADDi, 0x7101)
+    goto at20A;
+at20A:
+    SC8AOT_STEP(SEi, 0x3110)
+    if(state->pc == 0x20E) { goto at20E; }
+    goto at20C;
+at20C:
+    SC8AOT_STEP(JP, 0x1204)
+    goto at204;
+at20E:
+    SC8AOT_TRY(CALL, 0x2500)
+    goto at500;
+at210:
+    SC8AOT_STEP(LDi, 0x6200)
+    goto at212;
+at212:
+    SC8AOT_TRY(RET, 0x00EE)
+    goto ret;
+at300:
+    SC8AOT_STEP(ADDi, 0x7001)
+    goto at302;
+at302:
+    SC8AOT_TRY(CALL, 0x2400)
+    goto at400;
+at304:
+    SC8AOT_STEP(ADD, 0x8014)
+    goto at306;
+at306:
+    SC8AOT_TRY(RET, 0x00EE)
+    goto ret;
+at400:
+    SC8AOT_STEP(ADDi, 0x7003)
+    goto at402;
+at402:
+    SC8AOT_STEP(LDF, 0xF029)
+    goto at404;
+at404:
+    SC8AOT_STEP(DRW, 0xD015)
+    goto at406;
+at406:
+    SC8AOT_TRY(RET, 0x00EE)
+    goto ret;
+at500:
+    SC8AOT_STEP(ADDi, 0x7201)
+    goto at502;
+at502:
+    SC8AOT_TRY(CALL, 0x2500)
+    goto at500;
+at504:
+    SC8AOT_TRY(RET, 0x00EE)
+    goto ret;
+}
+
+#undef SC8AOT_TRY
+#undef SC8AOT_STEP
+
+uint32_t sc8aot_calls_run(sc8_state *state, uint32_t count) {
+    state->wait = sc8_wait_None;
+    uint32_t done = 0;
+    bool ok = true;
+    while(ok && done < count) {
+        const uint32_t until = sc8__applyKeys(state, done, count);
+        done += sc8aot_calls_exec(state, until - done, &ok);
+    }
+    return done;
+}
@@ -1,153 +1,699 @@
-#include <stdlib.h>
-
-#define SC8_USE_STDIO
-#define SC8_IMPLEMENTATION
-#include "../smallCHIP-8.h"
-
-#define SDL_MAIN_HANDLED
-#include "SDL3/SDL.h"
-
-#ifdef _WIN32
-#include <windows.h>
-#endif
-
-sc8_state state; // OH NO EVIL GLOBAL STATTE NONONONONO YOU CAN"T NOT DO THAT NOOOOOOOOOOOOOOOOOOOOOOOOOOOOO
-bool quit;
-
-// Map SDL_Keycode to CHIP-8 key index (example mapping)
-static int mapKey(SDL_Keycode key) {
-    switch (key) {
-        case SDLK_1: return 0x1;
-        case SDLK_2: return 0x2;
-        case SDLK_3: return 0x3;
-        case SDLK_4: return 0xC;
-        case SDLK_Q: return 0x4;
-        case SDLK_W: return 0x5;
-        case SDLK_E: return 0x6;
-        case SDLK_R: return 0xD;
-        case SDLK_A: return 0x7;
-        case SDLK_S: return 0x8;
-        case SDLK_D: return 0x9;
-        case SDLK_F: return 0xE;
-        case SDLK_Z: return 0xA;
-        case SDLK_X: return 0x0;
-        case SDLK_C: return 0xB;
-        case SDLK_V: return 0xF;
-        default:     return -1; // Not a CHIP-8 key
-    }
-}
-
-void sc8_updateKeyArray(sc8_state *state) {
-    SDL_Event events[16];
-    int num = SDL_PeepEvents(events, 16, SDL_PEEKEVENT, SDL_EVENT_KEY_DOWN, SDL_EVENT_KEY_UP);
-
-    for(int i = 0; i < num; i++) {
-        SDL_Event event = events[16];
-        int key = mapKey(event.key.key);
-        if(key >= 0 && key <= 16) {
-            state->key[key] = event.type == SDL_EVENT_KEY_DOWN;
-        }
-    }
-}
-
-static SDL_AudioStream *beep_stream = NULL;
-#define BEEP_FREQ 440
-void sc8_beep(void) {
-    static int sine_sample = 0;
-
-    static float samples[725]; // I found 725 to be a sweet spot
-    for(size_t i = 0; i < SDL_arraysize(samples); i++) {
-        const float phase = sine_sample * BEEP_FREQ / 8000.0f;
-        samples[i] = SDL_sinf(phase * 2 * SDL_PI_F);
-        sine_sample++;
-    }
-
-    sine_sample %= 8000;
-
-    SDL_PutAudioStreamData(beep_stream, samples, sizeof(samples));
-}
-#undef BEEP_FREQ
-
-#define PIXEL_SCALE 10
-int main(int argc, char **argv) {
-    if(argc != 2) {
-        fprintf(stderr, "Expected usage: %s <ROM file path>\n", argv[0]);
-        return 1;
-    }
-
-    sc8_init(&state);
-    int err = sc8_loadFile(&state, argv[1]);
-    if(err != sc8_loadFile_OK) {
-        fprintf(stderr, "Error loading file, code: %d\n", err);
-        return err;
-    }
-
-    if(!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_EVENTS)) {
-        fprintf(stderr, "SDL_Init has failed: %s", SDL_GetError());
-        return 1;  
-    }
-
-    SDL_Window *w = SDL_CreateWindow("CHIP-8", SC8_W * PIXEL_SCALE, SC8_H * PIXEL_SCALE, 0);
-    if(w == NULL) {
-        SDL_Log("Error at creating window: %s", SDL_GetError());
-        return 1;
-    }
-    SDL_Renderer *r = SDL_CreateRenderer(w, NULL);
-    if(r == NULL) {
-        SDL_Log("Error creating renderer: %s", SDL_GetError());
-        return 1;
-    }
-
-    SDL_AudioSpec beep_stream_spec;
-    beep_stream_spec.channels = 1;
-    beep_stream_spec.format = SDL_AUDIO_F32;
-    beep_stream_spec.freq = 8000;
-    beep_stream = SDL_OpenAudioDeviceStream(
-        SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK,
-        &beep_stream_spec, NULL, NULL
-    );
-    if(beep_stream == NULL) {
-        SDL_Log("Failed to create beep audio stream: %s", SDL_GetError());
-        return 1;
-    }
-    SDL_ResumeAudioStreamDevice(beep_stream);
-
-    quit = false;
-    while(!quit) {
-        sc8_step(&state);
-
-        SDL_Event event;
-        while(SDL_PollEvent(&event)) {
-            if(event.type == SDL_EVENT_QUIT)
-                quit = true;
-        }
-
-        if(state.drawFlag) {
-            SDL_SetRenderDrawColor(r, 0x18, 0x18, 0x18, 255);
-            SDL_RenderClear(r);
-            
-            SDL_SetRenderDrawColor(r, 90, 255, 90, 255);
-            for(int y = 0; y < SC8_H; y++) {
-                for(int x = 0; x < SC8_W; x++) {
-                    if(state.gfx[y * SC8_W + x]) {
-                        SDL_FRect rect = {
-                            x * PIXEL_SCALE, y * PIXEL_SCALE,
-                            PIXEL_SCALE, PIXEL_SCALE
-                        };
-                        SDL_RenderFillRect(r, &rect);
-                    }
-                }
-            }
-            state.drawFlag = false;
-            SDL_RenderPresent(r);
-        }
-
-        SDL_Delay(64);
-    }
-
-    SDL_DestroyWindow(w);
-    SDL_DestroyRenderer(r);
-    SDL_Quit();
-
-    return 0;
-}
+#include <stdlib.h>
+
+#define SC8_USE_STDIO
+#define SC8_IMPLEMENTATION
+#include "../smallCHIP-8.h"
+
+#define SDL_MAIN_HANDLED
+#include "SDL3/SDL.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+sc8_state state; // OH NO EVIL GLOBAL STATTE NONONONONO YOU CAN"T NOT DO THAT NOOOOOOOOOOOOOOOOOOOOOOOOOOOOO
+bool quit;
+
+// Map SDL_Keycode to CHIP-8 key index (example mapping)
+static int mapKey(SDL_Keycode key) {
+    switch (key) {
+        case SDLK_1: return 0x1;
+        case SDLK_2: return 0x2;
+        case SDLK_3: return 0x3;
+        case SDLK_4: return 0xC;
+        case SDLK_Q: return 0x4;
+        case SDLK_W: return 0x5;
+        case SDLK_E: return 0x6;
+        case SDLK_R: return 0xD;
+        case SDLK_A: return 0x7;
+        case SDLK_S: return 0x8;
+        case SDLK_D: return 0x9;
+        case SDLK_F: return 0xE;
+        case SDLK_Z: return 0xA;
+        case SDLK_X: return 0x0;
+        case SDLK_C: return 0xB;
+        case SDLK_V: return 0xF;
+        default:     return -1; // Not a CHIP-8 key
+    }
+}
+
+// Straight into the core's key queue, the emulation (whichever thread it's on) applies them.
+static SDL_AtomicInt playing; // a movie has the keyboard
+static void handleKeyEvent(const SDL_Event *event) {
+    const int key = mapKey(event->key.key);
+    if(key < 0 || event->key.repeat || SDL_GetAtomicInt(&playing)) {
+        return;
+    }
+    if(event->type == SDL_EVENT_KEY_DOWN) {
+        sc8_keyDown(&state, key, 0);
+    } else {
+        sc8_keyUp(&state, key, 0);
+    }
+}
+
+// Audio: the sound timer flips `beep_on` as it ticks, the tone itself is made in the audio
+// device's callback from a wavetable, so the emulation never does any audio work and no more
+// than what the device asks for (at most AUDIO_LATENCY_MS of it) is ever queued.
+#define AUDIO_FREQ 48000
+#define AUDIO_LATENCY_MS 5
+#define AUDIO_FRAMES (AUDIO_FREQ * AUDIO_LATENCY_MS / 1000)
+#define BEEP_FREQ 440
+#define BEEP_VOLUME 0.25f
+#define BEEP_RAMP (AUDIO_FREQ / 1000) // samples to fade in/out over, so gating doesn't click
+#define WAVETABLE_BITS 8
+static float wavetable[1 << WAVETABLE_BITS];
+static SDL_AtomicInt beep_on;
+static bool running_ahead; // run-ahead frames don't get heard
+
+// Called on every tick of a running sound timer, before it counts down: the tick that takes
+// it to 0 is the one that stops the tone.
+void sc8_beep(void) {
+    if(!running_ahead) {
+        SDL_SetAtomicInt(&beep_on, state.st > 1);
+    }
+}
+
+static void buildWavetable(void) {
+    for(size_t i = 0; i < SDL_arraysize(wavetable); i++) {
+        wavetable[i] = SDL_sinf(i * 2 * SDL_PI_F / SDL_arraysize(wavetable));
+    }
+}
+
+static void SDLCALL generateBeep(void *userdata, SDL_AudioStream *stream, int additional_amount, int total_amount) {
+    (void)userdata;
+    (void)total_amount;
+    // phase in 0.32 fixed point, its top bits index the wavetable
+    static Uint32 phase = 0;
+    static float gain = 0;
+    const Uint32 step = (Uint32)(((Uint64)BEEP_FREQ << 32) / AUDIO_FREQ);
+    const float target = SDL_GetAtomicInt(&beep_on) ? BEEP_VOLUME : 0;
+
+    float samples[AUDIO_FRAMES];
+    int frames = additional_amount / (int)sizeof(float);
+    while(frames > 0) {
+        const int count = SDL_min(frames, (int)SDL_arraysize(samples));
+        for(int i = 0; i < count; i++) {
+            if(gain < target) {
+                gain = SDL_min(gain + BEEP_VOLUME / BEEP_RAMP, target);
+            } else if(gain > target) {
+                gain = SDL_max(gain - BEEP_VOLUME / BEEP_RAMP, target);
+            }
+            samples[i] = wavetable[phase >> (32 - WAVETABLE_BITS)] * gain;
+            phase += step;
+        }
+        SDL_PutAudioStreamData(stream, samples, count * (int)sizeof(float));
+        frames -= count;
+    }
+}
+
+// Screen texture: the framebuffer gets expanded to XRGB8888 here a byte (8 pixels) at a time
+// through `pixel_lut` and only the rows that changed are uploaded, then the whole thing is
+// scaled up in one SDL_RenderTexture.
+#define COLOR_OFF 0xFF181818
+#define COLOR_ON  0xFF5AFF5A
+static Uint32 pixel_lut[256][8];
+static Uint32 screen_pixels[SC8_H][SC8_W];
+
+static void buildPixelLut(void) {
+    for(int byte = 0; byte < 256; byte++) {
+        for(int bit = 0; bit < 8; bit++) {
+            pixel_lut[byte][bit] = (byte & (0x80 >> bit)) ? COLOR_ON : COLOR_OFF;
+        }
+    }
+}
+
+static void uploadRows(SDL_Texture *screen, const uint64_t *gfx, uint32_t rows) {
+    for(int y = 0; y < SC8_H;) {
+        if(!(rows >> y & 1)) {
+            y++;
+            continue;
+        }
+
+        // expand a run of changed rows and send it in one go
+        int end = y;
+        for(; end < SC8_H && (rows >> end & 1); end++) {
+            for(int byte = 0; byte < SC8_W / 8; byte++) {
+                const uint8_t bits = gfx[end] >> (SC8_W - 8 - 8 * byte);
+                SDL_memcpy(&screen_pixels[end][8 * byte], pixel_lut[bits], sizeof(pixel_lut[bits]));
+            }
+        }
+        const SDL_Rect rect = { 0, y, SC8_W, end - y };
+        SDL_UpdateTexture(screen, &rect, screen_pixels[y], sizeof(screen_pixels[0]));
+        y = end;
+    }
+}
+
+// Frame pacing: emulated frames are due every FRAME_NS on the SDL_GetTicksNS clock.
+// When the host falls behind, up to MAX_CATCH_UP frames are emulated back to back and only
+// the last one gets drawn, past that the backlog is dropped. Waiting sleeps until SPIN_NS
+// before the deadline and spins the rest, sleeps alone are too coarse.
+#define FRAME_NS (SDL_NS_PER_SECOND / 60)
+#define MAX_CATCH_UP 4
+#define SPIN_NS (2 * SDL_NS_PER_MS)
+
+static void waitUntil(Uint64 deadline) {
+    for(;;) {
+        const Uint64 now = SDL_GetTicksNS();
+        if(now >= deadline) {
+            return;
+        }
+        if(deadline - now > SPIN_NS) {
+            SDL_DelayNS(deadline - now - SPIN_NS);
+        } else {
+            SDL_CPUPauseInstruction();
+        }
+    }
+}
+
+// Save states: F5 saves to `<ROM file>.state`, F9 loads it back and `--autosave=SECONDS`
+// saves every so often. They're taken between frames on whichever thread runs the
+// emulation, and written through SDL's async I/O so the frame loop never waits on the disk.
+#define STATE_SAVE 1
+#define STATE_LOAD 2
+static uint8_t *rom;
+static size_t rom_size;
+static char *state_path;
+static SDL_AtomicInt state_request;
+static SDL_AsyncIOQueue *save_queue;
+static uint8_t save_buffer[SC8_STATE_MAX];
+static bool saving; // save_buffer is still being written out
+static uint64_t autosave_frames; // 0 when off
+static uint64_t last_save;
+
+static void finishSaves(bool wait) {
+    SDL_AsyncIOOutcome outcome;
+    while(saving && (wait ? SDL_WaitAsyncIOResult(save_queue, &outcome, -1) : SDL_GetAsyncIOResult(save_queue, &outcome))) {
+        if(outcome.result != SDL_ASYNCIO_COMPLETE) {
+            SDL_Log("Failed to write %s", state_path);
+        }
+        if(outcome.type == SDL_ASYNCIO_TASK_CLOSE) {
+            saving = false;
+        }
+    }
+}
+
+static void saveState(void) {
+    last_save = state.frames;
+    if(saving) {
+        SDL_Log("Still writing the last save state, skipping this one");
+        return;
+    }
+    const size_t size = sc8_saveState(&state, rom, rom_size, save_buffer, sizeof(save_buffer));
+    SDL_AsyncIO *file = SDL_AsyncIOFromFile(state_path, "w");
+    if(file == NULL) {
+        SDL_Log("Failed to open %s: %s", state_path, SDL_GetError());
+        return;
+    }
+    SDL_WriteAsyncIO(file, save_buffer, 0, size, save_queue, NULL);
+    SDL_CloseAsyncIO(file, true, save_queue, NULL);
+    saving = true;
+}
+
+static void loadState(void) {
+    size_t size;
+    void *image = SDL_LoadFile(state_path, &size);
+    if(image == NULL) {
+        SDL_Log("Failed to read %s: %s", state_path, SDL_GetError());
+        return;
+    }
+    const sc8_LoadStateResult result = sc8_loadState(&state, rom, rom_size, image, size);
+    if(result != sc8_loadState_OK) {
+        SDL_Log("Failed to load %s, code: %d", state_path, result);
+    }
+    SDL_free(image);
+}
+
+static void serviceStates(void) {
+    finishSaves(false);
+    const int request = SDL_SetAtomicInt(&state_request, 0);
+    if(request == STATE_LOAD) {
+        loadState();
+    }
+    if(request == STATE_SAVE || (autosave_frames != 0 && state.frames - last_save >= autosave_frames)) {
+        saveState();
+    }
+}
+
+// Rewind: every frame goes into `history`, holding Backspace steps back through them one
+// frame at a time instead of running.
+#define REWIND_BUDGET (8 << 20) // ~10 minutes for most games
+static sc8_rewind history;
+static SDL_AtomicInt rewinding;
+
+// Movies: `--record=FILE` logs every key event and the state hash after every frame, with a
+// save state every MOVIE_KEYFRAME_EVERY frames, and writes it all to FILE on quit.
+// `--play=FILE` plays one back instead of taking input from the keyboard and logs the first
+// frame that doesn't come out the same. Rewinding and loading states are off for both.
+#define MOVIE_KEYFRAME_EVERY 600 // 10 seconds
+static char *record_path;
+static sc8_keyEvent logged[256];
+static sc8_keyLog key_log = { logged, 0, sizeof(logged) / sizeof(logged[0]), false };
+static sc8_movieInfo recorded;
+static sc8_keyEvent *recorded_events;
+static uint64_t *recorded_hashes;
+static sc8_movieKeyframe *recorded_keyframes;
+static uint32_t events_capacity;
+static uint64_t hashes_capacity;
+static sc8_movie movie;
+static void *movie_data;
+
+static void startRecording(int instructions_per_frame) {
+    sc8_attachKeyLog(&state, &key_log);
+    recorded.randState = state.xorRandState;
+    recorded.instructionsPerFrame = instructions_per_frame;
+    recorded.keyframeEvery = MOVIE_KEYFRAME_EVERY;
+    recorded.firstFrame = state.frames;
+}
+
+// Called before every frame.
+static void recordKeyframe(void) {
+    if(recorded.frames % MOVIE_KEYFRAME_EVERY != 0) {
+        return;
+    }
+    uint8_t *image = SDL_malloc(SC8_STATE_MAX);
+    sc8_movieKeyframe *keyframes = SDL_realloc(recorded_keyframes, (recorded.keyframes + 1) * sizeof(*keyframes));
+    if(image == NULL || keyframes == NULL) {
+        SDL_free(image);
+        return; // the frames after it will be missing from the movie
+    }
+    recorded_keyframes = keyframes;
+    sc8_movieKeyframe *key = &recorded_keyframes[recorded.keyframes++];
+    key->size = sc8_saveState(&state, rom, rom_size, image, SC8_STATE_MAX);
+    key->image = image;
+    key->firstEvent = recorded.events;
+}
+
+// Called after every frame.
+static void recordFrame(void) {
+    if(recorded.frames >= (uint64_t)recorded.keyframes * MOVIE_KEYFRAME_EVERY) {
+        return; // ran out of memory earlier
+    }
+    if(key_log.overflow) {
+        SDL_Log("Lost key events, the movie won't play back right from frame %llu on", (unsigned long long)recorded.frames);
+        key_log.overflow = false;
+    }
+    if(recorded.events + key_log.count > events_capacity) {
+        const uint32_t capacity = (events_capacity + key_log.count) * 2;
+        sc8_keyEvent *events = SDL_realloc(recorded_events, capacity * sizeof(*events));
+        if(events == NULL) {
+            return;
+        }
+        recorded_events = events;
+        events_capacity = capacity;
+    }
+    if(recorded.frames == hashes_capacity) {
+        const uint64_t capacity = SDL_max(hashes_capacity * 2, MOVIE_KEYFRAME_EVERY);
+        uint64_t *hashes = SDL_realloc(recorded_hashes, capacity * sizeof(*hashes));
+        if(hashes == NULL) {
+            return;
+        }
+        recorded_hashes = hashes;
+        hashes_capacity = capacity;
+    }
+    SDL_memcpy(recorded_events + recorded.events, key_log.events, key_log.count * sizeof(*recorded_events));
+    recorded.events += key_log.count;
+    key_log.count = 0;
+    recorded_hashes[recorded.frames++] = sc8_stateHash(&state);
+}
+
+static void saveMovie(void) {
+    // drop the keyframe nothing got recorded after
+    recorded.keyframes = SDL_min(recorded.keyframes, (recorded.frames + MOVIE_KEYFRAME_EVERY - 1) / MOVIE_KEYFRAME_EVERY);
+    if(recorded.keyframes == 0) {
+        return;
+    }
+    const size_t size = sc8_movieWrite(NULL, 0, &recorded, rom, rom_size, recorded_events, recorded_hashes, recorded_keyframes);
+    uint8_t *data = SDL_malloc(size);
+    if(data == NULL || sc8_movieWrite(data, size, &recorded, rom, rom_size, recorded_events, recorded_hashes, recorded_keyframes) == 0 ||
+       !SDL_SaveFile(record_path, data, size)) {
+        SDL_Log("Failed to write %s: %s", record_path, SDL_GetError());
+    } else {
+        SDL_Log("Recorded %llu frames to %s", (unsigned long long)recorded.frames, record_path);
+    }
+    SDL_free(data);
+}
+
+static void freeMovies(void) {
+    for(uint32_t k = 0; k < recorded.keyframes; k++) {
+        SDL_free((void *)recorded_keyframes[k].image);
+    }
+    SDL_free(recorded_keyframes);
+    SDL_free(recorded_events);
+    SDL_free(recorded_hashes);
+    SDL_free(record_path);
+    SDL_free(movie_data);
+}
+
+// One whole frame, carrying on past unknown opcodes.
+static void runFrame(int instructions_per_frame) {
+    if(SDL_GetAtomicInt(&playing)) {
+        static bool diverged;
+        const uint64_t frame = state.frames - movie.info.firstFrame;
+        if(frame < movie.info.frames) {
+            if(!sc8_moviePlayFrame(&movie, &state) && !diverged) {
+                SDL_Log("The movie diverged at frame %llu", (unsigned long long)frame);
+                diverged = true;
+            }
+            return;
+        }
+        SDL_Log("The movie is over, the keyboard is back");
+        SDL_SetAtomicInt(&playing, 0);
+    }
+    if(record_path != NULL) {
+        recordKeyframe();
+    }
+    const uint64_t frame = state.frames;
+    while(state.frames == frame) {
+        sc8_runFrame(&state, instructions_per_frame);
+    }
+    if(record_path != NULL) {
+        recordFrame();
+    }
+}
+
+// Run-ahead (`--run-ahead=FRAMES`): once the due frames ran, a copy of the state gets
+// snapshotted over and runs FRAMES more with the keys as they are now, and that copy is what's
+// shown. Games that only poll keys once a frame react to a press that many frames sooner.
+// The real state never runs them, so throwing the copy away is the whole rollback.
+// Costs FRAMES + 1 frames of emulation per frame shown.
+static int run_ahead;
+static sc8_state ahead;
+static sc8_snapshot ahead_snapshot;
+
+static void runAhead(int frames, int instructions_per_frame) {
+    running_ahead = true;
+    sc8_takeSnapshot(&ahead_snapshot, &state);
+    sc8_restoreSnapshot(&ahead, &ahead_snapshot);
+    for(int f = 0; f < frames; f++) {
+        const uint64_t frame = ahead.frames;
+        while(ahead.frames == frame) {
+            sc8_runFrame(&ahead, instructions_per_frame);
+        }
+    }
+    running_ahead = false;
+}
+
+// The state whose screen gets shown.
+static sc8_state *shownState(void) {
+    return (run_ahead > 0) ? &ahead : &state;
+}
+
+// Runs the frames that are due by now, returns whether it ran any.
+static bool runDueFrames(Uint64 *next_frame, int instructions_per_frame) {
+    const Uint64 now = SDL_GetTicksNS();
+    bool ran = false;
+    for(int caught_up = 0; now >= *next_frame && caught_up < MAX_CATCH_UP; caught_up++) {
+        if(SDL_GetAtomicInt(&rewinding)) {
+            sc8_rewindPop(&history, &state);
+        } else {
+            runFrame(instructions_per_frame);
+            sc8_rewindPush(&history, &state);
+        }
+        // the timer may have been set without ticking yet, or loaded, and stepping back is silent
+        SDL_SetAtomicInt(&beep_on, !SDL_GetAtomicInt(&rewinding) && state.st > 0);
+        *next_frame += FRAME_NS;
+        ran = true;
+    }
+    if(now >= *next_frame) {
+        *next_frame = now + FRAME_NS; // hopelessly behind, start over from here
+    }
+    if(ran) {
+        serviceStates();
+        if(run_ahead > 0) {
+            // nothing to guess while stepping back or playing a movie
+            const bool guess = !SDL_GetAtomicInt(&rewinding) && !SDL_GetAtomicInt(&playing);
+            runAhead(guess ? run_ahead : 0, instructions_per_frame);
+        }
+    }
+    return ran;
+}
+
+// Threaded mode (`--threaded`): the emulation runs and paces itself on its own thread and
+// hands finished frames to the render thread through a lock-free triple buffer. The
+// emulation thread owns `frame_back`, the render thread `frame_front`, and `frame_shared`
+// holds the third slot (with FRAME_FRESH set when it wasn't picked up yet). Each side swaps
+// its slot with the shared one, so neither ever waits on the other and the render thread
+// always gets the latest whole frame.
+#define FRAME_FRESH 4
+static uint64_t frames[3][SC8_H];
+static SDL_AtomicInt frame_shared;
+static int frame_back = 1, frame_front = 2;
+static SDL_AtomicInt emulating;
+
+static void publishFrame(void) {
+    SDL_memcpy(frames[frame_back], shownState()->gfx, sizeof(state.gfx));
+    frame_back = SDL_SetAtomicInt(&frame_shared, frame_back | FRAME_FRESH) & 3;
+}
+
+static bool takeFrame(void) {
+    if(!(SDL_GetAtomicInt(&frame_shared) & FRAME_FRESH)) {
+        return false;
+    }
+    frame_front = SDL_SetAtomicInt(&frame_shared, frame_front) & 3;
+    return true;
+}
+
+static int SDLCALL emulationThread(void *data) {
+    const int instructions_per_frame = *(const int *)data;
+    Uint64 next_frame = SDL_GetTicksNS();
+    while(SDL_GetAtomicInt(&emulating)) {
+        if(runDueFrames(&next_frame, instructions_per_frame)) {
+            publishFrame();
+        }
+        waitUntil(next_frame);
+    }
+    return 0;
+}
+
+// Faults and halts the emulation runs into, logged from the render thread so the emulation
+// never formats anything. At most EVENTS_PER_SECOND of them a second get through.
+#define EVENTS_PER_SECOND 8
+static sc8_eventLog events;
+static uint64_t events_suppressed;
+
+static void logEvents(void) {
+    sc8_event drained[16];
+    char line[64];
+    uint32_t n;
+    while((n = sc8_eventDrain(&events, drained, SDL_arraysize(drained))) > 0) {
+        for(uint32_t e = 0; e < n; e++) {
+            sc8_eventFormat(&drained[e], line, sizeof(line));
+            SDL_Log("%s", line);
+        }
+    }
+    uint64_t counts[sc8_event_Count], suppressed, dropped;
+    sc8_eventTotals(&events, counts, &suppressed, &dropped);
+    if(suppressed != events_suppressed) {
+        SDL_Log("(%llu more left out)", (unsigned long long)(suppressed - events_suppressed));
+        events_suppressed = suppressed;
+    }
+}
+
+#define PIXEL_SCALE 10
+#define INSTRUCTIONS_PER_FRAME 11 // ~660 instructions per second
+int main(int argc, char **argv) {
+    if(argc < 2 || argc > 7) {
+        fprintf(stderr, "Expected usage: %s <ROM file path> [instructions per frame] [--threaded] [--autosave=SECONDS] [--run-ahead=FRAMES] [--record=FILE | --play=FILE]\n", argv[0]);
+        return 1;
+    }
+    int instructions_per_frame = INSTRUCTIONS_PER_FRAME;
+    bool threaded = false;
+    const char *play_path = NULL;
+    for(int i = 2; i < argc; i++) {
+        if(SDL_strcmp(argv[i], "--threaded") == 0) {
+            threaded = true;
+        } else if(SDL_strncmp(argv[i], "--autosave=", 11) == 0) {
+            autosave_frames = (uint64_t)SDL_max(atoi(argv[i] + 11), 0) * 60;
+        } else if(SDL_strncmp(argv[i], "--run-ahead=", 12) == 0) {
+            run_ahead = SDL_max(atoi(argv[i] + 12), 0);
+        } else if(SDL_strncmp(argv[i], "--record=", 9) == 0) {
+            record_path = SDL_strdup(argv[i] + 9);
+        } else if(SDL_strncmp(argv[i], "--play=", 7) == 0) {
+            play_path = argv[i] + 7;
+        } else {
+            instructions_per_frame = atoi(argv[i]);
+        }
+    }
+    if(instructions_per_frame <= 0) {
+        fprintf(stderr, "Instructions per frame should be a positive number\n");
+        return 1;
+    }
+
+    // kept around, save states only store how memory differs from it
+    rom = SDL_LoadFile(argv[1], &rom_size);
+    if(rom == NULL || rom_size == 0 || rom_size >= MEMORY_SIZE - 512) {
+        fprintf(stderr, "Error loading file: %s\n", (rom == NULL) ? SDL_GetError() : "empty or too big");
+        return 1;
+    }
+    sc8_init(&state);
+    sc8_loadRom(&state, rom, rom_size);
+    sc8_init(&ahead);
+    void *rewind_buffer = SDL_malloc(REWIND_BUDGET);
+    if(rewind_buffer == NULL) {
+        fprintf(stderr, "Couldn't allocate the rewind buffer\n");
+        return 1;
+    }
+    sc8_rewindInit(&history, rewind_buffer, REWIND_BUDGET);
+    SDL_asprintf(&state_path, "%s.state", argv[1]);
+    if(play_path != NULL) {
+        size_t size;
+        movie_data = SDL_LoadFile(play_path, &size);
+        sc8_LoadStateResult result = (movie_data == NULL) ? sc8_loadState_BadImage : sc8_movieOpen(&movie, movie_data, size, rom, rom_size);
+        if(result == sc8_loadState_OK) {
+            result = sc8_movieSeek(&movie, &state, rom, rom_size, 0);
+        }
+        if(result != sc8_loadState_OK) {
+            fprintf(stderr, "Can't play %s, code: %d\n", play_path, result);
+            return 1;
+        }
+        instructions_per_frame = movie.info.instructionsPerFrame;
+        SDL_SetAtomicInt(&playing, 1);
+    } else if(record_path != NULL) {
+        startRecording(instructions_per_frame);
+    }
+    sc8_attachEventLog(&state, &events, EVENTS_PER_SECOND, (uint64_t)instructions_per_frame * 60);
+
+    // small device buffers, so a beep starts within AUDIO_LATENCY_MS
+    char audio_frames[16];
+    SDL_snprintf(audio_frames, sizeof(audio_frames), "%d", AUDIO_FRAMES);
+    SDL_SetHint(SDL_HINT_AUDIO_DEVICE_SAMPLE_FRAMES, audio_frames);
+
+    if(!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_EVENTS)) {
+        fprintf(stderr, "SDL_Init has failed: %s", SDL_GetError());
+        return 1;  
+    }
+
+    SDL_Window *w = SDL_CreateWindow("CHIP-8", SC8_W * PIXEL_SCALE, SC8_H * PIXEL_SCALE, 0);
+    if(w == NULL) {
+        SDL_Log("Error at creating window: %s", SDL_GetError());
+        return 1;
+    }
+    SDL_Renderer *r = SDL_CreateRenderer(w, NULL);
+    if(r == NULL) {
+        SDL_Log("Error creating renderer: %s", SDL_GetError());
+        return 1;
+    }
+
+    SDL_Texture *screen = SDL_CreateTexture(r, SDL_PIXELFORMAT_XRGB8888, SDL_TEXTUREACCESS_STREAMING, SC8_W, SC8_H);
+    if(screen == NULL) {
+        SDL_Log("Error creating screen texture: %s", SDL_GetError());
+        return 1;
+    }
+    SDL_SetTextureScaleMode(screen, SDL_SCALEMODE_NEAREST);
+    buildPixelLut();
+    uint32_t dirty = ~(uint32_t)0; // the texture starts out with garbage
+
+    SDL_AudioSpec beep_stream_spec;
+    beep_stream_spec.channels = 1;
+    beep_stream_spec.format = SDL_AUDIO_F32;
+    beep_stream_spec.freq = AUDIO_FREQ;
+    buildWavetable();
+    SDL_AudioStream *beep_stream = SDL_OpenAudioDeviceStream(
+        SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK,
+        &beep_stream_spec, NULL, NULL
+    );
+    if(beep_stream == NULL) {
+        SDL_Log("Failed to create beep audio stream: %s", SDL_GetError());
+        return 1;
+    }
+    SDL_SetAudioStreamGetCallback(beep_stream, generateBeep, NULL);
+    SDL_ResumeAudioStreamDevice(beep_stream);
+
+    save_queue = SDL_CreateAsyncIOQueue();
+    if(save_queue == NULL) {
+        SDL_Log("Failed to create the save state queue: %s", SDL_GetError());
+        return 1;
+    }
+
+    SDL_Thread *emulation = NULL;
+    if(threaded) {
+        SDL_SetRenderVSync(r, 1); // only blocks this thread now
+        SDL_SetAtomicInt(&frame_shared, 0);
+        SDL_SetAtomicInt(&emulating, 1);
+        emulation = SDL_CreateThread(emulationThread, "sc8 emulation", &instructions_per_frame);
+        if(emulation == NULL) {
+            SDL_Log("Failed to create the emulation thread: %s", SDL_GetError());
+            return 1;
+        }
+    }
+
+    quit = false;
+    Uint64 next_frame = SDL_GetTicksNS();
+    uint64_t shown[SC8_H] = {0}; // what the texture holds in threaded mode
+    while(!quit) {
+        SDL_Event event;
+        while(SDL_PollEvent(&event)) {
+            if(event.type == SDL_EVENT_QUIT) {
+                quit = true;
+            } else if(event.type == SDL_EVENT_KEY_DOWN && event.key.key == SDLK_F5) {
+                SDL_SetAtomicInt(&state_request, STATE_SAVE);
+            } else if(event.type == SDL_EVENT_KEY_DOWN && event.key.key == SDLK_F9) {
+                if(record_path == NULL && movie_data == NULL) {
+                    SDL_SetAtomicInt(&state_request, STATE_LOAD);
+                }
+            } else if((event.type == SDL_EVENT_KEY_DOWN || event.type == SDL_EVENT_KEY_UP) && event.key.key == SDLK_BACKSPACE) {
+                SDL_SetAtomicInt(&rewinding, event.type == SDL_EVENT_KEY_DOWN && record_path == NULL && movie_data == NULL);
+            } else if(event.type == SDL_EVENT_KEY_DOWN || event.type == SDL_EVENT_KEY_UP) {
+                handleKeyEvent(&event);
+            }
+        }
+
+        const uint64_t *gfx = threaded ? shown : shownState()->gfx;
+        if(threaded) {
+            if(takeFrame()) {
+                const uint64_t *frame = frames[frame_front];
+                for(int y = 0; y < SC8_H; y++) {
+                    if(frame[y] != shown[y]) {
+                        dirty |= (uint32_t)1 << y;
+                    }
+                }
+                SDL_memcpy(shown, frame, sizeof(shown));
+            }
+        } else {
+            runDueFrames(&next_frame, instructions_per_frame);
+            dirty |= sc8_takeDirtyRows(shownState());
+            shownState()->drawFlag = false;
+        }
+
+        logEvents();
+
+        const bool presented = dirty != 0;
+        if(presented) {
+            uploadRows(screen, gfx, dirty);
+            dirty = 0;
+            SDL_RenderTexture(r, screen, NULL, NULL);
+            SDL_RenderPresent(r);
+        }
+
+        if(threaded) {
+            if(!presented) {
+                SDL_DelayNS(SDL_NS_PER_MS); // nothing new yet, check again shortly
+            }
+        } else {
+            waitUntil(next_frame);
+        }
+    }
+
+    if(emulation != NULL) {
+        SDL_SetAtomicInt(&emulating, 0);
+        SDL_WaitThread(emulation, NULL);
+    }
+
+    finishSaves(true);
+    if(record_path != NULL) {
+        saveMovie();
+    }
+    freeMovies();
+    SDL_DestroyAsyncIOQueue(save_queue);
+    SDL_free(state_path);
+    SDL_free(rom);
+    SDL_free(rewind_buffer);
+
+    SDL_DestroyAudioStream(beep_stream);
+    SDL_DestroyTexture(screen);
+    SDL_DestroyRenderer(r);
+    SDL_DestroyWindow(w);
+    SDL_Quit();
+
+    return 0;
+}
@@ -0,0 +1,153 @@
+// Ahead of time translation test.
+//
+// usage: sc8_test_aot
+//
+// Runs `sc8_aot_calls.c`, what tools/sc8_aot.c makes of `sc8_aot_calls.ch8`, next to
+// `sc8_stepMany` in runs of random length and checks they stay in the same state and log the
+// same events. The ROM calls into subroutines past 0x2FF from several places, nests them,
+// recurses until the stack overflows and unwinds, returns with nothing on the stack and
+// (halfway through) gets its code overwritten, so the translated 2NNN/00EE, the return sites,
+// the dispatch and the fallback to the interpreter all run.
+// It also translates the ROM again with the tool's own code and checks the file is up to date,
+// regenerate it with `sc8_aot test/sc8_aot_calls.ch8 test/sc8_aot_calls.c calls`.
+// Prints every check that fails and exits with 1, 0 when there's none.
+
+// the tool, for its translator (it brings the header and `sc8_beep` with it)
+#define main sc8_aotMain
+#include "../tools/sc8_aot.c"
+#undef main
+
+#include "sc8_aot_calls.c"
+
+#define INSTRUCTIONS 200000
+#define MAX_EVENTS 64
+
+static int failures;
+
+#define CHECK(condition)                                                    \
+    do {                                                                    \
+        if(!(condition)) {                                                  \
+            printf("%s:%d: failed: %s\n", __FILE__, __LINE__, #condition);  \
+            failures++;                                                     \
+        }                                                                   \
+    } while(0)
+
+static uint32_t seed = 2463534242u;
+
+static uint32_t next(void) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+// Translates the ROM again and compares that with the file, past its first line (which
+// names the ROM file it was made from).
+static void upToDate(void) {
+    char path[512];
+    const char *slash = strrchr(__FILE__, '/');
+    const int dir = (slash != NULL) ? (int)(slash + 1 - __FILE__) : 0;
+    snprintf(path, sizeof(path), "%.*ssc8_aot_calls.c", dir, __FILE__);
+    FILE *saved = fopen(path, "rb");
+    if(saved == NULL) {
+        printf("Couldn't open %s, not checking it's up to date\n", path);
+        return;
+    }
+
+    romSize = sizeof(sc8aot_calls_rom);
+    memcpy(memory + ROM_START, sc8aot_calls_rom, romSize);
+    recoverCfg();
+    FILE *fresh = tmpfile();
+    CHECK(fresh != NULL);
+    if(fresh == NULL) {
+        fclose(saved);
+        return;
+    }
+    emit(fresh, "calls", "");
+    rewind(fresh);
+
+    int a, b;
+    while((a = fgetc(saved)) != EOF && a != '\n') {}
+    while((b = fgetc(fresh)) != EOF && b != '\n') {}
+    uint32_t line = 2;
+    do {
+        a = fgetc(saved);
+        b = fgetc(fresh);
+        line += a == '\n';
+    } while(a == b && a != EOF);
+    if(a != b) {
+        printf("%s:%d: failed: %s differs from the tool's output from line %u on\n", __FILE__, __LINE__, path, line);
+        failures++;
+    }
+    fclose(fresh);
+    fclose(saved);
+}
+
+static uint32_t drain(sc8_eventLog *log, sc8_event *events, uint32_t *faults) {
+    const uint32_t count = sc8_eventDrain(log, events, MAX_EVENTS);
+    for(uint32_t e = 0; e < count; e++) {
+        faults[events[e].kind]++;
+    }
+    return count;
+}
+
+static void equivalence(void) {
+    static sc8_state interpreted, translated;
+    static sc8_eventLog logs[2];
+    static sc8_event events[2][MAX_EVENTS];
+    uint32_t faults[2][sc8_event_Count] = { { 0 } };
+    sc8_state *states[2] = { &interpreted, &translated };
+    for(int s = 0; s < 2; s++) {
+        sc8_init(states[s]);
+        sc8_loadRom(states[s], sc8aot_calls_rom, sizeof(sc8aot_calls_rom));
+        sc8_attachEventLog(states[s], &logs[s], 1000000, 1);
+    }
+
+    uint32_t done = 0, deepest = 0;
+    bool patched = false;
+    while(done < INSTRUCTIONS) {
+        if(!patched && done >= INSTRUCTIONS / 2) {
+            // ADD V0, 1 at 300 becomes ADD V0, 2: the translation no longer applies
+            for(int s = 0; s < 2; s++) {
+                states[s]->memory[0x301] = 0x02;
+            }
+            patched = true;
+        }
+        const uint32_t count = 1 + next() % 64;
+        const uint32_t a = sc8_stepMany(&interpreted, count);
+        const uint32_t b = sc8aot_calls_run(&translated, count);
+        const uint32_t events_a = drain(&logs[0], events[0], faults[0]);
+        const uint32_t events_b = drain(&logs[1], events[1], faults[1]);
+        bool same = a == b && sc8_stateHash(&interpreted) == sc8_stateHash(&translated) && events_a == events_b;
+        for(uint32_t e = 0; same && e < events_a; e++) {
+            same = events[0][e].cycle == events[1][e].cycle && events[0][e].pc == events[1][e].pc &&
+                   events[0][e].kind == events[1][e].kind;
+        }
+        if(!same) {
+            printf("%s:%d: failed: after %u instructions, running %u more\n", __FILE__, __LINE__, done, count);
+            printf("  stepMany  ran %u, pc %03X  sp %u  V0 %02X  V1 %02X  V2 %02X, %u events\n", a, interpreted.pc,
+                   interpreted.sp, interpreted.v[0], interpreted.v[1], interpreted.v[2], events_a);
+            printf("  translated ran %u, pc %03X  sp %u  V0 %02X  V1 %02X  V2 %02X, %u events\n", b, translated.pc,
+                   translated.sp, translated.v[0], translated.v[1], translated.v[2], events_b);
+            failures++;
+            return;
+        }
+        done += a;
+        deepest = SC8_MAX(deepest, interpreted.sp);
+    }
+    // it went through all of it, more than once
+    CHECK(deepest == 16);
+    CHECK(faults[0][sc8_event_StackOverflow] > 1 && faults[0][sc8_event_StackUnderflow] > 1);
+    CHECK(faults[0][sc8_event_UnknownOpcode] == 0 && faults[0][sc8_event_OutOfBounds] == 0);
+}
+
+int main(void) {
+    upToDate();
+    equivalence();
+    if(failures > 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("ahead of time translation: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,329 @@
+// Engine equivalence test.
+//
+// usage: sc8_test_engines [rom.ch8...]
+//
+// Plays the ROMs given and a batch of random ones on every engine, with the same key events,
+// and checks after every frame that they're all in the same state and logged the same events.
+// The engines come in two groups that can't be compared with each other, since one ticks the
+// timers after every instruction and the other once a frame:
+//   - `sc8_step` one instruction at a time, `sc8_stepMany`, `sc8_stepMany` through a block
+//     cache and `sc8_jitRun`, a frame's worth of instructions and then the timers,
+//   - `sc8_runFrame` (so `sc8_run`) with and without a block cache.
+// The interpreter core is whichever the test was built with, build it with
+// `SC8_DISPATCH_THREADED` (and `SC8_NO_COMPUTED_GOTO`) to test the others.
+// Prints the first difference it finds and exits with 1, 0 when there's none.
+//
+// The random ROMs are mostly valid instructions, with jumps and calls that stay in the ROM,
+// I pointing anywhere (the ROM itself included, so they rewrite their own code) and now and
+// then an unknown opcode, an Fx0A or an F0FF.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SC8_JIT
+#define SC8_USE_STDIO
+#include "../smallCHIP-8.h"
+
+void sc8_beep(void) {}
+
+#define RANDOM_ROMS 200
+#define FRAMES 300
+#define INSTRUCTIONS_PER_FRAME 15
+#define MAX_EVENTS 64 // drained per frame, the rest are only counted
+
+static uint32_t seed;
+
+static uint32_t next(void) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+// Random ROMs.
+
+static size_t randomRom(uint8_t *rom) {
+    const size_t instructions = 16 + next() % 240;
+    for(size_t n = 0; n < instructions; n++) {
+        const uint16_t x = (next() & 0xF) << 8;
+        const uint16_t y = (next() & 0xF) << 4;
+        const uint16_t kk = next() & 0xFF;
+        const uint16_t target = 0x200 + 2 * (next() % instructions);
+        uint16_t opcode;
+        switch(next() % 32) {
+            case 0:  opcode = 0x00E0; break;
+            case 1:  opcode = 0x00EE; break;
+            case 2:  case 3: opcode = 0x1000 | target; break;
+            case 4:  opcode = 0x2000 | target; break;
+            case 5:  opcode = 0x3000 | x | kk; break;
+            case 6:  opcode = 0x4000 | x | kk; break;
+            case 7:  opcode = 0x5000 | x | y; break;
+            case 8:  case 9: opcode = 0x6000 | x | kk; break;
+            case 10: case 11: opcode = 0x7000 | x | kk; break;
+            case 12: case 13: {
+                static const uint8_t alu[] = { 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE, 0x9 }; // 8xy9 is unknown
+                opcode = 0x8000 | x | y | alu[next() % (sizeof(alu) - (next() % 8 != 0))];
+                break;
+            }
+            case 14: opcode = 0x9000 | x | y; break;
+            case 15: opcode = 0xA000 | ((next() % 4 == 0) ? target : next() & 0xFFF); break;
+            case 16: opcode = 0xB000 | target; break;
+            case 17: opcode = 0xC000 | x | kk; break;
+            case 18: case 19: opcode = 0xD000 | x | y | (next() & 0xF); break;
+            case 20: opcode = 0xE09E | x; break;
+            case 21: opcode = 0xE0A1 | x; break;
+            case 22: opcode = 0xF007 | x; break;
+            case 23: opcode = (next() % 4 == 0) ? 0xF00A | x : 0xF015 | x; break;
+            case 24: opcode = 0xF018 | x; break;
+            case 25: opcode = 0xF01E | x; break;
+            case 26: opcode = 0xF029 | x; break;
+            case 27: opcode = 0xF033 | x; break;
+            case 28: opcode = 0xF055 | x; break;
+            case 29: opcode = 0xF065 | x; break;
+            case 30: opcode = (next() % 16 == 0) ? 0xF0FF : 0x6000 | x | kk; break;
+            default: opcode = (next() % 4 == 0) ? next() & 0xFFFF : 0x7000 | x | kk; break;
+        }
+        rom[2 * n] = opcode >> 8;
+        rom[2 * n + 1] = opcode & 0xFF;
+    }
+    return 2 * instructions;
+}
+
+// Engines.
+
+static uint32_t runStep(sc8_state *state, uint32_t count) {
+    uint32_t done = 0;
+    while(done < count) {
+        if(!sc8_step(state)) {
+            return done + (state->wait == sc8_wait_None); // a wait didn't run
+        }
+        done++;
+    }
+    return done;
+}
+
+typedef struct {
+    const char *name;
+    uint32_t (*run)(sc8_state *state, uint32_t count); // NULL for `sc8_runFrame`
+    bool cached;
+    bool jitted;
+} Engine;
+
+// Each group starts with its reference.
+static const Engine engines[] = {
+    { "step", runStep, false, false },
+    { "many", sc8_stepMany, false, false },
+    { "cache", sc8_stepMany, true, false },
+    { "jit", sc8_jitRun, false, true },
+    { "run", NULL, false, false },
+    { "run+cache", NULL, true, false },
+};
+#define ENGINES (sizeof(engines) / sizeof(engines[0]))
+
+typedef struct {
+    sc8_state state;
+    sc8_blockCache cache;
+    sc8_jit jit;
+    sc8_eventLog log;
+    sc8_event events[MAX_EVENTS];
+    uint32_t eventCount;
+} Side;
+
+static Side sides[ENGINES];
+
+static void start(Side *side, const Engine *engine, const uint8_t *rom, size_t rom_size) {
+    sc8_state *state = &side->state;
+    sc8_init(state);
+    sc8_loadRom(state, rom, rom_size);
+    if(engine->cached) {
+        sc8_attachCache(state, &side->cache);
+    }
+    if(engine->jitted) {
+        sc8_attachJit(state, &side->jit);
+    }
+    sc8_attachEventLog(state, &side->log, 1000000, 1);
+}
+
+// One frame, the way `sc8_runFrame` plays it but with the timers ticked by the engine.
+static void playFrame(Side *side, const Engine *engine) {
+    sc8_state *state = &side->state;
+    if(engine->run == NULL) {
+        const uint64_t frame = state->frames;
+        while(state->frames == frame) {
+            sc8_runFrame(state, INSTRUCTIONS_PER_FRAME); // unknown opcodes end it early
+        }
+    } else {
+        uint32_t done = 0;
+        while(done < INSTRUCTIONS_PER_FRAME) {
+            const uint32_t n = engine->run(state, INSTRUCTIONS_PER_FRAME - done);
+            done += n;
+            if(state->wait != sc8_wait_None) {
+                state->idle++;
+                break;
+            }
+            if(n == 0) {
+                break;
+            }
+        }
+        sc8_tickTimers(state);
+        state->frames++;
+    }
+    side->eventCount = sc8_eventDrain(&side->log, side->events, MAX_EVENTS);
+}
+
+static bool sameEvents(const Side *a, const Side *b) {
+    if(a->eventCount != b->eventCount) {
+        return false;
+    }
+    for(uint32_t e = 0; e < a->eventCount; e++) {
+        const sc8_event *x = &a->events[e], *y = &b->events[e];
+        if(x->cycle != y->cycle || x->pc != y->pc || x->opcode != y->opcode || x->kind != y->kind) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void printEvents(const Side *side, const char *name) {
+    char line[128];
+    printf("  %s logged %u events\n", name, side->eventCount);
+    for(uint32_t e = 0; e < side->eventCount; e++) {
+        sc8_eventFormat(&side->events[e], line, sizeof(line));
+        printf("    %s\n", line);
+    }
+}
+
+// Plays the ROM on every engine, returns false at the first frame where one differs from
+// its group's reference.
+static bool check(const char *name, const uint8_t *rom, size_t rom_size) {
+    for(size_t e = 0; e < ENGINES; e++) {
+        start(&sides[e], &engines[e], rom, rom_size);
+    }
+    for(uint32_t frame = 0; frame < FRAMES; frame++) {
+        // the same key events for everyone, at the clock of their group's reference
+        const uint32_t roll = next();
+        if(roll % 3 == 0) {
+            const uint8_t key = roll >> 8 & 0xF;
+            size_t reference = 0;
+            uint64_t at = 0;
+            for(size_t e = 0; e < ENGINES; e++) {
+                sc8_state *state = &sides[e].state;
+                if(e == 0 || (engines[e].run == NULL && engines[reference].run != NULL)) {
+                    reference = e;
+                    at = state->cycles + state->idle + (roll >> 12 & 0x1F);
+                }
+                if(state->key[key]) {
+                    sc8_keyUp(state, key, at);
+                } else {
+                    sc8_keyDown(state, key, at);
+                }
+            }
+        }
+        size_t reference = 0;
+        for(size_t e = 0; e < ENGINES; e++) {
+            sc8_state *state = &sides[e].state;
+            if(engines[e].run == NULL && engines[reference].run != NULL) {
+                reference = e;
+            }
+            playFrame(&sides[e], &engines[e]);
+            if(e == reference) {
+                continue;
+            }
+            const sc8_state *expected = &sides[reference].state;
+            const bool same_state = sc8_stateHash(state) == sc8_stateHash(expected) && state->idle == expected->idle;
+            if(!same_state || !sameEvents(&sides[e], &sides[reference])) {
+                printf("%s: %s and %s differ after frame %u\n", name, engines[reference].name, engines[e].name, frame);
+                printf("  %-9s pc %03X  I %03X  cycles %llu  idle %llu\n", engines[reference].name, expected->pc, expected->i,
+                       (unsigned long long)expected->cycles, (unsigned long long)expected->idle);
+                printf("  %-9s pc %03X  I %03X  cycles %llu  idle %llu\n", engines[e].name, state->pc, state->i,
+                       (unsigned long long)state->cycles, (unsigned long long)state->idle);
+                printEvents(&sides[reference], engines[reference].name);
+                printEvents(&sides[e], engines[e].name);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Nested calls into subroutines past 0x2FF, where a return address doesn't fit a byte. Each
+// engine has to end up spinning at 208 with V0 = 1 + 2 + 4 + 10 + 2 + 4 and nothing on the
+// stack, whatever the others do.
+static bool checkCalls(void) {
+    static uint8_t rom[0x224];
+    static const struct {
+        uint16_t addr;
+        uint16_t opcode;
+    } code[] = {
+        { 0x200, 0x6000 }, // LD V0, 0
+        { 0x202, 0x2300 }, // CALL 300
+        { 0x204, 0x2310 }, // CALL 310
+        { 0x206, 0x6101 }, // LD V1, 1
+        { 0x208, 0x1208 }, // JP 208
+        { 0x300, 0x7001 }, // ADD V0, 1
+        { 0x302, 0x2310 }, // CALL 310
+        { 0x304, 0x7010 }, // ADD V0, 10
+        { 0x306, 0x00EE }, // RET
+        { 0x310, 0x7002 }, // ADD V0, 2
+        { 0x312, 0x2420 }, // CALL 420
+        { 0x314, 0x00EE }, // RET
+        { 0x420, 0x7004 }, // ADD V0, 4
+        { 0x422, 0x00EE }, // RET
+    };
+    for(size_t c = 0; c < sizeof(code) / sizeof(code[0]); c++) {
+        rom[code[c].addr - 0x200] = code[c].opcode >> 8;
+        rom[code[c].addr - 0x200 + 1] = code[c].opcode & 0xFF;
+    }
+    for(size_t e = 0; e < ENGINES; e++) {
+        start(&sides[e], &engines[e], rom, sizeof(rom));
+        for(int frame = 0; frame < 4; frame++) {
+            playFrame(&sides[e], &engines[e]);
+        }
+        const sc8_state *state = &sides[e].state;
+        if(state->pc != 0x208 || state->sp != 0 || state->v[0] != 0x1D || state->v[1] != 1) {
+            printf("calls: %s ends at %03X with sp %u, V0 %02X, V1 %02X\n", engines[e].name, state->pc, state->sp,
+                   state->v[0], state->v[1]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    for(size_t e = 0; e < ENGINES; e++) {
+        if(engines[e].jitted && !sc8_jitInit(&sides[e].jit)) {
+            printf("The JIT isn't available here, `jit` runs `sc8_stepMany`\n");
+        }
+    }
+
+    if(!checkCalls()) {
+        return 1;
+    }
+
+    static uint8_t rom[MEMORY_SIZE];
+    for(int a = 1; a < argc; a++) {
+        FILE *f = fopen(argv[a], "rb");
+        if(f == NULL) {
+            fprintf(stderr, "Couldn't open %s\n", argv[a]);
+            return 1;
+        }
+        const size_t rom_size = fread(rom, 1, MEMORY_SIZE - 0x200, f);
+        fclose(f);
+        seed = 2463534242u;
+        if(!check(argv[a], rom, rom_size)) {
+            return 1;
+        }
+    }
+
+    for(uint32_t r = 0; r < RANDOM_ROMS; r++) {
+        seed = 2463534242u + r * 7919;
+        const size_t rom_size = randomRom(rom);
+        char name[32];
+        snprintf(name, sizeof(name), "random ROM %u", r);
+        if(!check(name, rom, rom_size)) {
+            return 1;
+        }
+    }
+    printf("%d ROMs, %d frames each: every engine agrees\n", argc - 1 + RANDOM_ROMS, FRAMES);
+    return 0;
+}
@@ -0,0 +1,270 @@
+// Movie test.
+//
+// usage: sc8_test_movie
+//
+// Records a movie of a ROM that touches everything a save state holds, with random key events
+// and a couple of frames holding far more events than the key queue does, plays it back
+// whole and from every kind of seek point, and checks each frame hashes the same as when it
+// was recorded. Then checks a wrong hash gets caught on its own frame and that broken movies
+// (truncated, corrupt, the wrong ROM or version, events out of order) are refused.
+// Prints every check that fails and exits with 1, 0 when there's none.
+
+#include <stdio.h>
+
+#define SC8_USE_STDIO
+#include "../smallCHIP-8.h"
+
+void sc8_beep(void) {}
+
+#define INSTRUCTIONS_PER_FRAME 15
+#define FRAMES 700
+#define KEYFRAME_EVERY 50
+#define KEYFRAMES ((FRAMES + KEYFRAME_EVERY - 1) / KEYFRAME_EVERY)
+#define MAX_EVENTS 4096
+
+static int failures;
+
+#define CHECK(condition)                                                    \
+    do {                                                                    \
+        if(!(condition)) {                                                  \
+            printf("%s:%d: failed: %s\n", __FILE__, __LINE__, #condition);  \
+            failures++;                                                     \
+        }                                                                   \
+    } while(0)
+
+static const uint8_t rom[] = {
+    0x6A, 0x00, // 200  LD VA, 0
+    0xC0, 0x3F, // 202  RND V0, 3F
+    0xC1, 0x1F, // 204  RND V1, 1F
+    0xF2, 0x29, // 206  LD F, V2
+    0xD0, 0x15, // 208  DRW V0, V1, 5
+    0xA3, 0x00, // 20A  LD I, 300
+    0xFA, 0x1E, // 20C  ADD I, VA
+    0xF2, 0x33, // 20E  LD B, V2
+    0x72, 0x01, // 210  ADD V2, 1
+    0xE5, 0x9E, // 212  SKP V5
+    0x73, 0x01, // 214  ADD V3, 1
+    0xF3, 0x18, // 216  LD ST, V3
+    0xF4, 0x15, // 218  LD DT, V4
+    0x74, 0x05, // 21A  ADD V4, 5
+    0xF4, 0x55, // 21C  LD [I], V4
+    0x7A, 0x03, // 21E  ADD VA, 3
+    0x3A, 0x60, // 220  SE VA, 60
+    0x12, 0x02, // 222  JP 202
+    0x22, 0x00, // 224  CALL 200, never returns: the stack fills up, then overflows
+    0xF6, 0x0A, // 226  LD V6, K, once it has
+    0x12, 0x00, // 228  JP 200
+};
+
+// Frames that get a batch of key events every time they stop on a breakpoint.
+static const uint32_t busy[] = { 123, 250, 251 };
+
+static uint32_t nextKey(uint32_t *seed) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+}
+
+static sc8_state state;
+static sc8_keyEvent events[MAX_EVENTS];
+static uint64_t hashes[FRAMES];
+static uint8_t images[KEYFRAMES][SC8_STATE_MAX];
+static uint8_t movie_data[1 << 20], broken[1 << 20];
+static size_t movie_size;
+static uint32_t busiest; // most events any one frame got
+
+// Records `FRAMES` frames the way `sc8_movie record` does.
+static void record(void) {
+    sc8_init(&state);
+    sc8_loadRom(&state, rom, sizeof(rom));
+    state.xorRandState = 12345;
+
+    static sc8_keyEvent logged[1024];
+    sc8_keyLog log = { logged, 0, sizeof(logged) / sizeof(logged[0]), false };
+    sc8_attachKeyLog(&state, &log);
+
+    sc8_movieInfo info = { 0 };
+    info.randState = state.xorRandState;
+    info.instructionsPerFrame = INSTRUCTIONS_PER_FRAME;
+    info.keyframeEvery = KEYFRAME_EVERY;
+    info.firstFrame = state.frames;
+    info.frames = FRAMES;
+    info.keyframes = KEYFRAMES;
+    static sc8_movieKeyframe keyframes[KEYFRAMES];
+
+    uint32_t seed = 2463534242u;
+    for(uint32_t f = 0; f < FRAMES; f++) {
+        if(f % KEYFRAME_EVERY == 0) {
+            sc8_movieKeyframe *key = &keyframes[f / KEYFRAME_EVERY];
+            key->size = sc8_saveState(&state, rom, sizeof(rom), images[f / KEYFRAME_EVERY], SC8_STATE_MAX);
+            key->image = images[f / KEYFRAME_EVERY];
+            key->firstEvent = info.events;
+        }
+
+        const uint32_t roll = nextKey(&seed);
+        if(roll % 4 == 0) {
+            const uint8_t key = (roll >> 8) % 8;
+            if(state.key[key]) {
+                sc8_keyUp(&state, key, state.cycles + state.idle + (roll >> 16) % 16);
+            } else {
+                sc8_keyDown(&state, key, state.cycles + state.idle + (roll >> 16) % 16);
+            }
+        }
+        bool is_busy = false;
+        for(size_t b = 0; b < sizeof(busy) / sizeof(busy[0]); b++) {
+            is_busy |= busy[b] == f;
+        }
+        sc8_setBreakpoint(&state, 0x210, is_busy);
+        while(state.frames == info.firstFrame + f) {
+            // as many as the queue takes, all due right away
+            for(uint32_t n = 0; is_busy && n < 60; n++) {
+                const uint8_t key = nextKey(&seed) % 8;
+                if(n % 2 == 0) {
+                    sc8_keyDown(&state, key, state.cycles + state.idle);
+                } else {
+                    sc8_keyUp(&state, key, state.cycles + state.idle);
+                }
+            }
+            sc8_runFrame(&state, INSTRUCTIONS_PER_FRAME);
+        }
+
+        CHECK(!log.overflow && info.events + log.count <= MAX_EVENTS);
+        memcpy(events + info.events, log.events, log.count * sizeof(*events));
+        info.events += log.count;
+        busiest = SC8_MAX(busiest, log.count);
+        log.count = 0;
+        hashes[f] = sc8_stateHash(&state);
+    }
+    CHECK(busiest > SC8_KEY_QUEUE);
+    CHECK(state.idle > 0); // it waited on a key too
+
+    movie_size = sc8_movieWrite(NULL, 0, &info, rom, sizeof(rom), events, hashes, keyframes);
+    CHECK(movie_size > 0 && movie_size <= sizeof(movie_data));
+    CHECK(sc8_movieWrite(movie_data, movie_size - 1, &info, rom, sizeof(rom), events, hashes, keyframes) == 0);
+    CHECK(sc8_movieWrite(movie_data, sizeof(movie_data), &info, rom, sizeof(rom), events, hashes, keyframes) == movie_size);
+}
+
+// Whether it plays from `from` to the end, every frame hashing as recorded.
+static bool playsFrom(sc8_movie *movie, uint64_t from) {
+    sc8_init(&state);
+    if(sc8_movieSeek(movie, &state, rom, sizeof(rom), from) != sc8_loadState_OK) {
+        return false;
+    }
+    for(uint64_t f = from; f < FRAMES; f++) {
+        if(!sc8_moviePlayFrame(movie, &state)) {
+            printf("%s:%d: failed: frame %llu played from %llu\n", __FILE__, __LINE__, (unsigned long long)f,
+                   (unsigned long long)from);
+            return false;
+        }
+    }
+    return !sc8_moviePlayFrame(movie, &state); // it's over
+}
+
+static void playBack(void) {
+    sc8_movie movie;
+    CHECK(sc8_movieOpen(&movie, movie_data, movie_size, rom, sizeof(rom)) == sc8_loadState_OK);
+    CHECK(movie.info.frames == FRAMES && movie.info.keyframes == KEYFRAMES && movie.info.romSize == sizeof(rom));
+
+    CHECK(playsFrom(&movie, 0));
+    // right on, right before and right after keyframes, and into the busy frames
+    static const uint64_t seeks[] = { 1, 49, 50, 51, 122, 123, 124, 249, 251, 252, 600, 650, 651, 680, FRAMES - 1 };
+    for(size_t s = 0; s < sizeof(seeks) / sizeof(seeks[0]); s++) {
+        sc8_init(&state);
+        CHECK(sc8_movieSeek(&movie, &state, rom, sizeof(rom), seeks[s]) == sc8_loadState_OK);
+        CHECK(sc8_stateHash(&state) == hashes[seeks[s] - 1]);
+        CHECK(playsFrom(&movie, seeks[s]));
+    }
+    // from a state that's had a key event queued of its own (on a key the movie never
+    // uses, due right away), which has to go
+    CHECK(sc8_keyDown(&state, 0xF, 0));
+    CHECK(sc8_movieSeek(&movie, &state, rom, sizeof(rom), 100) == sc8_loadState_OK);
+    for(int f = 100; f < 150; f++) {
+        CHECK(sc8_moviePlayFrame(&movie, &state));
+    }
+    // past the end stops at the end
+    sc8_init(&state);
+    CHECK(sc8_movieSeek(&movie, &state, rom, sizeof(rom), FRAMES + 10) == sc8_loadState_OK);
+    CHECK(sc8_stateHash(&state) == hashes[FRAMES - 1]);
+    CHECK(!sc8_moviePlayFrame(&movie, &state));
+
+    // a state that went its own way gets caught on the frame it did
+    memcpy(broken, movie_data, movie_size);
+    const size_t hash_at = 52 + (size_t)movie.info.events * 10 + 300 * 8;
+    broken[hash_at] ^= 1;
+    CHECK(sc8_movieOpen(&movie, broken, movie_size, rom, sizeof(rom)) == sc8_loadState_OK);
+    sc8_init(&state);
+    CHECK(sc8_movieSeek(&movie, &state, rom, sizeof(rom), 290) == sc8_loadState_OK);
+    for(int f = 290; f < 300; f++) {
+        CHECK(sc8_moviePlayFrame(&movie, &state));
+    }
+    CHECK(!sc8_moviePlayFrame(&movie, &state));
+    CHECK(sc8_moviePlayFrame(&movie, &state));
+}
+
+// Overwrites the cycle of event `e` in a movie.
+static void putCycle(uint8_t *movie, uint32_t e, uint64_t cycle) {
+    for(int b = 0; b < 8; b++) {
+        movie[52 + (size_t)e * 10 + b] = (uint8_t)(cycle >> (8 * b));
+    }
+}
+
+static void failedOpens(void) {
+    sc8_movie movie;
+    // every truncation
+    for(size_t cut = 0; cut < movie_size; cut++) {
+        if(sc8_movieOpen(&movie, movie_data, cut, rom, sizeof(rom)) != sc8_loadState_BadImage) {
+            printf("%s:%d: failed: a movie cut to %zu of %zu bytes opened\n", __FILE__, __LINE__, cut, movie_size);
+            failures++;
+            break;
+        }
+    }
+
+    // not a movie
+    memcpy(broken, movie_data, movie_size);
+    broken[0] ^= 0xFF;
+    CHECK(sc8_movieOpen(&movie, broken, movie_size, rom, sizeof(rom)) == sc8_loadState_BadImage);
+
+    // recorded by another version
+    memcpy(broken, movie_data, movie_size);
+    broken[4]++;
+    CHECK(sc8_movieOpen(&movie, broken, movie_size, rom, sizeof(rom)) == sc8_loadState_BadVersion);
+
+    // the wrong ROM: one byte off, one byte short
+    static uint8_t other[sizeof(rom)];
+    memcpy(other, rom, sizeof(rom));
+    other[5] ^= 1;
+    CHECK(sc8_movieOpen(&movie, movie_data, movie_size, other, sizeof(other)) == sc8_loadState_WrongROM);
+    CHECK(sc8_movieOpen(&movie, movie_data, movie_size, rom, sizeof(rom) - 1) == sc8_loadState_WrongROM);
+
+    // an event before the one it follows, and one for a key that isn't there
+    CHECK(sc8_movieOpen(&movie, movie_data, movie_size, rom, sizeof(rom)) == sc8_loadState_OK);
+    const uint32_t last = movie.info.events - 1;
+    CHECK(last > 0 && events[last - 1].cycle > 0);
+    memcpy(broken, movie_data, movie_size);
+    putCycle(broken, last, events[last - 1].cycle);
+    CHECK(sc8_movieOpen(&movie, broken, movie_size, rom, sizeof(rom)) == sc8_loadState_OK); // the same cycle is fine
+    putCycle(broken, last, events[last - 1].cycle - 1);
+    CHECK(sc8_movieOpen(&movie, broken, movie_size, rom, sizeof(rom)) == sc8_loadState_BadImage);
+    memcpy(broken, movie_data, movie_size);
+    broken[52 + 8] = 0x10;
+    CHECK(sc8_movieOpen(&movie, broken, movie_size, rom, sizeof(rom)) == sc8_loadState_BadImage);
+
+    // a keyframe past the end
+    memcpy(broken, movie_data, movie_size);
+    const size_t keyframe_at = 52 + (size_t)movie.info.events * 10 + FRAMES * 8 + (KEYFRAMES - 1) * 16;
+    broken[keyframe_at + 8]++;
+    CHECK(sc8_movieOpen(&movie, broken, movie_size, rom, sizeof(rom)) == sc8_loadState_BadImage);
+}
+
+int main(void) {
+    record();
+    playBack();
+    failedOpens();
+    if(failures > 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("movies: all checks passed (%u events in the busiest frame)\n", busiest);
+    return 0;
+}
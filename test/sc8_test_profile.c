@@ -0,0 +1,148 @@
+// Profiler call tree test.
+//
+// usage: sc8_test_profile
+//
+// Runs a ROM whose subroutines live past 0x2FF, with the same routine called from two places
+// and a 00EE on an empty stack, and checks the calling context tree the profiler builds out
+// of it node by node, along with the routines and call edges worked out from the tree. Runs
+// it one `sc8_step` at a time and through `sc8_stepMany`, with and without a block cache.
+// Prints every check that fails and exits with 1, 0 when there's none.
+
+#include <stdio.h>
+
+#define SC8_PROFILE
+#define SC8_USE_STDIO
+#include "../smallCHIP-8.h"
+
+void sc8_beep(void) {}
+
+static int failures;
+
+#define CHECK(condition)                                                    \
+    do {                                                                    \
+        if(!(condition)) {                                                  \
+            printf("%s:%d: failed: %s\n", __FILE__, __LINE__, #condition);  \
+            failures++;                                                     \
+        }                                                                   \
+    } while(0)
+
+static const struct {
+    uint16_t addr;
+    uint16_t opcode;
+} code[] = {
+    { 0x200, 0x2300 }, // CALL 300
+    { 0x202, 0x2310 }, // CALL 310
+    { 0x204, 0x00EE }, // RET, with nothing to return to
+    { 0x206, 0x1206 }, // JP 206
+    { 0x300, 0x2310 }, // CALL 310
+    { 0x302, 0x6001 }, // LD V0, 1
+    { 0x304, 0x00EE }, // RET
+    { 0x310, 0x2420 }, // CALL 420
+    { 0x312, 0x00EE }, // RET
+    { 0x420, 0x7001 }, // ADD V0, 1
+    { 0x422, 0x00EE }, // RET
+};
+#define CALLS_DONE 14 // instructions until it spins at 206
+#define SPINS 10
+
+// The child of `parent` for `routine`, 0 when there's none.
+static uint16_t child(const sc8_profile *profile, uint16_t parent, uint16_t routine) {
+    for(uint16_t node = profile->nodes[parent].child; node != 0; node = profile->nodes[node].sibling) {
+        if(profile->nodes[node].routine == routine) {
+            return node;
+        }
+    }
+    return 0;
+}
+
+static void checkTree(const sc8_profile *profile) {
+    const sc8_callNode *nodes = profile->nodes;
+    CHECK(profile->nodeCount == 6 && profile->current == 0 && profile->lostDepth == 0);
+    // the top level ran both calls, the bad 00EE and the spinning JP
+    CHECK(nodes[0].routine == 0x200 && nodes[0].self == 3 + SPINS);
+
+    const uint16_t a = child(profile, 0, 0x300);
+    const uint16_t b = child(profile, a, 0x310);
+    const uint16_t c = child(profile, b, 0x420);
+    const uint16_t d = child(profile, 0, 0x310);
+    const uint16_t e = child(profile, d, 0x420);
+    CHECK(a != 0 && b != 0 && c != 0 && d != 0 && e != 0 && b != d && c != e);
+    CHECK(nodes[a].calls == 1 && nodes[a].self == 3); // CALL, LD, RET
+    CHECK(nodes[b].calls == 1 && nodes[b].self == 2); // CALL, RET
+    CHECK(nodes[c].calls == 1 && nodes[c].self == 2); // ADD, RET
+    CHECK(nodes[d].calls == 1 && nodes[d].self == 2);
+    CHECK(nodes[e].calls == 1 && nodes[e].self == 2);
+    CHECK(nodes[c].child == 0 && nodes[e].child == 0);
+
+    sc8_routineProfile routines[8];
+    CHECK(sc8_profileRoutines(profile, routines, 8) == 4);
+    static const sc8_routineProfile expected[] = {
+        { 0x200, 1, CALLS_DONE + SPINS, 3 + SPINS },
+        { 0x310, 2, 8, 4 },
+        { 0x300, 1, 7, 3 },
+        { 0x420, 2, 4, 4 },
+    };
+    for(int r = 0; r < 4; r++) {
+        if(routines[r].routine != expected[r].routine || routines[r].calls != expected[r].calls ||
+           routines[r].inclusive != expected[r].inclusive || routines[r].exclusive != expected[r].exclusive) {
+            printf("%s:%d: failed: routine #%d is %03X, %llu calls, %llu/%llu instructions\n", __FILE__, __LINE__, r,
+                   routines[r].routine, (unsigned long long)routines[r].calls,
+                   (unsigned long long)routines[r].inclusive, (unsigned long long)routines[r].exclusive);
+            failures++;
+        }
+    }
+
+    sc8_callEdge edges[8];
+    CHECK(sc8_profileEdges(profile, edges, 8) == 4);
+    CHECK(edges[0].caller == 0x310 && edges[0].callee == 0x420 && edges[0].calls == 2);
+    uint32_t others = 0;
+    for(int n = 1; n < 4; n++) {
+        CHECK(edges[n].calls == 1);
+        others |= (edges[n].caller == 0x200 && edges[n].callee == 0x300) << 0 |
+                  (edges[n].caller == 0x300 && edges[n].callee == 0x310) << 1 |
+                  (edges[n].caller == 0x200 && edges[n].callee == 0x310) << 2;
+    }
+    CHECK(others == 7);
+}
+
+static void run(const char *how, bool many, bool cached) {
+    static uint8_t rom[0x224];
+    for(size_t c = 0; c < sizeof(code) / sizeof(code[0]); c++) {
+        rom[code[c].addr - 0x200] = code[c].opcode >> 8;
+        rom[code[c].addr - 0x200 + 1] = code[c].opcode & 0xFF;
+    }
+    static sc8_state state;
+    static sc8_blockCache cache;
+    static sc8_profile profile;
+    sc8_init(&state);
+    sc8_loadRom(&state, rom, sizeof(rom));
+    if(cached) {
+        sc8_attachCache(&state, &cache);
+    }
+    sc8_attachProfile(&state, &profile);
+
+    uint32_t done = 0;
+    while(done < CALLS_DONE + SPINS) {
+        // the bad 00EE stops a run like an unknown opcode, and counts
+        done += many ? sc8_stepMany(&state, CALLS_DONE + SPINS - done) : (sc8_step(&state), 1);
+    }
+    // the guest returned where it called from every time
+    if(state.pc != 0x206 || state.sp != 0 || state.v[0] != 2) {
+        printf("%s:%d: failed: %s ends at %03X with sp %u, V0 %02X\n", __FILE__, __LINE__, how, state.pc, state.sp,
+               state.v[0]);
+        failures++;
+    }
+    checkTree(&profile);
+}
+
+int main(void) {
+    run("sc8_step", false, false);
+    run("sc8_stepMany", true, false);
+    run("sc8_stepMany with a cache", true, true);
+    if(failures > 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("call tree: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,234 @@
+// Snapshot and rewind test.
+//
+// usage: sc8_test_rewind
+//
+// Round-trips a ROM that touches everything a snapshot holds through `sc8_takeSnapshot`/
+// `sc8_restoreSnapshot`, then pushes a long run frame by frame into rewind rings of a few
+// budgets and pops it all back, checking every frame comes back as it was recorded, across
+// keyframes, after the oldest frames got evicted and with pushes and pops interleaved.
+// Prints every check that fails and exits with 1, 0 when there's none.
+
+#include <stdio.h>
+
+#define SC8_USE_STDIO
+#include "../smallCHIP-8.h"
+
+void sc8_beep(void) {}
+
+#define INSTRUCTIONS_PER_FRAME 15
+#define FRAMES 1000
+
+static int failures;
+
+#define CHECK(condition)                                                    \
+    do {                                                                    \
+        if(!(condition)) {                                                  \
+            printf("%s:%d: failed: %s\n", __FILE__, __LINE__, #condition);  \
+            failures++;                                                     \
+        }                                                                   \
+    } while(0)
+
+static const uint8_t rom[] = {
+    0x6A, 0x00, // 200  LD VA, 0
+    0xC0, 0x3F, // 202  RND V0, 3F
+    0xC1, 0x1F, // 204  RND V1, 1F
+    0xF2, 0x29, // 206  LD F, V2
+    0xD0, 0x15, // 208  DRW V0, V1, 5
+    0xA3, 0x00, // 20A  LD I, 300
+    0xFA, 0x1E, // 20C  ADD I, VA
+    0xF2, 0x33, // 20E  LD B, V2
+    0x72, 0x01, // 210  ADD V2, 1
+    0xE5, 0x9E, // 212  SKP V5
+    0x73, 0x01, // 214  ADD V3, 1
+    0xF3, 0x18, // 216  LD ST, V3
+    0xF4, 0x15, // 218  LD DT, V4
+    0x74, 0x05, // 21A  ADD V4, 5
+    0xF4, 0x55, // 21C  LD [I], V4
+    0x7A, 0x03, // 21E  ADD VA, 3
+    0x3A, 0x60, // 220  SE VA, 60
+    0x12, 0x02, // 222  JP 202
+    0x22, 0x00, // 224  CALL 200, never returns: the stack fills up, then overflows
+    0xF6, 0x0A, // 226  LD V6, K, once it has
+    0x12, 0x00, // 228  JP 200
+};
+
+static uint32_t nextKey(uint32_t *seed) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+}
+
+// Plays one frame, with key events out of `seed`.
+static void playFrame(sc8_state *state, uint32_t *seed) {
+    const uint32_t roll = nextKey(seed);
+    if(roll % 4 == 0) {
+        const uint8_t key = (roll >> 8) % 8;
+        if(state->key[key]) {
+            sc8_keyUp(state, key, state->cycles + state->idle + (roll >> 16) % 16);
+        } else {
+            sc8_keyDown(state, key, state->cycles + state->idle + (roll >> 16) % 16);
+        }
+    }
+    const uint64_t frame = state->frames;
+    while(state->frames == frame) {
+        sc8_runFrame(state, INSTRUCTIONS_PER_FRAME);
+    }
+}
+
+static sc8_state state, other;
+static uint64_t hashes[FRAMES];
+
+static void snapshots(void) {
+    static sc8_snapshot snap, again;
+    sc8_init(&state);
+    sc8_loadRom(&state, rom, sizeof(rom));
+    sc8_init(&other);
+    sc8_loadRom(&other, rom, sizeof(rom));
+    uint32_t seed = 2463534242u;
+    uint32_t seed_other = 88172645u;
+
+    for(uint32_t frame = 0; frame < 900; frame++) {
+        playFrame(&state, &seed);
+        playFrame(&other, &seed_other);
+        if(frame % 7 != 0) {
+            continue;
+        }
+        sc8_takeSnapshot(&snap, &state);
+        other.dirtyRows = 0;
+        sc8_restoreSnapshot(&other, &snap);
+        CHECK(sc8_stateHash(&other) == sc8_stateHash(&state));
+        CHECK(other.idle == state.idle && other.frameCycles == state.frameCycles);
+        // taking it again gives the same bytes, padding included
+        sc8_takeSnapshot(&again, &other);
+        CHECK(memcmp(&snap, &again, sizeof(snap)) == 0);
+
+        // both play on the same, given the key events still queued (not part of a snapshot)
+        other.keyQueue = state.keyQueue;
+        uint32_t seed_copy = seed;
+        for(int f = 0; f < 7; f++) {
+            playFrame(&state, &seed);
+            playFrame(&other, &seed_copy);
+        }
+        CHECK(sc8_stateHash(&other) == sc8_stateHash(&state));
+        frame += 7;
+
+        // every row that changes gets marked dirty, and only those
+        sc8_takeSnapshot(&snap, &state);
+        other.gfx[3] ^= 0x100;
+        other.gfx[20] ^= 1;
+        other.dirtyRows = 0;
+        sc8_restoreSnapshot(&other, &snap);
+        CHECK(other.dirtyRows == ((uint32_t)1 << 3 | (uint32_t)1 << 20));
+        CHECK(sc8_stateHash(&other) == sc8_stateHash(&state));
+        seed_other = seed;
+    }
+    CHECK(state.cycles > 0 && state.idle > 0 && state.sp > 0);
+}
+
+// Pushes `FRAMES` frames into a ring of `size` bytes, then pops them all back. Returns how
+// many it held at the end.
+static uint32_t pushThenPop(size_t size) {
+    static uint8_t buffer[4 << 20];
+    static sc8_rewind rewind;
+    sc8_rewindInit(&rewind, buffer, size);
+    sc8_init(&state);
+    sc8_loadRom(&state, rom, sizeof(rom));
+
+    uint32_t seed = 2463534242u;
+    uint32_t held = 0;
+    for(uint32_t frame = 0; frame < FRAMES; frame++) {
+        playFrame(&state, &seed);
+        hashes[frame] = sc8_stateHash(&state);
+        sc8_rewindPush(&rewind, &state);
+        // never more than one more, and only fewer when the budget ran out
+        const uint32_t frames = sc8_rewindFrames(&rewind);
+        CHECK(frames <= held + 1 && frames <= frame + 1);
+        held = frames;
+    }
+    CHECK(held > 0);
+
+    // pop back into a state that has moved on
+    playFrame(&state, &seed);
+    for(uint32_t n = 0; n < held; n++) {
+        if(!sc8_rewindPop(&rewind, &state) || sc8_stateHash(&state) != hashes[FRAMES - 1 - n]) {
+            printf("%s:%d: failed: popping %u of %u frames from a %zu byte ring\n", __FILE__, __LINE__, n + 1, held, size);
+            failures++;
+            break;
+        }
+        CHECK(sc8_rewindFrames(&rewind) == held - 1 - n);
+    }
+    CHECK(!sc8_rewindPop(&rewind, &state));
+    CHECK(sc8_stateHash(&state) == hashes[FRAMES - held]);
+    return held;
+}
+
+// Rewinds a few frames now and then and plays on from there, the way a player holding the
+// rewind key does, then checks the ring holds the run the state really took.
+static void backAndForth(void) {
+    static uint8_t buffer[1 << 20];
+    static sc8_rewind rewind;
+    sc8_rewindInit(&rewind, buffer, sizeof(buffer));
+    sc8_init(&state);
+    sc8_loadRom(&state, rom, sizeof(rom));
+
+    uint32_t seed = 2463534242u;
+    uint32_t top = 0; // frames in `hashes`, the same as in the ring
+    for(uint32_t step = 0; step < FRAMES; step++) {
+        const uint32_t roll = nextKey(&seed);
+        if(roll % 5 == 0 && top > 0) {
+            // back by up to 150 frames, past a keyframe more often than not
+            const uint32_t back = 1 + (roll >> 8) % SC8_MIN(top, 150);
+            for(uint32_t n = 0; n < back; n++) {
+                CHECK(sc8_rewindPop(&rewind, &state));
+                top--;
+                CHECK(sc8_stateHash(&state) == hashes[top]);
+            }
+            state.keyQueue.tail = state.keyQueue.head; // a rewound player lets go of what was queued
+            // the newest frame left is the state we're in again
+            sc8_rewindPush(&rewind, &state);
+            top++;
+        }
+        playFrame(&state, &seed);
+        hashes[top++] = sc8_stateHash(&state);
+        sc8_rewindPush(&rewind, &state);
+        CHECK(sc8_rewindFrames(&rewind) == top);
+    }
+    while(top > 0) {
+        CHECK(sc8_rewindPop(&rewind, &state));
+        top--;
+        CHECK(sc8_stateHash(&state) == hashes[top]);
+    }
+    CHECK(!sc8_rewindPop(&rewind, &state));
+}
+
+int main(void) {
+    snapshots();
+
+    // all of it, then budgets that only hold a few keyframes' worth or fewer
+    CHECK(pushThenPop(4 << 20) == FRAMES);
+    const uint32_t some = pushThenPop(64 << 10);
+    CHECK(some > 0 && some < FRAMES);
+    CHECK(pushThenPop(16 << 10) < some);
+    // room for a keyframe and not much more
+    sc8_snapshot snap;
+    sc8_takeSnapshot(&snap, &state);
+    CHECK(pushThenPop(sizeof(snap) + 64) > 0);
+
+    // too small for a single frame: nothing is held
+    static uint8_t tiny[16];
+    static sc8_rewind rewind;
+    sc8_rewindInit(&rewind, tiny, sizeof(tiny));
+    sc8_rewindPush(&rewind, &state);
+    CHECK(sc8_rewindFrames(&rewind) == 0);
+    CHECK(!sc8_rewindPop(&rewind, &state));
+
+    backAndForth();
+
+    if(failures > 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("snapshots and rewind: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,189 @@
+// Save state test.
+//
+// usage: sc8_test_savestate
+//
+// Round-trips a ROM that touches everything a save state holds (screen, memory past the ROM,
+// stack, timers, keys, the RNG) through `sc8_saveState`/`sc8_loadState` at many points of a
+// run and checks the loaded state hashes the same and plays on the same. Then checks the
+// failure cases: buffers too small, truncated or corrupt images, the wrong ROM or version,
+// none of which may touch the state they're loaded into.
+// Prints every check that fails and exits with 1, 0 when there's none.
+
+#include <stdio.h>
+
+#define SC8_USE_STDIO
+#include "../smallCHIP-8.h"
+
+void sc8_beep(void) {}
+
+#define INSTRUCTIONS_PER_FRAME 15
+
+static int failures;
+
+#define CHECK(condition)                                                    \
+    do {                                                                    \
+        if(!(condition)) {                                                  \
+            printf("%s:%d: failed: %s\n", __FILE__, __LINE__, #condition);  \
+            failures++;                                                     \
+        }                                                                   \
+    } while(0)
+
+static const uint8_t rom[] = {
+    0x6A, 0x00, // 200  LD VA, 0
+    0xC0, 0x3F, // 202  RND V0, 3F
+    0xC1, 0x1F, // 204  RND V1, 1F
+    0xF2, 0x29, // 206  LD F, V2
+    0xD0, 0x15, // 208  DRW V0, V1, 5
+    0xA3, 0x00, // 20A  LD I, 300
+    0xFA, 0x1E, // 20C  ADD I, VA
+    0xF2, 0x33, // 20E  LD B, V2
+    0x72, 0x01, // 210  ADD V2, 1
+    0xE5, 0x9E, // 212  SKP V5
+    0x73, 0x01, // 214  ADD V3, 1
+    0xF3, 0x18, // 216  LD ST, V3
+    0xF4, 0x15, // 218  LD DT, V4
+    0x74, 0x05, // 21A  ADD V4, 5
+    0xF4, 0x55, // 21C  LD [I], V4
+    0x7A, 0x03, // 21E  ADD VA, 3
+    0x3A, 0x60, // 220  SE VA, 60
+    0x12, 0x02, // 222  JP 202
+    0x22, 0x00, // 224  CALL 200, never returns: the stack fills up, then overflows
+    0xF6, 0x0A, // 226  LD V6, K, once it has
+    0x12, 0x00, // 228  JP 200
+};
+
+static uint32_t nextKey(uint32_t *seed) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+}
+
+// Plays `frames` frames, with key events out of `seed`.
+static void play(sc8_state *state, uint32_t frames, uint32_t *seed) {
+    for(uint32_t f = 0; f < frames; f++) {
+        const uint32_t roll = nextKey(seed);
+        if(roll % 4 == 0) {
+            const uint8_t key = (roll >> 8) % 8;
+            if(state->key[key]) {
+                sc8_keyUp(state, key, state->cycles + state->idle + (roll >> 16) % 16);
+            } else {
+                sc8_keyDown(state, key, state->cycles + state->idle + (roll >> 16) % 16);
+            }
+        }
+        const uint64_t frame = state->frames;
+        while(state->frames == frame) {
+            sc8_runFrame(state, INSTRUCTIONS_PER_FRAME);
+        }
+    }
+}
+
+static uint8_t image[SC8_STATE_MAX], again[SC8_STATE_MAX];
+
+static void roundTrips(void) {
+    static sc8_state state, loaded;
+    sc8_init(&state);
+    sc8_loadRom(&state, rom, sizeof(rom));
+
+    const size_t fresh = sc8_saveState(&state, rom, sizeof(rom), image, sizeof(image));
+    CHECK(fresh > 0 && fresh <= 128); // a fresh state is tiny
+
+    uint32_t seed = 2463534242u;
+    for(uint32_t frame = 0; frame < 900; frame += 23) {
+        const size_t size = sc8_saveState(&state, rom, sizeof(rom), image, sizeof(image));
+        CHECK(size > 0);
+
+        sc8_init(&loaded);
+        CHECK(sc8_loadState(&loaded, rom, sizeof(rom), image, size) == sc8_loadState_OK);
+        CHECK(sc8_stateHash(&loaded) == sc8_stateHash(&state));
+        CHECK(loaded.idle == state.idle && loaded.frameCycles == state.frameCycles);
+        // saving it again gives the same bytes
+        CHECK(sc8_saveState(&loaded, rom, sizeof(rom), again, sizeof(again)) == size && memcmp(image, again, size) == 0);
+
+        // both play on the same, given the key events still queued (not part of a save state)
+        loaded.keyQueue = state.keyQueue;
+        uint32_t seed_loaded = seed;
+        play(&state, 23, &seed);
+        play(&loaded, 23, &seed_loaded);
+        CHECK(sc8_stateHash(&loaded) == sc8_stateHash(&state));
+    }
+    uint64_t lit = 0;
+    for(int row = 0; row < SC8_H; row++) {
+        lit |= state.gfx[row];
+    }
+    CHECK(state.cycles > 0 && state.idle > 0 && lit != 0); // it did run, wait and draw
+
+    // the biggest there can be: memory all different from the ROM, every row lit
+    uint32_t noise = 88172645u;
+    for(int addr = 0; addr < MEMORY_SIZE; addr++) {
+        state.memory[addr] = (uint8_t)nextKey(&noise);
+    }
+    for(int row = 0; row < SC8_H; row++) {
+        state.gfx[row] = (uint64_t)nextKey(&noise) << 32 | nextKey(&noise) | 1;
+    }
+    const size_t size = sc8_saveState(&state, rom, sizeof(rom), image, sizeof(image));
+    CHECK(size > 0 && size <= SC8_STATE_MAX);
+    sc8_init(&loaded);
+    CHECK(sc8_loadState(&loaded, rom, sizeof(rom), image, size) == sc8_loadState_OK);
+    CHECK(sc8_stateHash(&loaded) == sc8_stateHash(&state));
+}
+
+static void failedLoads(void) {
+    static sc8_state state, target;
+    sc8_init(&state);
+    sc8_loadRom(&state, rom, sizeof(rom));
+    uint32_t seed = 2463534242u;
+    play(&state, 100, &seed);
+    const size_t size = sc8_saveState(&state, rom, sizeof(rom), image, sizeof(image));
+    CHECK(size > 0);
+
+    // too small a buffer
+    CHECK(sc8_saveState(&state, rom, sizeof(rom), again, size - 1) == 0);
+    CHECK(sc8_saveState(&state, rom, sizeof(rom), again, 0) == 0);
+    CHECK(sc8_saveState(&state, rom, sizeof(rom), again, size) == size);
+
+    sc8_init(&target);
+    sc8_loadRom(&target, rom, sizeof(rom));
+    play(&target, 10, &seed);
+    const uint64_t before = sc8_stateHash(&target);
+
+    // every truncation
+    for(size_t cut = 0; cut < size; cut++) {
+        if(sc8_loadState(&target, rom, sizeof(rom), image, cut) != sc8_loadState_BadImage) {
+            printf("%s:%d: failed: an image cut to %zu of %zu bytes loaded\n", __FILE__, __LINE__, cut, size);
+            failures++;
+            break;
+        }
+    }
+    CHECK(sc8_stateHash(&target) == before);
+
+    // not a save state
+    memcpy(again, image, size);
+    again[0] ^= 0xFF;
+    CHECK(sc8_loadState(&target, rom, sizeof(rom), again, size) == sc8_loadState_BadImage);
+
+    // saved by another version
+    memcpy(again, image, size);
+    again[4]++;
+    CHECK(sc8_loadState(&target, rom, sizeof(rom), again, size) == sc8_loadState_BadVersion);
+
+    // the wrong ROM: one byte off, one byte short
+    static uint8_t other[sizeof(rom)];
+    memcpy(other, rom, sizeof(rom));
+    other[5] ^= 1;
+    CHECK(sc8_loadState(&target, other, sizeof(other), image, size) == sc8_loadState_WrongROM);
+    CHECK(sc8_loadState(&target, rom, sizeof(rom) - 1, image, size) == sc8_loadState_WrongROM);
+
+    CHECK(sc8_stateHash(&target) == before);
+}
+
+int main(void) {
+    roundTrips();
+    failedLoads();
+    if(failures > 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("save states: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,342 @@
+// Ahead of time ROM to C translator.
+//
+// usage: sc8_aot <rom.ch8> <out.c> [name]
+//
+// Recovers the control flow of the ROM (jump/call targets, both sides of every skip) and writes
+// out a C file with `uint32_t sc8aot_<name>_run(sc8_state *state, uint32_t count)`, which behaves
+// like `sc8_stepMany` for that ROM. Every reachable instruction becomes a call to its handler with
+// a constant opcode, so the compiler folds the decoding away, and branches become gotos.
+// Since smallCHIP-8.h always carries its implementation, #include the output right after it
+// instead of compiling it on its own.
+//
+// Anything the translation can't know ahead of time goes through the interpreter: `BNNN`
+// (and `00EE` returning anywhere but right after a translated `2NNN`) land on whatever
+// translated instruction they target or get interpreted one instruction at a time, and once the translated code is overwritten (or wasn't the same ROM
+// to begin with) the rest of the call is handed to the interpreter.
+// Key events are applied between runs of translated code, at the same cycles as everywhere else.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#define SC8_USE_STDIO
+#include "../smallCHIP-8.h"
+
+// never called, the tool only needs the decoder
+void sc8_beep(void) {}
+
+static const char *kindNames[] = {
+#define SC8__KIND_NAME(name) #name,
+    SC8__KINDS(SC8__KIND_NAME)
+#undef SC8__KIND_NAME
+};
+
+#define ROM_START 0x200
+
+static uint8_t memory[MEMORY_SIZE];
+static size_t romSize;
+static bool reachable[MEMORY_SIZE]; // an instruction starts here
+static bool code[MEMORY_SIZE];      // byte belongs to a reachable instruction
+static bool returnSite[MEMORY_SIZE]; // right after a reachable 2NNN, where its 00EE comes back to
+static bool returns;                // a 00EE is reachable
+
+static bool inRom(size_t addr) {
+    return addr >= ROM_START && addr + 1 < ROM_START + romSize;
+}
+
+static uint16_t opcodeAt(size_t addr) {
+    return memory[addr] << 8 | memory[addr + 1];
+}
+
+// Worklist walk from the entry point. Successors of each instruction:
+//   1NNN, 2NNN  -> NNN (and pc + 2 for calls, where 00EE comes back to: the stack holds the
+//                  2NNN's own address and 00EE goes to the one after it)
+//   skips       -> pc + 2 and pc + 4
+//   00EE, BNNN  -> nothing known ahead of time
+//   F0FF, unknown -> nothing, they stop the run
+//   the rest    -> pc + 2
+static void recoverCfg(void) {
+    static uint16_t work[MEMORY_SIZE * 2];
+    size_t top = 0;
+    work[top++] = ROM_START;
+    while(top > 0) {
+        const uint16_t pc = work[--top];
+        if(!inRom(pc) || reachable[pc]) {
+            continue;
+        }
+        reachable[pc] = true;
+        code[pc] = code[pc + 1] = true;
+
+        const uint16_t opcode = opcodeAt(pc);
+        switch(sc8__decode(opcode)) {
+            case sc8__kindJP:
+                work[top++] = SC8_NNN(opcode);
+                break;
+            case sc8__kindCALL:
+                work[top++] = SC8_NNN(opcode);
+                work[top++] = pc + 2;
+                returnSite[pc + 2] = true;
+                break;
+            case sc8__kindSEi: case sc8__kindSNEi: case sc8__kindSE: case sc8__kindSNE:
+            case sc8__kindSKP: case sc8__kindSKNP:
+                work[top++] = pc + 2;
+                work[top++] = pc + 4;
+                break;
+            case sc8__kindRET:
+                returns = true;
+                break;
+            case sc8__kindJPV0: case sc8__kindHALT:
+            case sc8__kindUnknown: case sc8__kindUnknown8:
+                break;
+            default:
+                work[top++] = pc + 2;
+                break;
+        }
+    }
+}
+
+// goto the translation of `target` if there is one, back to the dispatch otherwise
+static void emitGoto(FILE *out, size_t target) {
+    if(target < MEMORY_SIZE && reachable[target]) {
+        fprintf(out, "goto at%03zX;", target);
+    } else {
+        fprintf(out, "goto dispatch;");
+    }
+}
+
+static void emit(FILE *out, const char *name, const char *romPath) {
+    fprintf(out, "// Generated by tools/sc8_aot.c from %s, don't edit.\n", romPath);
+    fprintf(out, "// #include it right after smallCHIP-8.h.\n\n");
+
+    fprintf(out, "static const uint8_t sc8aot_%s_rom[%zu] = {", name, romSize);
+    for(size_t i = 0; i < romSize; i++) {
+        fprintf(out, "%s0x%02X,", (i % 16 == 0) ? "\n    " : " ", memory[ROM_START + i]);
+    }
+    fprintf(out, "\n};\n\n");
+
+    // runs of bytes the translation was made from
+    fprintf(out, "static const uint16_t sc8aot_%s_code[][2] = {\n", name);
+    size_t ranges = 0;
+    for(size_t addr = ROM_START; addr < ROM_START + romSize; addr++) {
+        if(code[addr] && !code[addr - 1]) {
+            size_t end = addr;
+            while(end < ROM_START + romSize && code[end]) {
+                end++;
+            }
+            fprintf(out, "    { 0x%03zX, 0x%03zX },\n", addr, end);
+            ranges++;
+        }
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out,
+        "static inline bool sc8aot_%s_intact(const sc8_state *state) {\n"
+        "    for(size_t r = 0; r < %zu; r++) {\n"
+        "        const uint16_t from = sc8aot_%s_code[r][0], to = sc8aot_%s_code[r][1];\n"
+        "        if(memcmp(state->memory + from, sc8aot_%s_rom + (from - 0x%03X), to - from) != 0) {\n"
+        "            return false;\n"
+        "        }\n"
+        "    }\n"
+        "    return true;\n"
+        "}\n\n",
+        name, ranges, name, name, name, ROM_START);
+
+    fprintf(out,
+        "static inline bool sc8aot_%s_overwrites(uint16_t addr, size_t len) {\n"
+        "    for(size_t r = 0; r < %zu; r++) {\n"
+        "        if(addr < sc8aot_%s_code[r][1] && addr + len > sc8aot_%s_code[r][0]) {\n"
+        "            return true;\n"
+        "        }\n"
+        "    }\n"
+        "    return false;\n"
+        "}\n\n",
+        name, ranges, name, name);
+
+    fprintf(out,
+        "#define SC8AOT_STEP(name, op)        \\\n"
+        "    if(done == count) {              \\\n"
+        "        return done;                 \\\n"
+        "    }                                \\\n"
+        "    state->opcode = op;              \\\n"
+        "    sc8__op##name(state, op);        \\\n"
+        "    sc8__tickTimers(state);          \\\n"
+        "    state->cycles++;                 \\\n"
+        "    done++;\n\n");
+    // Fx0A and F0FF, which don't count while they wait, and 2NNN and 00EE,
+    // which stop (and count) when the stack can't take them
+    fprintf(out,
+        "#define SC8AOT_TRY(name, op)         \\\n"
+        "    if(done == count) {              \\\n"
+        "        return done;                 \\\n"
+        "    }                                \\\n"
+        "    state->opcode = op;              \\\n"
+        "    if(!sc8__op##name(state, op)) {  \\\n"
+        "        sc8__tickTimers(state);      \\\n"
+        "        *ok = false;                 \\\n"
+        "        if(state->wait != sc8_wait_None) { \\\n"
+        "            return done;             \\\n"
+        "        }                            \\\n"
+        "        state->cycles++;             \\\n"
+        "        return done + 1;             \\\n"
+        "    }                                \\\n"
+        "    sc8__tickTimers(state);          \\\n"
+        "    state->cycles++;                 \\\n"
+        "    done++;\n\n");
+
+    fprintf(out,
+        "static uint32_t sc8aot_%s_exec(sc8_state *state, uint32_t count, bool *ok) {\n"
+        "    if(!sc8aot_%s_intact(state)) {\n"
+        "        return sc8__run(state, count, ok);\n"
+        "    }\n"
+        "    uint32_t done = 0;\n"
+        "    *ok = true;\n\n"
+        "dispatch:\n"
+        "    switch(state->pc) {\n",
+        name, name);
+    for(size_t addr = 0; addr < MEMORY_SIZE; addr++) {
+        if(reachable[addr]) {
+            fprintf(out, "        case 0x%03zX: goto at%03zX;\n", addr, addr);
+        }
+    }
+    fprintf(out,
+        "    }\n"
+        "    // not translated, interpret a single instruction\n"
+        "    if(done == count) {\n"
+        "        return done;\n"
+        "    }\n"
+        "    {\n"
+        "        const uint16_t opcode = sc8__fetch(state);\n"
+        "        const uint8_t kind = sc8__decode(opcode);\n"
+        "        const uint16_t i = state->i;\n"
+        "        done += sc8__run(state, 1, ok);\n"
+        "        if(!*ok) {\n"
+        "            return done;\n"
+        "        }\n"
+        "        if((kind == sc8__kindLDB && sc8aot_%s_overwrites(i & (MEMORY_SIZE - 1), 3)) ||\n"
+        "           (kind == sc8__kindSTORE && sc8aot_%s_overwrites(i & (MEMORY_SIZE - 1), SC8_Vx(opcode)))) {\n"
+        "            return done + sc8__run(state, count - done, ok);\n"
+        "        }\n"
+        "    }\n"
+        "    goto dispatch;\n\n",
+        name, name);
+
+    // every 00EE comes here, a switch over the return sites only
+    if(returns) {
+        fprintf(out, "ret:\n    switch(state->pc) {\n");
+        for(size_t addr = 0; addr < MEMORY_SIZE; addr++) {
+            if(returnSite[addr] && reachable[addr]) {
+                fprintf(out, "        case 0x%03zX: goto at%03zX;\n", addr, addr);
+            }
+        }
+        fprintf(out, "    }\n    goto dispatch;\n\n");
+    }
+
+    for(size_t addr = 0; addr < MEMORY_SIZE; addr++) {
+        if(!reachable[addr]) {
+            continue;
+        }
+        const uint16_t opcode = opcodeAt(addr);
+        const uint8_t kind = sc8__decode(opcode);
+        const bool stops = kind == sc8__kindLDK || kind == sc8__kindHALT ||
+                           kind == sc8__kindCALL || kind == sc8__kindRET;
+        fprintf(out, "at%03zX:\n    SC8AOT_%s(%s, 0x%04X)\n    ", addr, stops ? "TRY" : "STEP", kindNames[kind], opcode);
+        switch(kind) {
+            case sc8__kindJP: case sc8__kindCALL:
+                emitGoto(out, SC8_NNN(opcode));
+                break;
+            case sc8__kindSEi: case sc8__kindSNEi: case sc8__kindSE: case sc8__kindSNE:
+            case sc8__kindSKP: case sc8__kindSKNP:
+                fprintf(out, "if(state->pc == 0x%03zX) { ", addr + 4);
+                emitGoto(out, addr + 4);
+                fprintf(out, " }\n    ");
+                emitGoto(out, addr + 2);
+                break;
+            case sc8__kindRET:
+                fprintf(out, "goto ret;");
+                break;
+            case sc8__kindJPV0:
+                fprintf(out, "goto dispatch;");
+                break;
+            case sc8__kindUnknown: case sc8__kindUnknown8:
+                fprintf(out, "*ok = false;\n    return done;");
+                break;
+            case sc8__kindHALT:
+                break; // SC8AOT_TRY already returned
+            case sc8__kindLDK:
+                emitGoto(out, addr + 2);
+                break;
+            case sc8__kindLDB: case sc8__kindSTORE:
+                fprintf(out, "if(sc8aot_%s_overwrites(state->i & (MEMORY_SIZE - 1), %d)) {\n"
+                             "        return done + sc8__run(state, count - done, ok);\n"
+                             "    }\n    ",
+                        name, (kind == sc8__kindLDB) ? 3 : SC8_Vx(opcode));
+                emitGoto(out, addr + 2);
+                break;
+            default:
+                emitGoto(out, addr + 2);
+                break;
+        }
+        fprintf(out, "\n");
+    }
+    fprintf(out, "}\n\n#undef SC8AOT_TRY\n#undef SC8AOT_STEP\n\n");
+
+    // same as `sc8_stepMany`: straight through to the next key event, apply it and carry on
+    fprintf(out,
+        "uint32_t sc8aot_%s_run(sc8_state *state, uint32_t count) {\n"
+        "    state->wait = sc8_wait_None;\n"
+        "    uint32_t done = 0;\n"
+        "    bool ok = true;\n"
+        "    while(ok && done < count) {\n"
+        "        const uint32_t until = sc8__applyKeys(state, done, count);\n"
+        "        done += sc8aot_%s_exec(state, until - done, &ok);\n"
+        "    }\n"
+        "    return done;\n"
+        "}\n",
+        name, name);
+}
+
+int main(int argc, char **argv) {
+    if(argc < 3) {
+        fprintf(stderr, "usage: %s <rom.ch8> <out.c> [name]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *f = fopen(argv[1], "rb");
+    if(f == NULL) {
+        fprintf(stderr, "Couldn't open %s\n", argv[1]);
+        return 1;
+    }
+    romSize = fread(memory + ROM_START, 1, MEMORY_SIZE - ROM_START, f);
+    fclose(f);
+    if(romSize == 0) {
+        fprintf(stderr, "%s is empty\n", argv[1]);
+        return 1;
+    }
+
+    // name defaults to the file name, minus the extension
+    char name[64];
+    const char *base = (argc > 3) ? argv[3] : argv[1];
+    if(argc <= 3) {
+        for(const char *p = argv[1]; *p; p++) {
+            if(*p == '/' || *p == '\\') {
+                base = p + 1;
+            }
+        }
+    }
+    size_t len = 0;
+    for(; base[len] && base[len] != '.' && len < sizeof(name) - 1; len++) {
+        name[len] = isalnum((unsigned char)base[len]) ? base[len] : '_';
+    }
+    name[len] = '\0';
+
+    recoverCfg();
+
+    FILE *out = fopen(argv[2], "w");
+    if(out == NULL) {
+        fprintf(stderr, "Couldn't open %s\n", argv[2]);
+        return 1;
+    }
+    emit(out, name, argv[1]);
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,420 @@
+// Divergence bisection between two engines.
+//
+// usage: sc8_bisect <rom.ch8> <movie.sc8m> [engine a] [engine b] [checkpoint every N frames]
+//
+// Engines: `step` (`sc8_step` one instruction at a time, the reference and the default for
+// a), `many` (`sc8_stepMany`, the default for b), `cache` (`sc8_stepMany` through a block
+// cache) and `jit` (`sc8_jitRun`). The interpreter core is whichever the tool was built with,
+// build it with `SC8_DISPATCH_THREADED` to put the threaded one under test.
+// `sc8_run` isn't one of them: it leaves the timers to its caller, once a frame, while all of
+// these tick them after every instruction, so the two can't share a frame loop.
+//
+// Both engines play the movie's key events from its first keyframe, each on its own, with
+// the same frame loop (a frame's worth of instructions, then the timers). Comparing them in
+// lockstep would take a state hash per instruction, so instead:
+//   1. each one plays the whole movie, hashing its state only at checkpoints; the first
+//      engine also keeps a snapshot there,
+//   2. the first checkpoint where the hashes differ bounds the divergence, both replay just
+//      that interval from the snapshot before it, hashing every frame,
+//   3. the first frame that differs gets bisected on instructions, replaying the start of
+//      it from a snapshot each time, down to the instruction that did it.
+// A divergence that sorts itself out before the next checkpoint goes unnoticed, lower the
+// checkpoint interval to look closer.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define SC8_JIT
+#define SC8_USE_STDIO
+#include "../smallCHIP-8.h"
+
+void sc8_beep(void) {}
+
+#define CHECKPOINT_EVERY 600 // 10 seconds
+#define MAX_DIFFS 16
+
+static uint8_t *readFile(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if(f == NULL) {
+        fprintf(stderr, "Couldn't open %s\n", path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(*size + 1);
+    if(data == NULL || fread(data, 1, *size, f) != *size) {
+        fprintf(stderr, "Couldn't read %s\n", path);
+        fclose(f);
+        free(data);
+        return NULL;
+    }
+    fclose(f);
+    return data;
+}
+
+static uint64_t nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Engines.
+
+static uint32_t runStep(sc8_state *state, uint32_t count) {
+    uint32_t done = 0;
+    while(done < count) {
+        if(!sc8_step(state)) {
+            return done + (state->wait == sc8_wait_None); // a wait didn't run
+        }
+        done++;
+    }
+    return done;
+}
+
+typedef struct {
+    const char *name;
+    uint32_t (*run)(sc8_state *state, uint32_t count);
+    bool cached;
+    bool jitted;
+} Engine;
+
+static const Engine engines[] = {
+    { "step", runStep, false, false },
+    { "many", sc8_stepMany, false, false },
+    { "cache", sc8_stepMany, true, false },
+    { "jit", sc8_jitRun, false, true },
+};
+
+static const Engine *findEngine(const char *name) {
+    for(size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+        if(strcmp(engines[e].name, name) == 0) {
+            return &engines[e];
+        }
+    }
+    return NULL;
+}
+
+// Sides: an engine and the state it plays the movie on.
+
+typedef struct {
+    const Engine *engine;
+    sc8_state state;
+    uint32_t nextEvent; // movie events pushed to `state` so far
+} Side;
+
+// Everything a side needs to carry on from a frame.
+typedef struct {
+    sc8_snapshot snapshot;
+    sc8_keyQueue keys;
+    uint32_t nextEvent;
+} Checkpoint;
+
+static sc8_movie movie;
+static Side sides[2];
+static sc8_blockCache caches[2];
+static sc8_jit jits[2];
+
+static void takeCheckpoint(Checkpoint *checkpoint, const Side *side) {
+    sc8_takeSnapshot(&checkpoint->snapshot, &side->state);
+    checkpoint->keys = side->state.keyQueue;
+    checkpoint->nextEvent = side->nextEvent;
+}
+
+static void restoreCheckpoint(Side *side, const Checkpoint *checkpoint) {
+    sc8_restoreSnapshot(&side->state, &checkpoint->snapshot);
+    side->state.keyQueue = checkpoint->keys;
+    side->nextEvent = checkpoint->nextEvent;
+}
+
+// Queues what fits of the movie's key events, like `sc8_moviePlayFrame`. Returns how far
+// (in `cycles + idle`) the side can run before the queue needs room, UINT64_MAX once
+// they're all in.
+static uint64_t pushKeys(Side *side) {
+    for(; side->nextEvent < movie.info.events; side->nextEvent++) {
+        const uint8_t *event = movie.events + (size_t)side->nextEvent * SC8__MOVIE_EVENT;
+        if(!sc8__pushKey(&side->state, event[8], event[9], sc8__movieRead(event, 8))) {
+            return sc8__movieRead(event - SC8__MOVIE_EVENT, 8); // the newest one queued
+        }
+    }
+    return UINT64_MAX;
+}
+
+// Runs up to `count` instructions of the current frame, stopping early only where the frame
+// would (waiting on a key, halted). Returns whether it stopped early.
+static bool runInstructions(Side *side, uint32_t count) {
+    sc8_state *state = &side->state;
+    uint32_t done = 0;
+    while(done < count) {
+        const uint64_t until = pushKeys(side);
+        const uint64_t clock = state->cycles + state->idle;
+        if(clock >= until) {
+            sc8__applyKeys(state, 0, 0); // all of them are due, make room for the rest
+            continue;
+        }
+        const uint32_t n = side->engine->run(state, (uint32_t)SC8_MIN((uint64_t)(count - done), until - clock));
+        done += n;
+        state->frameCycles += n;
+        if(state->wait != sc8_wait_None) {
+            return true;
+        }
+        if(n == 0) {
+            break;
+        }
+        // short otherwise means a draw, an unknown opcode or a full key queue, the frame carries on
+    }
+    return false;
+}
+
+static void playFrame(Side *side) {
+    sc8_state *state = &side->state;
+    if(runInstructions(side, movie.info.instructionsPerFrame - state->frameCycles)) {
+        state->idle++; // the wait took up the rest of the frame, like in `sc8_runFrame`
+    }
+    sc8_tickTimers(state);
+    state->frameCycles = 0;
+    state->frames++;
+}
+
+// Plays frames [from, to) from `start` (taken at `from`) and writes the state hash after each
+// `every`th of them, and after the last, to `hashes`. Keeps checkpoints in `checkpoints` too
+// if it isn't NULL. Returns how long it took in ns.
+static uint64_t playHashing(Side *side, const Checkpoint *start, uint64_t from, uint64_t to, uint64_t every,
+                            uint64_t *hashes, Checkpoint *checkpoints) {
+    restoreCheckpoint(side, start);
+    const uint64_t began = nowNs();
+    for(uint64_t f = from; f < to; f++) {
+        playFrame(side);
+        const uint64_t played = f + 1 - from;
+        if(played % every == 0 || f + 1 == to) {
+            const uint64_t at = (played - 1) / every;
+            hashes[at] = sc8_stateHash(&side->state);
+            if(checkpoints != NULL) {
+                takeCheckpoint(&checkpoints[at], side);
+            }
+        }
+    }
+    return nowNs() - began;
+}
+
+// Reports.
+
+static void printState(const char *name, const sc8_snapshot *snap) {
+    printf("  %-5s pc %03X  I %03X  sp %X  dt %02X  st %02X  V", name, snap->pc, snap->i, snap->sp, snap->dt, snap->st);
+    for(int x = 0; x < 16; x++) {
+        printf(" %02X", snap->v[x]);
+    }
+    printf("\n");
+}
+
+// Prints what differs between the two, the first `MAX_DIFFS` of it at most.
+static void printDiff(const sc8_snapshot *a, const sc8_snapshot *b) {
+    int shown = 0;
+#define DIFF(what, format, x, y)                                   \
+    if((x) != (y) && shown++ < MAX_DIFFS) {                        \
+        printf("  %-14s " format "  vs  " format "\n", what, x, y); \
+    }
+    char what[32];
+    DIFF("pc", "%03X", a->pc, b->pc);
+    DIFF("I", "%03X", a->i, b->i);
+    for(int x = 0; x < 16; x++) {
+        snprintf(what, sizeof(what), "V%X", x);
+        DIFF(what, "%02X", a->v[x], b->v[x]);
+    }
+    DIFF("sp", "%X", a->sp, b->sp);
+    for(int s = 0; s < 16; s++) {
+        snprintf(what, sizeof(what), "stack[%X]", s);
+        DIFF(what, "%03X", a->stack[s], b->stack[s]);
+    }
+    DIFF("dt", "%02X", a->dt, b->dt);
+    DIFF("st", "%02X", a->st, b->st);
+    DIFF("cycles", "%llu", (unsigned long long)a->cycles, (unsigned long long)b->cycles);
+    DIFF("frame cycles", "%u", a->frameCycles, b->frameCycles);
+    DIFF("idle", "%llu", (unsigned long long)a->idle, (unsigned long long)b->idle);
+    DIFF("wait", "%u", a->wait, b->wait);
+    DIFF("flags", "%X", a->flags, b->flags);
+    DIFF("keys", "%04X", a->keys, b->keys);
+    DIFF("keys pressed", "%04X", a->keysPressed, b->keysPressed);
+    DIFF("keys released", "%04X", a->keysReleased, b->keysReleased);
+    DIFF("rand", "%08X", a->xorRandState, b->xorRandState);
+    for(int addr = 0; addr < MEMORY_SIZE; addr++) {
+        snprintf(what, sizeof(what), "memory[%03X]", addr);
+        DIFF(what, "%02X", a->memory[addr], b->memory[addr]);
+    }
+    for(int row = 0; row < SC8_H; row++) {
+        snprintf(what, sizeof(what), "row %d", row);
+        DIFF(what, "%016llX", (unsigned long long)a->gfx[row], (unsigned long long)b->gfx[row]);
+    }
+#undef DIFF
+    if(shown > MAX_DIFFS) {
+        printf("  and %d more\n", shown - MAX_DIFFS);
+    }
+}
+
+// Bisects the frame starting at `start` down to the first instruction after which the two
+// differ. Returns how many instructions in that is, 0 when they only differ at the end of the
+// frame (the wait or the timers).
+static uint32_t bisectFrame(const Checkpoint *start) {
+    sc8_snapshot a, b;
+    uint32_t good = 0, bad = movie.info.instructionsPerFrame + 1;
+    while(bad - good > 1) {
+        const uint32_t mid = good + (bad - good) / 2;
+        for(int s = 0; s < 2; s++) {
+            restoreCheckpoint(&sides[s], start);
+            runInstructions(&sides[s], mid);
+        }
+        sc8_takeSnapshot(&a, &sides[0].state);
+        sc8_takeSnapshot(&b, &sides[1].state);
+        if(memcmp(&a, &b, sizeof(a)) == 0) {
+            good = mid;
+        } else {
+            bad = mid;
+        }
+    }
+    return (bad > movie.info.instructionsPerFrame) ? 0 : bad;
+}
+
+static int bisect(const uint8_t *rom, size_t rom_size, uint64_t every) {
+    const uint64_t frames = movie.info.frames;
+    const uint64_t count = SC8_MAX((frames + every - 1) / every, 1);
+    uint64_t *hashes[2] = { calloc(count, sizeof(uint64_t)), calloc(count, sizeof(uint64_t)) };
+    Checkpoint *checkpoints = calloc(count + 1, sizeof(Checkpoint));
+    Checkpoint *start = &checkpoints[count]; // kept at the end so checkpoint k - 1 is at [k - 1]
+    uint64_t *frame_hashes[2] = { calloc(every, sizeof(uint64_t)), calloc(every, sizeof(uint64_t)) };
+
+    for(int s = 0; s < 2; s++) {
+        Side *side = &sides[s];
+        sc8_init(&side->state);
+        if(side->engine->cached) {
+            sc8_attachCache(&side->state, &caches[s]);
+        }
+        if(side->engine->jitted) {
+            if(!sc8_jitInit(&jits[s])) {
+                fprintf(stderr, "The JIT isn't available here, `jit` runs `sc8_stepMany`\n");
+            }
+            sc8_attachJit(&side->state, &jits[s]);
+        }
+        const sc8_LoadStateResult result = sc8_movieSeek(&movie, &side->state, rom, rom_size, 0);
+        if(result != sc8_loadState_OK) {
+            fprintf(stderr, "Can't seek the movie, code: %d\n", result);
+            return 1;
+        }
+        side->nextEvent = movie.nextEvent;
+    }
+    takeCheckpoint(start, &sides[0]);
+
+    // 1. whole run, hashes at the checkpoints only
+    uint64_t ns[2];
+    ns[0] = playHashing(&sides[0], start, 0, frames, every, hashes[0], checkpoints);
+    ns[1] = playHashing(&sides[1], start, 0, frames, every, hashes[1], NULL);
+    printf("%llu frames, %s %.1f ms, %s %.1f ms, checkpoints every %llu frames\n", (unsigned long long)frames,
+           sides[0].engine->name, ns[0] / 1e6, sides[1].engine->name, ns[1] / 1e6, (unsigned long long)every);
+    uint64_t k = 0;
+    while(k < count && hashes[0][k] == hashes[1][k]) {
+        k++;
+    }
+    if(k == count) {
+        printf("No divergence\n");
+        return 0;
+    }
+    const uint64_t from = k * every;
+    const uint64_t to = SC8_MIN(from + every, frames);
+    printf("Diverged between frames %llu and %llu\n", (unsigned long long)from, (unsigned long long)to);
+
+    // 2. that interval again, hashing every frame
+    const Checkpoint *interval = (k == 0) ? start : &checkpoints[k - 1];
+    for(int s = 0; s < 2; s++) {
+        playHashing(&sides[s], interval, from, to, 1, frame_hashes[s], NULL);
+    }
+    uint64_t f = 0;
+    while(from + f < to && frame_hashes[0][f] == frame_hashes[1][f]) {
+        f++;
+    }
+    if(from + f == to) {
+        printf("They didn't diverge again when replayed from frame %llu, so it depends on more than a "
+               "snapshot holds (the JIT's or cache's own state?)\n", (unsigned long long)from);
+        return 1;
+    }
+    const uint64_t frame = from + f;
+    printf("First differing frame: %llu\n", (unsigned long long)frame);
+
+    // 3. that frame, bisected on instructions
+    Checkpoint before;
+    restoreCheckpoint(&sides[0], interval);
+    for(uint64_t g = from; g < frame; g++) {
+        playFrame(&sides[0]);
+    }
+    takeCheckpoint(&before, &sides[0]);
+    const uint32_t n = bisectFrame(&before);
+
+    sc8_snapshot a, b;
+    if(n == 0) {
+        printf("Every instruction of it matches, the end of the frame (key wait, timers) doesn't\n");
+        for(int s = 0; s < 2; s++) {
+            restoreCheckpoint(&sides[s], &before);
+            playFrame(&sides[s]);
+        }
+    } else {
+        restoreCheckpoint(&sides[0], &before);
+        runInstructions(&sides[0], n - 1);
+        sc8_snapshot previous;
+        sc8_takeSnapshot(&previous, &sides[0].state);
+        for(int s = 0; s < 2; s++) {
+            restoreCheckpoint(&sides[s], &before);
+            runInstructions(&sides[s], n);
+        }
+        // the opcode the first engine fetched, pc may be past the end of memory
+        const uint16_t opcode = sides[0].state.opcode;
+        printf("First differing instruction: #%u of the frame, cycle %llu, %03X %04X %s\n", n,
+               (unsigned long long)previous.cycles, previous.pc, opcode, sc8_kindName(sc8__decode(opcode)));
+        printState("before", &previous);
+    }
+    sc8_takeSnapshot(&a, &sides[0].state);
+    sc8_takeSnapshot(&b, &sides[1].state);
+    printState(sides[0].engine->name, &a);
+    printState(sides[1].engine->name, &b);
+    printf("%s vs %s:\n", sides[0].engine->name, sides[1].engine->name);
+    printDiff(&a, &b);
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    if(argc < 3) {
+        fprintf(stderr, "usage: %s <rom.ch8> <movie.sc8m> [engine a] [engine b] [checkpoint every N frames]\n"
+                        "engines: step, many, cache, jit\n", argv[0]);
+        return 1;
+    }
+    for(int s = 0; s < 2; s++) {
+        const char *name = (argc > 3 + s) ? argv[3 + s] : (s == 0) ? "step" : "many";
+        sides[s].engine = findEngine(name);
+        if(sides[s].engine == NULL) {
+            fprintf(stderr, "Unknown engine %s\n", name);
+            return 1;
+        }
+    }
+    const uint64_t every = (argc > 5) ? strtoull(argv[5], NULL, 0) : CHECKPOINT_EVERY;
+    if(every == 0) {
+        fprintf(stderr, "The checkpoint interval should be a positive number\n");
+        return 1;
+    }
+
+    size_t rom_size, size;
+    uint8_t *rom = readFile(argv[1], &rom_size);
+    uint8_t *data = readFile(argv[2], &size);
+    if(rom == NULL || data == NULL) {
+        return 1;
+    }
+    const sc8_LoadStateResult result = sc8_movieOpen(&movie, data, size, rom, rom_size);
+    if(result != sc8_loadState_OK) {
+        fprintf(stderr, "Can't play %s, code: %d\n", argv[2], result);
+        return 1;
+    }
+    const int status = bisect(rom, rom_size, every);
+    for(int s = 0; s < 2; s++) {
+        if(sides[s].engine->jitted) {
+            sc8_jitFree(&jits[s]);
+        }
+    }
+    return status;
+}
@@ -0,0 +1,233 @@
+// Movie recorder and verifier.
+//
+// usage: sc8_movie record <rom.ch8> <out.sc8m> <frames> [seed] [instructions per frame]
+//        sc8_movie verify <rom.ch8> <movie.sc8m> [jobs]
+//
+// `record` plays the ROM headless for that many frames, mashing random keys, and writes the
+// movie (handy for soak runs, the SDL renderer records real ones with `--record=`).
+// `verify` replays a movie and checks the state hash after every frame. The movie is split
+// at its keyframes and the pieces are checked by `jobs` worker threads at once (one per
+// core by default), each playing its own state.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define SC8_USE_STDIO
+#include "../smallCHIP-8.h"
+
+void sc8_beep(void) {}
+
+#define KEYFRAME_EVERY 600 // 10 seconds
+
+static uint8_t *readFile(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if(f == NULL) {
+        fprintf(stderr, "Couldn't open %s\n", path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(*size + 1);
+    if(data == NULL || fread(data, 1, *size, f) != *size) {
+        fprintf(stderr, "Couldn't read %s\n", path);
+        fclose(f);
+        free(data);
+        return NULL;
+    }
+    fclose(f);
+    return data;
+}
+
+static sc8_state state;
+
+static int record(const uint8_t *rom, size_t rom_size, const char *out_path, uint64_t frames, uint32_t seed, uint32_t instructions_per_frame) {
+    sc8_init(&state);
+    sc8_loadRom(&state, rom, rom_size);
+    state.xorRandState = seed;
+
+    static sc8_keyEvent logged[256];
+    sc8_keyLog log = { logged, 0, sizeof(logged) / sizeof(logged[0]), false };
+    sc8_attachKeyLog(&state, &log);
+
+    sc8_movieInfo info = { 0 };
+    info.randState = seed;
+    info.instructionsPerFrame = instructions_per_frame;
+    info.keyframeEvery = KEYFRAME_EVERY;
+    info.firstFrame = state.frames;
+    info.frames = frames;
+    info.keyframes = (frames + KEYFRAME_EVERY - 1) / KEYFRAME_EVERY;
+    if(info.keyframes == 0) {
+        info.keyframes = 1;
+    }
+    uint64_t *hashes = malloc(frames * sizeof(*hashes) + 1);
+    sc8_movieKeyframe *keyframes = calloc(info.keyframes, sizeof(*keyframes));
+    sc8_keyEvent *events = NULL;
+    size_t capacity = 0;
+
+    uint32_t input = seed * 2654435761u + 1; // not xorRandState, that belongs to the game
+    for(uint64_t f = 0; f < frames || (f == 0 && frames == 0); f++) {
+        if(f % KEYFRAME_EVERY == 0) {
+            uint8_t *image = malloc(SC8_STATE_MAX);
+            sc8_movieKeyframe *key = &keyframes[f / KEYFRAME_EVERY];
+            key->size = sc8_saveState(&state, rom, rom_size, image, SC8_STATE_MAX);
+            key->image = image;
+            key->firstEvent = info.events;
+        }
+        if(f == frames) {
+            break;
+        }
+
+        input ^= input << 13;
+        input ^= input >> 17;
+        input ^= input << 5;
+        if(input % 8 == 0) {
+            const uint8_t key = input >> 8 & 0xF;
+            if(state.key[key]) {
+                sc8_keyUp(&state, key, 0);
+            } else {
+                sc8_keyDown(&state, key, 0);
+            }
+        }
+        while(state.frames == info.firstFrame + f) {
+            sc8_runFrame(&state, instructions_per_frame); // carry on past unknown opcodes
+        }
+
+        if(info.events + log.count > capacity) {
+            capacity = (capacity + log.count) * 2;
+            events = realloc(events, capacity * sizeof(*events));
+        }
+        memcpy(events + info.events, log.events, log.count * sizeof(*events));
+        info.events += log.count;
+        log.count = 0;
+        hashes[f] = sc8_stateHash(&state);
+    }
+
+    const size_t size = sc8_movieWrite(NULL, 0, &info, rom, rom_size, events, hashes, keyframes);
+    uint8_t *movie = malloc(size);
+    sc8_movieWrite(movie, size, &info, rom, rom_size, events, hashes, keyframes);
+    FILE *out = fopen(out_path, "wb");
+    if(out == NULL || fwrite(movie, 1, size, out) != size) {
+        fprintf(stderr, "Couldn't write %s\n", out_path);
+        return 1;
+    }
+    fclose(out);
+    printf("%llu frames, %u key events, %u keyframes, %zu bytes\n",
+           (unsigned long long)frames, info.events, info.keyframes, size);
+    return 0;
+}
+
+typedef struct {
+    sc8_movie movie; // a copy each, playing moves `nextEvent` on
+    sc8_state state;
+    const uint8_t *rom;
+    size_t romSize;
+    uint32_t job, jobs;
+    uint64_t firstBad;
+    pthread_t thread;
+} Worker;
+
+// Checks keyframe segments `job`, `job + jobs`... and leaves the first frame that
+// didn't match in `firstBad` (UINT64_MAX when they all did).
+static void *verifySegments(void *data) {
+    Worker *worker = data;
+    sc8_movie *movie = &worker->movie;
+    const uint64_t every = movie->info.keyframeEvery;
+    worker->firstBad = UINT64_MAX;
+    for(uint64_t k = worker->job; k * every < movie->info.frames; k += worker->jobs) {
+        sc8_init(&worker->state);
+        if(sc8_movieSeek(movie, &worker->state, worker->rom, worker->romSize, k * every) != sc8_loadState_OK) {
+            worker->firstBad = SC8_MIN(worker->firstBad, k * every);
+            break;
+        }
+        const uint64_t end = SC8_MIN((k + 1) * every, movie->info.frames);
+        for(uint64_t f = k * every; f < end; f++) {
+            if(!sc8_moviePlayFrame(movie, &worker->state)) {
+                worker->firstBad = SC8_MIN(worker->firstBad, f);
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+static int verify(const uint8_t *rom, size_t rom_size, const char *movie_path, uint32_t jobs) {
+    size_t size;
+    uint8_t *data = readFile(movie_path, &size);
+    if(data == NULL) {
+        return 1;
+    }
+    sc8_movie movie;
+    const sc8_LoadStateResult result = sc8_movieOpen(&movie, data, size, rom, rom_size);
+    if(result != sc8_loadState_OK) {
+        fprintf(stderr, "Can't play %s, code: %d\n", movie_path, result);
+        return 1;
+    }
+
+    Worker *workers = calloc(jobs, sizeof(*workers));
+    if(workers == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    uint32_t started = 0;
+    for(; started < jobs; started++) {
+        Worker *worker = &workers[started];
+        worker->movie = movie;
+        worker->rom = rom;
+        worker->romSize = rom_size;
+        worker->job = started;
+        worker->jobs = jobs;
+        if(pthread_create(&worker->thread, NULL, verifySegments, worker) != 0) {
+            fprintf(stderr, "Couldn't start a worker\n");
+            break;
+        }
+    }
+    uint64_t first_bad = UINT64_MAX;
+    for(uint32_t job = 0; job < started; job++) {
+        pthread_join(workers[job].thread, NULL);
+        first_bad = SC8_MIN(first_bad, workers[job].firstBad);
+    }
+    free(workers);
+    if(started != jobs) {
+        return 1;
+    }
+
+    if(first_bad != UINT64_MAX) {
+        printf("Diverged at frame %llu of %llu\n", (unsigned long long)first_bad, (unsigned long long)movie.info.frames);
+        return 1;
+    }
+    printf("%llu frames OK (%u jobs)\n", (unsigned long long)movie.info.frames, jobs);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if(argc < 4 || (strcmp(argv[1], "record") == 0 && argc < 5)) {
+        fprintf(stderr, "usage: %s record <rom.ch8> <out.sc8m> <frames> [seed] [instructions per frame]\n"
+                        "       %s verify <rom.ch8> <movie.sc8m> [jobs]\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    size_t rom_size;
+    uint8_t *rom = readFile(argv[2], &rom_size);
+    if(rom == NULL) {
+        return 1;
+    }
+    if(rom_size == 0 || rom_size >= MEMORY_SIZE - 512) {
+        fprintf(stderr, "%s is empty or too big\n", argv[2]);
+        return 1;
+    }
+
+    if(strcmp(argv[1], "record") == 0) {
+        const uint32_t seed = (argc > 5) ? strtoul(argv[5], NULL, 0) : 1;
+        const uint32_t instructions_per_frame = (argc > 6) ? strtoul(argv[6], NULL, 0) : 11;
+        return record(rom, rom_size, argv[3], strtoull(argv[4], NULL, 0), seed, instructions_per_frame);
+    }
+    if(strcmp(argv[1], "verify") == 0) {
+        long jobs = (argc > 4) ? strtol(argv[4], NULL, 0) : sysconf(_SC_NPROCESSORS_ONLN);
+        return verify(rom, rom_size, argv[3], (uint32_t)SC8_MAX(jobs, 1L));
+    }
+    fprintf(stderr, "Unknown command %s\n", argv[1]);
+    return 1;
+}
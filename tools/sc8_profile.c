@@ -0,0 +1,284 @@
+// Per-PC profile of a ROM.
+//
+// usage: sc8_profile <rom.ch8> <out> [frames] [instructions per frame]
+//
+// Plays the ROM headless (keys mashed at random so it gets past its title screen) with the
+// profiler built in, has the faults it runs into printed to stderr by the event drain thread
+// as it goes, prints the opcode histogram, the busiest skips, the hottest loops and
+// the guest's subroutines with who calls them, and how memory got used (code, data, and code
+// that gets written, page by page), and writes:
+//   `<out>.prof`          see `sc8_profileDump`
+//   `<out>.folded`        one line per pc that ran nested under the loops around it,
+//   `<out>.calls.folded`  one line per chain of 2NNN calls, both for flamegraph.pl and friends
+//   `<out>.heat.ppm`      the 4 KB of memory as 64x64 cells, a row of cells per 64 bytes, with
+//                         executed in blue, read in green and written in red (log scale)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define SC8_PROFILE
+#define SC8_EVENT_THREAD
+#define SC8_USE_STDIO
+#include "../smallCHIP-8.h"
+
+void sc8_beep(void) {}
+
+#define TOP 10
+
+static sc8_state state;
+static sc8_profile profile;
+static sc8_eventLog events;
+static sc8_eventPrinter printer;
+static sc8_hotLoop loops[256];
+static uint32_t loopCount;
+static sc8_routineProfile routines[SC8_PROFILE_NODES];
+static sc8_callEdge edges[SC8_PROFILE_NODES];
+static sc8_memRegion regions[MEMORY_SIZE];
+
+#define HEAT_CELL 4 // pixels per address, each way
+
+static int compareCounts(const void *a, const void *b) {
+    const uint64_t x = profile.executed[*(const uint16_t *)a], y = profile.executed[*(const uint16_t *)b];
+    return (x < y) - (x > y);
+}
+
+static void writeFolded(FILE *out, const char *name) {
+    for(int pc = 0; pc < MEMORY_SIZE; pc++) {
+        if(profile.executed[pc] == 0) {
+            continue;
+        }
+        fprintf(out, "%s", name);
+        // `loops` is sorted by instructions, the outer ones run at least as many as the ones inside
+        for(uint32_t l = 0; l < loopCount; l++) {
+            if(loops[l].start <= pc && pc <= loops[l].end) {
+                fprintf(out, ";loop_%03X-%03X", loops[l].start, loops[l].end);
+            }
+        }
+        const uint16_t opcode = state.memory[pc] << 8 | state.memory[(pc + 1) & (MEMORY_SIZE - 1)];
+        fprintf(out, ";%03X_%s %llu\n", pc, sc8_kindName(sc8__decode(opcode)), (unsigned long long)profile.executed[pc]);
+    }
+}
+
+static void writeCallChain(FILE *out, uint16_t node) {
+    if(node != 0) {
+        writeCallChain(out, profile.nodes[node].parent);
+    }
+    fprintf(out, ";sub_%03X", profile.nodes[node].routine);
+}
+
+static void writeCallsFolded(FILE *out, const char *name) {
+    for(uint32_t n = 0; n < profile.nodeCount; n++) {
+        if(profile.nodes[n].self == 0) {
+            continue;
+        }
+        fprintf(out, "%s", name);
+        writeCallChain(out, n);
+        fprintf(out, " %llu\n", (unsigned long long)profile.nodes[n].self);
+    }
+}
+
+static const char *accessName(uint8_t access) {
+    static char name[4];
+    name[0] = (access & SC8_MEM_READ) ? 'r' : '-';
+    name[1] = (access & SC8_MEM_WRITE) ? 'w' : '-';
+    name[2] = (access & SC8_MEM_EXEC) ? 'x' : '-';
+    return name;
+}
+
+// 0 for never, 255 for the busiest address
+static uint8_t heat(uint64_t count, uint64_t busiest) {
+    return (count == 0) ? 0 : (uint8_t)(64 + 191 * log((double)count) / log((double)busiest + 1));
+}
+
+static bool writeHeatmap(const char *path) {
+    uint64_t executed = 1, reads = 1, writes = 1;
+    for(int addr = 0; addr < MEMORY_SIZE; addr++) {
+        executed = SC8_MAX(executed, profile.executed[addr]);
+        reads = SC8_MAX(reads, profile.reads[addr]);
+        writes = SC8_MAX(writes, profile.writes[addr]);
+    }
+    FILE *out = fopen(path, "wb");
+    if(out == NULL) {
+        return false;
+    }
+    enum { SIDE = 64 * HEAT_CELL };
+    fprintf(out, "P6\n%d %d\n255\n", SIDE, SIDE);
+    for(int y = 0; y < SIDE; y++) {
+        for(int x = 0; x < SIDE; x++) {
+            const int addr = (y / HEAT_CELL) * 64 + x / HEAT_CELL;
+            const uint64_t fetched = profile.executed[addr] + profile.executed[(addr - 1) & (MEMORY_SIZE - 1)];
+            const uint8_t pixel[3] = { heat(profile.writes[addr], writes), heat(profile.reads[addr], reads), heat(fetched, executed) };
+            fwrite(pixel, 1, 3, out);
+        }
+    }
+    return fclose(out) == 0;
+}
+
+int main(int argc, char **argv) {
+    if(argc < 3) {
+        fprintf(stderr, "usage: %s <rom.ch8> <out> [frames] [instructions per frame]\n", argv[0]);
+        return 1;
+    }
+    const uint32_t frames = (argc > 3) ? strtoul(argv[3], NULL, 0) : 36000; // 10 minutes
+    const uint32_t instructions_per_frame = (argc > 4) ? strtoul(argv[4], NULL, 0) : 11;
+
+    sc8_init(&state);
+    if(sc8_loadFile(&state, argv[1]) != sc8_loadFile_OK) {
+        fprintf(stderr, "Couldn't load %s\n", argv[1]);
+        return 1;
+    }
+    sc8_attachProfile(&state, &profile);
+    // at most 8 a second of them
+    sc8_attachEventLog(&state, &events, 8, (uint64_t)instructions_per_frame * 60);
+    if(!sc8_eventPrinterStart(&printer, &events, 100)) {
+        fprintf(stderr, "Couldn't start the event thread\n");
+        return 1;
+    }
+
+    uint32_t input = 2463534242u;
+    for(uint32_t f = 0; f < frames; f++) {
+        input ^= input << 13;
+        input ^= input >> 17;
+        input ^= input << 5;
+        if(input % 8 == 0) {
+            const uint8_t key = input >> 8 & 0xF;
+            if(state.key[key]) {
+                sc8_keyUp(&state, key, 0);
+            } else {
+                sc8_keyDown(&state, key, 0);
+            }
+        }
+        const uint64_t frame = state.frames;
+        while(state.frames == frame) {
+            sc8_runFrame(&state, instructions_per_frame);
+        }
+    }
+
+    sc8_eventPrinterStop(&printer);
+
+    uint64_t total = 0;
+    for(int kind = 0; kind < sc8__kindCount; kind++) {
+        total += profile.kinds[kind];
+    }
+    printf("%llu instructions in %u frames\n\nopcodes:\n", (unsigned long long)total, frames);
+    for(int kind = 0; kind < sc8__kindCount; kind++) {
+        if(profile.kinds[kind] != 0) {
+            printf("  %-8s %12llu  %5.1f%%\n", sc8_kindName(kind), (unsigned long long)profile.kinds[kind],
+                   100.0 * profile.kinds[kind] / total);
+        }
+    }
+
+    static uint16_t skips[MEMORY_SIZE];
+    int skipCount = 0;
+    for(int pc = 0; pc < MEMORY_SIZE - 1; pc++) {
+        const uint16_t opcode = state.memory[pc] << 8 | state.memory[pc + 1];
+        switch(sc8__decode(opcode)) {
+            case sc8__kindSEi: case sc8__kindSNEi: case sc8__kindSE: case sc8__kindSNE:
+            case sc8__kindSKP: case sc8__kindSKNP:
+                if(profile.executed[pc] != 0) {
+                    skips[skipCount++] = pc;
+                }
+                break;
+        }
+    }
+    qsort(skips, skipCount, sizeof(skips[0]), compareCounts);
+    printf("\nbusiest skips:      taken  not taken\n");
+    for(int s = 0; s < SC8_MIN(skipCount, TOP); s++) {
+        const uint16_t pc = skips[s];
+        printf("  %03X %-5s %12llu %10llu\n", pc, sc8_kindName(sc8__decode(state.memory[pc] << 8 | state.memory[pc + 1])),
+               (unsigned long long)profile.skipsTaken[pc], (unsigned long long)(profile.executed[pc] - profile.skipsTaken[pc]));
+    }
+
+    loopCount = sc8_profileHotLoops(&profile, &state, loops, sizeof(loops) / sizeof(loops[0]));
+    printf("\nhot loops:        iterations  instructions\n");
+    for(uint32_t l = 0; l < SC8_MIN(loopCount, (uint32_t)TOP); l++) {
+        printf("  %03X-%03X %16llu %13llu  %5.1f%%\n", loops[l].start, loops[l].end, (unsigned long long)loops[l].iterations,
+               (unsigned long long)loops[l].instructions, 100.0 * loops[l].instructions / total);
+    }
+
+    uint64_t counts[sc8_event_Count], suppressed, dropped;
+    sc8_eventTotals(&events, counts, &suppressed, &dropped);
+    printf("\nevents:\n");
+    for(int kind = 0; kind < sc8_event_Count; kind++) {
+        printf("  %-16s %12llu\n", sc8_eventName(kind), (unsigned long long)counts[kind]);
+    }
+
+    const uint32_t routineCount = sc8_profileRoutines(&profile, routines, SC8_PROFILE_NODES);
+    printf("\nsubroutines:    calls     inclusive     exclusive\n");
+    for(uint32_t r = 0; r < SC8_MIN(routineCount, (uint32_t)TOP); r++) {
+        printf("  %03X %14llu %13llu %13llu  %5.1f%%\n", routines[r].routine, (unsigned long long)routines[r].calls,
+               (unsigned long long)routines[r].inclusive, (unsigned long long)routines[r].exclusive,
+               100.0 * routines[r].inclusive / total);
+    }
+    const uint32_t edgeCount = sc8_profileEdges(&profile, edges, SC8_PROFILE_NODES);
+    printf("\nbusiest calls:           calls\n");
+    for(uint32_t e = 0; e < SC8_MIN(edgeCount, (uint32_t)TOP); e++) {
+        printf("  %03X -> %03X %16llu\n", edges[e].caller, edges[e].callee, (unsigned long long)edges[e].calls);
+    }
+    if(profile.lostDepth > 0 || profile.nodeCount == SC8_PROFILE_NODES) {
+        printf("  (call tree full, deeper calls were counted in their callers)\n");
+    }
+
+    const uint32_t regionCount = sc8_profileRegions(&profile, regions, MEMORY_SIZE);
+    printf("\nmemory:              executed         reads        writes\n");
+    for(uint32_t r = 0; r < regionCount; r++) {
+        printf("  %03X-%03X %s %13llu %13llu %13llu%s\n", regions[r].start, regions[r].end - 1, accessName(regions[r].access),
+               (unsigned long long)regions[r].executed, (unsigned long long)regions[r].reads, (unsigned long long)regions[r].writes,
+               (regions[r].access & SC8_MEM_EXEC && regions[r].access & SC8_MEM_WRITE) ? "  self-modifying" : "");
+    }
+    // whether a page's code could go without the checks on writes
+    printf("\npages:");
+    for(int page = 0; page < MEMORY_SIZE; page += 256) {
+        uint8_t access = 0;
+        for(int addr = page; addr < page + 256; addr++) {
+            access |= sc8_profileAccess(&profile, addr);
+        }
+        printf("%s%03X %s", (page % 1024 == 0) ? "\n  " : "  ", page, accessName(access));
+    }
+    printf("\n");
+
+    char path[1024];
+    snprintf(path, sizeof(path), "%s.prof", argv[2]);
+    const size_t size = sc8_profileDump(&profile, &state, NULL, 0);
+    uint8_t *dump = malloc(size);
+    sc8_profileDump(&profile, &state, dump, size);
+    FILE *out = fopen(path, "wb");
+    if(out == NULL || fwrite(dump, 1, size, out) != size) {
+        fprintf(stderr, "Couldn't write %s\n", path);
+        return 1;
+    }
+    fclose(out);
+    free(dump);
+
+    snprintf(path, sizeof(path), "%s.folded", argv[2]);
+    out = fopen(path, "w");
+    if(out == NULL) {
+        fprintf(stderr, "Couldn't write %s\n", path);
+        return 1;
+    }
+    const char *name = argv[1];
+    for(const char *p = argv[1]; *p; p++) {
+        if(*p == '/' || *p == '\\') {
+            name = p + 1;
+        }
+    }
+    writeFolded(out, name);
+    fclose(out);
+
+    snprintf(path, sizeof(path), "%s.calls.folded", argv[2]);
+    out = fopen(path, "w");
+    if(out == NULL) {
+        fprintf(stderr, "Couldn't write %s\n", path);
+        return 1;
+    }
+    writeCallsFolded(out, name);
+    fclose(out);
+
+    snprintf(path, sizeof(path), "%s.heat.ppm", argv[2]);
+    if(!writeHeatmap(path)) {
+        fprintf(stderr, "Couldn't write %s\n", path);
+        return 1;
+    }
+    return 0;
+}
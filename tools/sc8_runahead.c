@@ -0,0 +1,110 @@
+// Headless run-ahead overhead benchmark.
+//
+// usage: sc8_runahead <rom.ch8> [frames] [max run-ahead] [instructions per frame]
+//
+// Plays the ROM the way the SDL renderer does with `--run-ahead=N`, for every N from 0 up
+// to the max: each frame shown is one real frame, a snapshot copied into a second state, and
+// N frames run on the copy. Keys get mashed at random (the same presses for every N) so the
+// game does something. Prints the time per frame shown and how it compares to no run-ahead,
+// which should stay close to N + 1 as long as snapshots are cheap next to a frame.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define SC8_USE_STDIO
+#include "../smallCHIP-8.h"
+
+void sc8_beep(void) {}
+
+static sc8_state state, ahead;
+static sc8_snapshot snapshot;
+
+static uint64_t nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void runWholeFrame(sc8_state *s, uint32_t instructions_per_frame) {
+    const uint64_t frame = s->frames;
+    while(s->frames == frame) {
+        sc8_runFrame(s, instructions_per_frame);
+    }
+}
+
+// Returns the ns per frame shown, and the ns spent on snapshots in `snapshot_ns`.
+static double play(const uint8_t *rom, size_t rom_size, uint32_t frames, int run_ahead, uint32_t instructions_per_frame, double *snapshot_ns) {
+    sc8_init(&state);
+    sc8_init(&ahead);
+    sc8_loadRom(&state, rom, rom_size);
+
+    uint32_t input = 2463534242u;
+    uint64_t snapshots = 0;
+    const uint64_t start = nowNs();
+    for(uint32_t f = 0; f < frames; f++) {
+        input ^= input << 13;
+        input ^= input >> 17;
+        input ^= input << 5;
+        if(input % 8 == 0) {
+            const uint8_t key = input >> 8 & 0xF;
+            if(state.key[key]) {
+                sc8_keyUp(&state, key, 0);
+            } else {
+                sc8_keyDown(&state, key, 0);
+            }
+        }
+        runWholeFrame(&state, instructions_per_frame);
+
+        if(run_ahead > 0) {
+            const uint64_t before = nowNs();
+            sc8_takeSnapshot(&snapshot, &state);
+            sc8_restoreSnapshot(&ahead, &snapshot);
+            snapshots += nowNs() - before;
+            for(int n = 0; n < run_ahead; n++) {
+                runWholeFrame(&ahead, instructions_per_frame);
+            }
+        }
+    }
+    *snapshot_ns = (double)snapshots / frames;
+    return (double)(nowNs() - start) / frames;
+}
+
+int main(int argc, char **argv) {
+    if(argc < 2) {
+        fprintf(stderr, "usage: %s <rom.ch8> [frames] [max run-ahead] [instructions per frame]\n", argv[0]);
+        return 1;
+    }
+    FILE *f = fopen(argv[1], "rb");
+    if(f == NULL) {
+        fprintf(stderr, "Couldn't open %s\n", argv[1]);
+        return 1;
+    }
+    static uint8_t rom[MEMORY_SIZE];
+    const size_t rom_size = fread(rom, 1, MEMORY_SIZE - 512 - 1, f);
+    fclose(f);
+    if(rom_size == 0) {
+        fprintf(stderr, "%s is empty\n", argv[1]);
+        return 1;
+    }
+    const uint32_t frames = (argc > 2) ? strtoul(argv[2], NULL, 0) : 36000; // 10 minutes
+    const int max_run_ahead = (argc > 3) ? atoi(argv[3]) : 4;
+    const uint32_t instructions_per_frame = (argc > 4) ? strtoul(argv[4], NULL, 0) : 11;
+    if(frames == 0 || instructions_per_frame == 0) {
+        fprintf(stderr, "Frames and instructions per frame should be positive numbers\n");
+        return 1;
+    }
+
+    printf("%u frames, %u instructions per frame, snapshots are %zu bytes\n", frames, instructions_per_frame, sizeof(sc8_snapshot));
+    printf("run-ahead  ns/frame  snapshot ns  overhead\n");
+    double base = 0;
+    for(int n = 0; n <= max_run_ahead; n++) {
+        double snapshot_ns;
+        const double ns = play(rom, rom_size, frames, n, instructions_per_frame, &snapshot_ns);
+        if(n == 0) {
+            base = ns;
+        }
+        printf("%9d  %8.0f  %11.0f  %7.2fx\n", n, ns, snapshot_ns, ns / base);
+    }
+    return 0;
+}
@@ -0,0 +1,180 @@
+// Sampling hot-spot report.
+//
+// usage: sc8_sample [--interval=US] [--seconds=S] <rom.ch8>...
+//
+// Runs every ROM flat out on a thread of its own (keys mashed at random), first without
+// and then with the SIGPROF sampler, and prints where each ROM spent its time along with
+// what the sampler cost in instructions per second. Linux only, like the sampler.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#define SC8_SAMPLER
+#define SC8_USE_STDIO
+#include "../smallCHIP-8.h"
+
+void sc8_beep(void) {}
+
+#define MAX_ROMS SC8_SAMPLER_STATES
+#define TOP 10
+
+typedef struct {
+    const char *path;
+    uint8_t rom[MEMORY_SIZE];
+    size_t romSize;
+    sc8_state state;
+    uint64_t instructions;
+    pthread_t thread;
+} Job;
+
+static Job jobs[MAX_ROMS];
+static int jobCount;
+static volatile bool running;
+
+static void *runRom(void *data) {
+    Job *job = data;
+    sc8_init(&job->state);
+    sc8_loadRom(&job->state, job->rom, job->romSize);
+    job->instructions = 0;
+    uint32_t input = 2463534242u;
+    while(running) {
+        input ^= input << 13;
+        input ^= input >> 17;
+        input ^= input << 5;
+        if(input % 8 == 0) {
+            const uint8_t key = input >> 8 & 0xF;
+            if(job->state.key[key]) {
+                sc8_keyUp(&job->state, key, 0);
+            } else {
+                sc8_keyDown(&job->state, key, 0);
+            }
+        }
+        // a frame's worth, ticking the timers once like `sc8_runFrame` minus the early stops
+        job->instructions += sc8_stepMany(&job->state, 11);
+        job->state.wait = sc8_wait_None;
+        sc8_tickTimers(&job->state);
+    }
+    return NULL;
+}
+
+static sc8_hotSpots roms[MAX_ROMS];
+static uint32_t romCount;
+static sc8_sample samples[SC8_SAMPLER_RING];
+
+static void drain(void) {
+    uint32_t n;
+    while((n = sc8_samplerDrain(samples, SC8_SAMPLER_RING)) > 0) {
+        sc8_hotSpotsAdd(roms, &romCount, MAX_ROMS, samples, n);
+    }
+}
+
+// Runs every ROM for `seconds`, returns the instructions per second they managed together.
+static double runAll(double seconds, bool sampled) {
+    running = true;
+    for(int j = 0; j < jobCount; j++) {
+        if(sampled) {
+            sc8_samplerRegister(&jobs[j].state, jobs[j].rom, jobs[j].romSize);
+        }
+        pthread_create(&jobs[j].thread, NULL, runRom, &jobs[j]);
+    }
+    struct timespec tick = { 0, 10 * 1000 * 1000 };
+    for(double t = 0; t < seconds; t += 0.01) {
+        nanosleep(&tick, NULL);
+        drain();
+    }
+    running = false;
+    uint64_t instructions = 0;
+    for(int j = 0; j < jobCount; j++) {
+        pthread_join(jobs[j].thread, NULL);
+        if(sampled) {
+            sc8_samplerUnregister(&jobs[j].state);
+        }
+        instructions += jobs[j].instructions;
+    }
+    drain();
+    return instructions / seconds;
+}
+
+static const sc8_hotSpots *spotsOf(const Job *job) {
+    const uint32_t hash = sc8__romHash(job->rom, job->romSize);
+    for(uint32_t r = 0; r < romCount; r++) {
+        if(roms[r].romHash == hash) {
+            return &roms[r];
+        }
+    }
+    return NULL;
+}
+
+static void report(const Job *job) {
+    const sc8_hotSpots *spots = spotsOf(job);
+    printf("\n%s: ", job->path);
+    if(spots == NULL || spots->samples == 0) {
+        printf("no samples\n");
+        return;
+    }
+    printf("%llu samples\n", (unsigned long long)spots->samples);
+    bool shown[MEMORY_SIZE] = { false };
+    for(int t = 0; t < TOP; t++) {
+        int best = -1;
+        for(int pc = 0; pc < MEMORY_SIZE; pc++) {
+            if(!shown[pc] && spots->pcs[pc] != 0 && (best < 0 || spots->pcs[pc] > spots->pcs[best])) {
+                best = pc;
+            }
+        }
+        if(best < 0) {
+            break;
+        }
+        shown[best] = true;
+        const uint16_t opcode = job->state.memory[best] << 8 | job->state.memory[(best + 1) & (MEMORY_SIZE - 1)];
+        printf("  %03X %04X %-7s %5.1f%%\n", best, opcode, sc8_kindName(sc8__decode(opcode)),
+               100.0 * spots->pcs[best] / spots->samples);
+    }
+}
+
+int main(int argc, char **argv) {
+    uint32_t interval_us = 1000;
+    double seconds = 2;
+    for(int a = 1; a < argc; a++) {
+        if(strncmp(argv[a], "--interval=", 11) == 0) {
+            interval_us = strtoul(argv[a] + 11, NULL, 0);
+        } else if(strncmp(argv[a], "--seconds=", 10) == 0) {
+            seconds = atof(argv[a] + 10);
+        } else if(jobCount < MAX_ROMS) {
+            Job *job = &jobs[jobCount];
+            FILE *f = fopen(argv[a], "rb");
+            if(f == NULL) {
+                fprintf(stderr, "Couldn't open %s\n", argv[a]);
+                return 1;
+            }
+            job->romSize = fread(job->rom, 1, MEMORY_SIZE - 512 - 1, f);
+            fclose(f);
+            if(job->romSize == 0) {
+                fprintf(stderr, "%s is empty\n", argv[a]);
+                return 1;
+            }
+            job->path = argv[a];
+            jobCount++;
+        }
+    }
+    if(jobCount == 0 || seconds <= 0) {
+        fprintf(stderr, "usage: %s [--interval=US] [--seconds=S] <rom.ch8>...\n", argv[0]);
+        return 1;
+    }
+
+    const double plain = runAll(seconds, false);
+    if(!sc8_samplerStart(interval_us)) {
+        fprintf(stderr, "Couldn't start the sampler\n");
+        return 1;
+    }
+    const double sampled = runAll(seconds, true);
+    sc8_samplerStop();
+
+    printf("%.0f instructions/s without the sampler, %.0f with it every %u us (%+.2f%%), %llu samples dropped\n",
+           plain, sampled, interval_us, 100.0 * (plain - sampled) / plain, (unsigned long long)sc8_samplerDropped());
+    for(int j = 0; j < jobCount; j++) {
+        report(&jobs[j]);
+    }
+    return 0;
+}
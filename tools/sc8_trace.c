@@ -0,0 +1,288 @@
+// Execution tracer, streaming to disk.
+//
+// usage: sc8_trace record <rom.ch8> <out.sc8t> [frames] [instructions per frame]
+//        sc8_trace show <trace.sc8t> <cycle> [count]
+//
+// `record` plays the ROM headless (keys mashed at random) once without and once with the
+// tracer attached, and prints what tracing cost the emulation thread. While it runs, a writer
+// thread drains the trace ring, packs the records into chunks with `sc8_traceEncode` and
+// appends them to the file, and the index of chunks goes at the end once it's done. The trace
+// is lossless: the emulation waits on the writer rather than dropping records.
+// `show` prints `count` records from `cycle` on. It reads the index, seeks straight to the
+// chunk holding that cycle and decodes only that one, so it's instant however big the trace.
+//
+// Layout (little-endian):
+//   "SC8T", u16 version, u16 0, u32 records per chunk
+//   chunks: u32 records, u32 packed size, u64 cycle of the first record, the packed records
+//   index: u64 cycle of the first record, u64 offset, per chunk
+//   u32 chunks, u64 offset of the index, "SC8I"
+
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#define SC8_TRACE
+#define SC8_USE_STDIO
+#include "../smallCHIP-8.h"
+
+void sc8_beep(void) {}
+
+#define TRACE_VERSION 1
+#define CHUNK 4096 // records, the most `show` ever decodes
+
+static void putLe(FILE *out, uint64_t value, int bytes) {
+    for(int b = 0; b < bytes; b++) {
+        fputc((uint8_t)(value >> (8 * b)), out);
+    }
+}
+
+static uint64_t getLe(const uint8_t *at, int bytes) {
+    uint64_t value = 0;
+    for(int b = 0; b < bytes; b++) {
+        value |= (uint64_t)at[b] << (8 * b);
+    }
+    return value;
+}
+
+// CPU time of the calling thread: what the emulation costs, the writer's share of the cores
+// left out.
+static uint64_t nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static sc8_state state;
+static sc8_trace trace;
+
+// Writer thread.
+
+typedef struct {
+    uint64_t cycle;
+    uint64_t offset;
+} IndexEntry;
+
+static FILE *out;
+static volatile bool tracing;
+static sc8_traceRecord chunk[CHUNK];
+static uint8_t packed[SC8_TRACE_PACKED_MAX(CHUNK)];
+static IndexEntry *index_entries;
+static uint32_t chunks, index_capacity;
+static uint64_t records, packed_bytes;
+
+static void writeChunk(uint32_t count) {
+    if(chunks == index_capacity) {
+        index_capacity = (index_capacity == 0) ? 256 : index_capacity * 2;
+        index_entries = realloc(index_entries, index_capacity * sizeof(*index_entries));
+    }
+    index_entries[chunks++] = (IndexEntry){ chunk[0].cycle, (uint64_t)ftello(out) };
+    const size_t size = sc8_traceEncode(chunk, count, packed);
+    putLe(out, count, 4);
+    putLe(out, size, 4);
+    putLe(out, chunk[0].cycle, 8);
+    fwrite(packed, 1, size, out);
+    records += count;
+    packed_bytes += 16 + size;
+}
+
+static void *writer(void *data) {
+    (void)data;
+    uint32_t filled = 0;
+    for(;;) {
+        const bool last = !tracing; // checked before draining, so nothing gets left behind
+        const uint32_t n = sc8_traceDrain(&trace, chunk + filled, CHUNK - filled);
+        filled += n;
+        if(filled == CHUNK) {
+            writeChunk(filled);
+            filled = 0;
+        } else if(n == 0) {
+            if(last) {
+                break;
+            }
+            struct timespec nap = { 0, 100 * 1000 };
+            nanosleep(&nap, NULL);
+        }
+    }
+    if(filled > 0) {
+        writeChunk(filled);
+    }
+    return NULL;
+}
+
+// Recording.
+
+static void runFrames(uint32_t frames, uint32_t instructions_per_frame) {
+    uint32_t input = 2463534242u;
+    for(uint32_t f = 0; f < frames; f++) {
+        input ^= input << 13;
+        input ^= input >> 17;
+        input ^= input << 5;
+        if(input % 8 == 0) {
+            const uint8_t key = input >> 8 & 0xF;
+            if(state.key[key]) {
+                sc8_keyUp(&state, key, 0);
+            } else {
+                sc8_keyDown(&state, key, 0);
+            }
+        }
+        const uint64_t frame = state.frames;
+        while(state.frames == frame) {
+            sc8_runFrame(&state, instructions_per_frame);
+        }
+    }
+}
+
+// Plays the frames from the start, returns how long it took in ns.
+static uint64_t play(const uint8_t *rom, size_t rom_size, uint32_t frames, uint32_t instructions_per_frame) {
+    sc8_init(&state);
+    sc8_loadRom(&state, rom, rom_size);
+    const uint64_t start = nowNs();
+    runFrames(frames, instructions_per_frame);
+    return nowNs() - start;
+}
+
+static int record(const char *rom_path, const char *out_path, uint32_t frames, uint32_t instructions_per_frame) {
+    FILE *f = fopen(rom_path, "rb");
+    if(f == NULL) {
+        fprintf(stderr, "Couldn't open %s\n", rom_path);
+        return 1;
+    }
+    static uint8_t rom[MEMORY_SIZE];
+    const size_t rom_size = fread(rom, 1, MEMORY_SIZE - 512 - 1, f);
+    fclose(f);
+    if(rom_size == 0) {
+        fprintf(stderr, "%s is empty\n", rom_path);
+        return 1;
+    }
+    out = fopen(out_path, "wb");
+    if(out == NULL) {
+        fprintf(stderr, "Couldn't write %s\n", out_path);
+        return 1;
+    }
+    fwrite("SC8T", 1, 4, out);
+    putLe(out, TRACE_VERSION, 2);
+    putLe(out, 0, 2);
+    putLe(out, CHUNK, 4);
+
+    const uint64_t plain = play(rom, rom_size, frames, instructions_per_frame);
+
+    sc8_init(&state);
+    sc8_loadRom(&state, rom, rom_size);
+    sc8_attachTrace(&state, &trace, true);
+    tracing = true;
+    pthread_t thread;
+    if(pthread_create(&thread, NULL, writer, NULL) != 0) {
+        fprintf(stderr, "Couldn't start the writer thread\n");
+        return 1;
+    }
+    const uint64_t start = nowNs();
+    runFrames(frames, instructions_per_frame);
+    const uint64_t traced = nowNs() - start;
+    sc8_attachTrace(&state, NULL, false); // where the run ended, for the drain to finish it
+    tracing = false;
+    pthread_join(thread, NULL);
+
+    const uint64_t index_offset = (uint64_t)ftello(out);
+    for(uint32_t c = 0; c < chunks; c++) {
+        putLe(out, index_entries[c].cycle, 8);
+        putLe(out, index_entries[c].offset, 8);
+    }
+    putLe(out, chunks, 4);
+    putLe(out, index_offset, 8);
+    fwrite("SC8I", 1, 4, out);
+    if(fclose(out) != 0) {
+        fprintf(stderr, "Couldn't write %s\n", out_path);
+        return 1;
+    }
+    free(index_entries);
+
+    printf("%llu records in %u chunks, %llu bytes (%.2f per record, %.1fx smaller than raw records)\n",
+           (unsigned long long)records, chunks, (unsigned long long)packed_bytes, (double)packed_bytes / SC8_MAX(records, 1),
+           (double)records * sizeof(sc8_traceRecord) / SC8_MAX(packed_bytes, 1));
+    printf("%.1f ms without the tracer, %.1f ms with it (%+.1f%%)\n", plain / 1e6, traced / 1e6,
+           100.0 * ((double)traced - plain) / plain);
+    return 0;
+}
+
+// Reading.
+
+static int show(const char *path, uint64_t cycle, uint64_t count) {
+    FILE *in = fopen(path, "rb");
+    if(in == NULL) {
+        fprintf(stderr, "Couldn't open %s\n", path);
+        return 1;
+    }
+    uint8_t head[12], foot[16];
+    if(fread(head, 1, sizeof(head), in) != sizeof(head) || memcmp(head, "SC8T", 4) != 0 ||
+       getLe(head + 4, 2) != TRACE_VERSION || getLe(head + 8, 4) != CHUNK ||
+       fseeko(in, -(off_t)sizeof(foot), SEEK_END) != 0 || fread(foot, 1, sizeof(foot), in) != sizeof(foot) ||
+       memcmp(foot + 12, "SC8I", 4) != 0) {
+        fprintf(stderr, "%s isn't a finished trace\n", path);
+        return 1;
+    }
+    const uint32_t chunk_count = getLe(foot, 4);
+    uint8_t *index = malloc((size_t)chunk_count * 16 + 1);
+    if(fseeko(in, (off_t)getLe(foot + 4, 8), SEEK_SET) != 0 || fread(index, 16, chunk_count, in) != chunk_count) {
+        fprintf(stderr, "Couldn't read the index of %s\n", path);
+        return 1;
+    }
+
+    // last chunk starting at or before `cycle`
+    uint32_t lo = 0, hi = chunk_count;
+    while(hi - lo > 1) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if(getLe(index + mid * 16, 8) <= cycle) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    printf("     cycle   pc  opcode        I  written\n");
+    for(uint32_t c = lo; c < chunk_count && count > 0; c++) {
+        uint8_t chunk_head[16];
+        if(fseeko(in, (off_t)getLe(index + c * 16 + 8, 8), SEEK_SET) != 0 || fread(chunk_head, 1, 16, in) != 16) {
+            fprintf(stderr, "Truncated chunk %u\n", c);
+            return 1;
+        }
+        const uint32_t n = getLe(chunk_head, 4);
+        const uint32_t size = getLe(chunk_head + 4, 4);
+        if(n > CHUNK || size > sizeof(packed) || fread(packed, 1, size, in) != size || !sc8_traceDecode(packed, size, chunk, n)) {
+            fprintf(stderr, "Bad chunk %u\n", c);
+            return 1;
+        }
+        for(uint32_t r = 0; r < n && count > 0; r++) {
+            const sc8_traceRecord *record = &chunk[r];
+            if(record->cycle < cycle) {
+                continue;
+            }
+            printf("%10llu  %03X  %04X %-6s  %03X", (unsigned long long)record->cycle, record->pc, record->opcode,
+                   sc8_kindName(sc8__decode(record->opcode)), record->i);
+            if(record->reg != SC8_TRACE_NONE) {
+                printf("  V%X=%02X", record->reg, record->value);
+            }
+            printf("\n");
+            count--;
+        }
+    }
+    free(index);
+    fclose(in);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if(argc >= 4 && strcmp(argv[1], "record") == 0) {
+        const uint32_t frames = (argc > 4) ? strtoul(argv[4], NULL, 0) : 36000; // 10 minutes
+        const uint32_t instructions_per_frame = (argc > 5) ? strtoul(argv[5], NULL, 0) : 11;
+        return record(argv[2], argv[3], frames, instructions_per_frame);
+    }
+    if(argc >= 4 && strcmp(argv[1], "show") == 0) {
+        const uint64_t count = (argc > 4) ? strtoull(argv[4], NULL, 0) : 20;
+        return show(argv[2], strtoull(argv[3], NULL, 0), count);
+    }
+    fprintf(stderr, "usage: %s record <rom.ch8> <out.sc8t> [frames] [instructions per frame]\n"
+                    "       %s show <trace.sc8t> <cycle> [count]\n", argv[0], argv[0]);
+    return 1;
+}